@@ -0,0 +1,404 @@
+// Generic intrusive AVL tree
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) declare a "node" type, with a "avltree_node_t" as a member
+//   3) call "DEFINE_AVLTREE" with their node-type, the member name, and a
+//      comparison function
+//   4) The user must allocate a "avltree_##type", to store the tree, and call
+//      avltree_##type##_init() on it.
+//   5) The user must allocate all nodes before passing them in
+//   6) When done with the tree user must call "avltree_##type##_destroy" on it
+//
+//   See avltree_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   The interface matches rbtree.h, so the two can be swapped for each other.
+//   Equal nodes are allowed, they're kept in insertion order.
+//   Lookups take a "probe", a node with just the fields "cmp" looks at
+//   filled in, often a local variable.
+//   A node may be in a tree and a dlist at once, with a member for each.
+//
+// Design Decisions:
+//   * AVL keeps the two subtrees of every node within one level of each
+//     other, so the tree is at most ~1.44 log n deep, against ~2 log n for
+//     rbtree.h. Those are worst case bounds, with random keys the two trees
+//     come out within a fraction of a level of each other on average, and
+//     look up in the same time (see avltree_bench.c). The tighter bound
+//     only pays off on insert orders that push rbtree.h towards its worst
+//     case.
+//   * Insert, erase, find and the bounds are O(log n). first/last and
+//     next/prev are O(log n) worst case, O(1) amortized over a walk.
+//   * The search is written by the typed macros, so "cmp" is called
+//     directly and can be inlined. Linking the new node in, rebalancing and
+//     erase don't compare, so they're shared backend functions, as in
+//     dlist.h.
+//   * Nodes store their height rather than a balance factor, so rebalancing
+//     is plain arithmetic, and stops at the first node whose height didn't
+//     change.
+
+#include <assert.h>
+#include <stddef.h>
+#include "offset.h"
+#include "panic.h"
+
+#ifndef AVLTREE_H
+#define AVLTREE_H
+
+// ******************* typedefs ****************
+
+// User should include this as a field in their node struct
+typedef struct avltree_node_struct {
+  struct avltree_node_struct *parent;
+  struct avltree_node_struct *left;
+  struct avltree_node_struct *right;
+  int height;
+} avltree_node_t;
+
+// The backend tree, the typed tree wraps this
+typedef struct {
+  avltree_node_t *root;
+  size_t size;
+} avltree_t;
+
+// Defines the typed tree.
+//   cmp - a function or macro taking two "const type *", returning <0, 0, or
+//         >0 like strcmp
+// find returns a node equal to "probe" (the first, if there are several),
+// lower_bound the first node >= "probe", upper_bound the first node >
+// "probe", all NULL if there isn't one.
+// before returns whether "data" sorts before "probe".
+#define DEFINE_AVLTREE(type, metaname, cmp)  \
+  typedef struct {  \
+    avltree_t tree;  \
+  } avltree_##type;  \
+  void avltree_##type##_init(avltree_##type *root) {  \
+    avltree_init(&root->tree);  \
+  }  \
+  void avltree_##type##_destroy(avltree_##type *root) {  \
+    avltree_destroy(&root->tree);  \
+  }  \
+  int avltree_##type##_empty(const avltree_##type *root) {  \
+    return !root->tree.root;  \
+  }  \
+  size_t avltree_##type##_size(const avltree_##type *root) {  \
+    return root->tree.size;  \
+  }  \
+  int avltree_##type##_height(const avltree_##type *root) {  \
+    return avltree_height(root->tree.root);  \
+  }  \
+  type * avltree_##type##_container(const avltree_node_t *node) {  \
+    return node ? GET_CONTAINER(node, type, metaname) : NULL;  \
+  }  \
+  void avltree_##type##_insert(avltree_##type *root, type *data) {  \
+    avltree_node_t **link = &root->tree.root;  \
+    avltree_node_t *parent = NULL;  \
+    while (*link) {  \
+      parent = *link;  \
+      if (cmp(data, GET_CONTAINER(parent, type, metaname)) < 0)  \
+        link = &parent->left;  \
+      else  \
+        link = &parent->right;  \
+    }  \
+    avltree_link(&root->tree, &(data->metaname), parent, link);  \
+  }  \
+  void avltree_##type##_erase(avltree_##type *root, type *data) {  \
+    avltree_erase(&root->tree, &(data->metaname));  \
+  }  \
+  type * avltree_##type##_lower_bound(const avltree_##type *root,  \
+                                     const type *probe) {  \
+    avltree_node_t *ptr = root->tree.root;  \
+    avltree_node_t *result = NULL;  \
+    while (ptr) {  \
+      if (cmp(GET_CONTAINER(ptr, type, metaname), probe) < 0) {  \
+        ptr = ptr->right;  \
+      } else {  \
+        result = ptr;  \
+        ptr = ptr->left;  \
+      }  \
+    }  \
+    return avltree_##type##_container(result);  \
+  }  \
+  type * avltree_##type##_upper_bound(const avltree_##type *root,  \
+                                     const type *probe) {  \
+    avltree_node_t *ptr = root->tree.root;  \
+    avltree_node_t *result = NULL;  \
+    while (ptr) {  \
+      if (cmp(GET_CONTAINER(ptr, type, metaname), probe) <= 0) {  \
+        ptr = ptr->right;  \
+      } else {  \
+        result = ptr;  \
+        ptr = ptr->left;  \
+      }  \
+    }  \
+    return avltree_##type##_container(result);  \
+  }  \
+  type * avltree_##type##_find(const avltree_##type *root,  \
+                              const type *probe) {  \
+    type *data = avltree_##type##_lower_bound(root, probe);  \
+    return data && cmp(data, probe) == 0 ? data : NULL;  \
+  }  \
+  int avltree_##type##_before(const type *data, const type *probe) {  \
+    return cmp(data, probe) < 0;  \
+  }  \
+  type * avltree_##type##_first(const avltree_##type *root) {  \
+    return avltree_##type##_container(avltree_first(&root->tree));  \
+  }  \
+  type * avltree_##type##_last(const avltree_##type *root) {  \
+    return avltree_##type##_container(avltree_last(&root->tree));  \
+  }  \
+  type * avltree_##type##_next(const type *data) {  \
+    return avltree_##type##_container(avltree_next(&(data->metaname)));  \
+  }  \
+  type * avltree_##type##_prev(const type *data) {  \
+    return avltree_##type##_container(avltree_prev(&(data->metaname)));  \
+  }  \
+  void avltree_##type##_check(const avltree_##type *root) {  \
+    type *data;  \
+    type *last = NULL;  \
+    avltree_check(&root->tree);  \
+    for (data = avltree_##type##_first(root); data;  \
+         data = avltree_##type##_next(data)) {  \
+      if (last)  \
+        assert(cmp(last, data) <= 0);  \
+      last = data;  \
+    }  \
+  }
+
+// Inline iteration, in order, as DLIST_FOREACH in dlist.h
+// The body must not insert or erase, use AVLTREE_FOREACH_SAFE to erase.
+#define AVLTREE_FOREACH(type, root, var)  \
+  for ((var) = avltree_##type##_first(root);  \
+       (var);  \
+       (var) = avltree_##type##_next(var))
+
+// As AVLTREE_FOREACH, but in reverse order
+#define AVLTREE_FOREACH_REVERSE(type, root, var)  \
+  for ((var) = avltree_##type##_last(root);  \
+       (var);  \
+       (var) = avltree_##type##_prev(var))
+
+// As AVLTREE_FOREACH, but "var" may be erased by the body.
+#define AVLTREE_FOREACH_SAFE(type, root, var, tmp)  \
+  for ((var) = avltree_##type##_first(root);  \
+       (var) && (((tmp) = avltree_##type##_next(var)), 1);  \
+       (var) = (tmp))
+
+// Iterates over the nodes "from" <= node < "to", in order.
+//   from, to - "const type *" probes, as for lower_bound
+#define AVLTREE_FOREACH_RANGE(type, root, var, from, to)  \
+  for ((var) = avltree_##type##_lower_bound((root), (from));  \
+       (var) && avltree_##type##_before((var), (to));  \
+       (var) = avltree_##type##_next(var))
+
+
+// ******************* private functions ****************
+
+void avltree_init(avltree_t *root) {
+  root->root = NULL;
+  root->size = 0;
+}
+
+void avltree_destroy(avltree_t *root) {
+  if (root->root) {
+    PANIC("avltree_destroy: tree is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->root = (avltree_node_t*) 0xdeadbeef;
+}
+
+// Height of the subtree under "node", 0 for an empty one
+int avltree_height(const avltree_node_t *node) {
+  return node ? node->height : 0;
+}
+
+void avltree_update_height(avltree_node_t *node) {
+  int left = avltree_height(node->left);
+  int right = avltree_height(node->right);
+  node->height = 1 + (left > right ? left : right);
+}
+
+// Puts "v" where "u" was under u's parent (v may be NULL)
+void avltree_replace(avltree_t *root, avltree_node_t *u, avltree_node_t *v) {
+  if (!u->parent)
+    root->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v)
+    v->parent = u->parent;
+}
+
+// Rotations return the new root of the subtree
+avltree_node_t * avltree_rotate_left(avltree_t *root, avltree_node_t *node) {
+  avltree_node_t *pivot = node->right;
+  node->right = pivot->left;
+  if (pivot->left)
+    pivot->left->parent = node;
+  avltree_replace(root, node, pivot);
+  pivot->left = node;
+  node->parent = pivot;
+  avltree_update_height(node);
+  avltree_update_height(pivot);
+  return pivot;
+}
+
+avltree_node_t * avltree_rotate_right(avltree_t *root, avltree_node_t *node) {
+  avltree_node_t *pivot = node->left;
+  node->left = pivot->right;
+  if (pivot->right)
+    pivot->right->parent = node;
+  avltree_replace(root, node, pivot);
+  pivot->right = node;
+  node->parent = pivot;
+  avltree_update_height(node);
+  avltree_update_height(pivot);
+  return pivot;
+}
+
+// Walks up from "node", whose subtree just changed, fixing heights and
+// rotating wherever the balance is off by 2.
+void avltree_rebalance(avltree_t *root, avltree_node_t *node) {
+  while (node) {
+    avltree_node_t *parent = node->parent;
+    int old_height = node->height;
+    int balance = avltree_height(node->left) - avltree_height(node->right);
+    if (balance > 1) {
+      avltree_node_t *left = node->left;
+      if (avltree_height(left->left) < avltree_height(left->right))
+        avltree_rotate_left(root, left);
+      node = avltree_rotate_right(root, node);
+    } else if (balance < -1) {
+      avltree_node_t *right = node->right;
+      if (avltree_height(right->right) < avltree_height(right->left))
+        avltree_rotate_right(root, right);
+      node = avltree_rotate_left(root, node);
+    } else {
+      avltree_update_height(node);
+    }
+    // Nothing above can have changed
+    if (node->height == old_height)
+      return;
+    node = parent;
+  }
+}
+
+// Links "node" in as a leaf at "*link", a child pointer of "parent" (or the
+// root pointer if "parent" is NULL) found by the typed search, and
+// rebalances.
+void avltree_link(avltree_t *root, avltree_node_t *node, avltree_node_t *parent,
+                  avltree_node_t **link) {
+  node->parent = parent;
+  node->left = NULL;
+  node->right = NULL;
+  node->height = 1;
+  *link = node;
+  root->size++;
+  avltree_rebalance(root, parent);
+}
+
+avltree_node_t * avltree_leftmost(avltree_node_t *node) {
+  while (node->left)
+    node = node->left;
+  return node;
+}
+
+avltree_node_t * avltree_rightmost(avltree_node_t *node) {
+  while (node->right)
+    node = node->right;
+  return node;
+}
+
+void avltree_erase(avltree_t *root, avltree_node_t *node) {
+  // The lowest node whose subtree lost a node
+  avltree_node_t *parent;
+  assert(root->size);
+
+  if (!node->left || !node->right) {
+    parent = node->parent;
+    avltree_replace(root, node, node->left ? node->left : node->right);
+  } else {
+    // Two children, so the successor (which has no left child) is unlinked
+    // from its spot, and takes node's place and height
+    avltree_node_t *next = avltree_leftmost(node->right);
+    if (next->parent == node) {
+      parent = next;
+    } else {
+      parent = next->parent;
+      avltree_replace(root, next, next->right);
+      next->right = node->right;
+      next->right->parent = next;
+    }
+    avltree_replace(root, node, next);
+    next->left = node->left;
+    next->left->parent = next;
+    next->height = node->height;
+  }
+  root->size--;
+  avltree_rebalance(root, parent);
+}
+
+avltree_node_t * avltree_first(const avltree_t *root) {
+  return root->root ? avltree_leftmost(root->root) : NULL;
+}
+
+avltree_node_t * avltree_last(const avltree_t *root) {
+  return root->root ? avltree_rightmost(root->root) : NULL;
+}
+
+avltree_node_t * avltree_next(const avltree_node_t *node) {
+  if (node->right)
+    return avltree_leftmost(node->right);
+  while (node->parent && node == node->parent->right)
+    node = node->parent;
+  return node->parent;
+}
+
+avltree_node_t * avltree_prev(const avltree_node_t *node) {
+  if (node->left)
+    return avltree_rightmost(node->left);
+  while (node->parent && node == node->parent->left)
+    node = node->parent;
+  return node->parent;
+}
+
+// Checks the subtree under "node", returning its height
+int avltree_check_subtree(const avltree_node_t *node, size_t *count) {
+  int left_height;
+  int right_height;
+  if (!node)
+    return 0;
+  (*count)++;
+  if (node->left)
+    assert(node->left->parent == node);
+  if (node->right)
+    assert(node->right->parent == node);
+  left_height = avltree_check_subtree(node->left, count);
+  right_height = avltree_check_subtree(node->right, count);
+  assert(left_height - right_height <= 1);
+  assert(right_height - left_height <= 1);
+  assert(node->height == 1 + (left_height > right_height ? left_height :
+                                                           right_height));
+  return node->height;
+}
+
+// Checks the links, the heights, the balance and the size. The typed check
+// also checks the order.
+void avltree_check(const avltree_t *root) {
+  size_t count = 0;
+  if (root->root)
+    assert(!root->root->parent);
+  avltree_check_subtree(root->root, &count);
+  assert(count == root->size);
+}
+
+#endif
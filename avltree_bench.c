@@ -0,0 +1,140 @@
+// Benchmark for avltree (intrusive AVL tree) against rbtree
+//
+// Usage:
+//   gcc -O2 -o avltree_bench avltree_bench.c
+//   ./avltree_bench [nodes]
+// "nodes" defaults to 1000000. Builds each tree from the same random keys,
+// then reports its height, the mean depth of a node, and the time to look
+// up LOOKUPS random keys that are present, and to insert. The trees take
+// turns with the same nodes, so 50000000 nodes needs about 2.5GB.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "avltree.h"
+#include "bench.h"
+#include "rbtree.h"
+
+#define RUNS 5
+#define LOOKUPS 1000000
+
+typedef struct {
+  long key;
+  union {
+    rbtree_node_t rb_data;
+    avltree_node_t avl_data;
+  };
+} mynode_t;
+
+int mynode_cmp(const mynode_t *a, const mynode_t *b) {
+  return a->key < b->key ? -1 : a->key > b->key;
+}
+
+DEFINE_RBTREE(mynode_t, rb_data, mynode_cmp)
+DEFINE_AVLTREE(mynode_t, avl_data, mynode_cmp)
+
+// Adds up the depth (the root is 1) of every node under "node"
+void rb_depths(const rbtree_node_t *node, int depth, double *sum, int *max) {
+  for (; node; node = node->right, depth++) {
+    *sum += depth;
+    if (depth > *max)
+      *max = depth;
+    rb_depths(node->left, depth + 1, sum, max);
+  }
+}
+
+void avl_depths(const avltree_node_t *node, int depth, double *sum,
+                int *max) {
+  for (; node; node = node->right, depth++) {
+    *sum += depth;
+    if (depth > *max)
+      *max = depth;
+    avl_depths(node->left, depth + 1, sum, max);
+  }
+}
+
+// Times building each tree of "count" nodes, then LOOKUPS finds of
+// "probes", and prints the results. The trees take turns each run, so
+// neither gets a warmer cache. A tree's nodes are then taken over by the
+// other, insert sets all of a node's links, so each is abandoned by
+// starting it again.
+void bench(mynode_t *nodes, size_t count, const mynode_t *probes) {
+  rbtree_mynode_t rb;
+  avltree_mynode_t at;
+  double best[4] = {1e9, 1e9, 1e9, 1e9};
+  double sums[2] = {0, 0};
+  int maxes[2] = {0, 0};
+  size_t found = 0;
+  size_t i;
+  int run;
+  int avl;
+
+  for (run = 0; run < RUNS; run++) {
+    for (avl = 0; avl < 2; avl++) {
+      double times[3];
+      times[0] = bench_now();
+      if (avl) {
+        avltree_mynode_t_init(&at);
+        for (i = 0; i < count; i++)
+          avltree_mynode_t_insert(&at, &nodes[i]);
+        times[1] = bench_now();
+        for (i = 0; i < LOOKUPS; i++)
+          found += avltree_mynode_t_find(&at, &probes[i]) != NULL;
+      } else {
+        rbtree_mynode_t_init(&rb);
+        for (i = 0; i < count; i++)
+          rbtree_mynode_t_insert(&rb, &nodes[i]);
+        times[1] = bench_now();
+        for (i = 0; i < LOOKUPS; i++)
+          found += rbtree_mynode_t_find(&rb, &probes[i]) != NULL;
+      }
+      times[2] = bench_now();
+      if (times[1] - times[0] < best[2 * avl])
+        best[2 * avl] = times[1] - times[0];
+      if (times[2] - times[1] < best[2 * avl + 1])
+        best[2 * avl + 1] = times[2] - times[1];
+      if (run < RUNS - 1)
+        continue;
+      if (avl) {
+        avl_depths(at.tree.root, 1, &sums[1], &maxes[1]);
+        if (maxes[1] != avltree_mynode_t_height(&at))
+          abort();
+      } else {
+        rbtree_mynode_t_check(&rb);
+        rb_depths(rb.tree.root, 1, &sums[0], &maxes[0]);
+      }
+    }
+  }
+  if (found != 2 * RUNS * (size_t) LOOKUPS)
+    abort();
+  avltree_mynode_t_check(&at);
+  while (!avltree_mynode_t_empty(&at))
+    avltree_mynode_t_erase(&at, avltree_mynode_t_first(&at));
+  avltree_mynode_t_destroy(&at);
+  rbtree_mynode_t_init(&rb);
+  rbtree_mynode_t_destroy(&rb);
+  for (avl = 0; avl < 2; avl++) {
+    printf("  %-7s height %2d  mean depth %5.2f  insert %7.1f"
+           "  lookup %7.1f\n", avl ? "avltree" : "rbtree", maxes[avl],
+           sums[avl] / count, best[2 * avl] * 1e9 / count,
+           best[2 * avl + 1] * 1e9 / LOOKUPS);
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t count = bench_arg(argc, argv, 1, 1000000);
+  mynode_t *nodes = malloc(count * sizeof(mynode_t));
+  mynode_t *probes = malloc(LOOKUPS * sizeof(mynode_t));
+  uint64_t seed = 1;
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    nodes[i].key = bench_rand(&seed) >> 1;
+  for (i = 0; i < LOOKUPS; i++)
+    probes[i].key = nodes[bench_rand(&seed) % count].key;
+  printf("%zu random keys (ns/insert, ns/lookup)\n", count);
+  bench(nodes, count, probes);
+  free(probes);
+  free(nodes);
+  return 0;
+}
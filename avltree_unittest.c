@@ -0,0 +1,197 @@
+// Unittest for avltree (intrusive AVL tree)
+
+
+#include <stdio.h>
+#include "assert.h"
+#include "dlist.h"
+#include "avltree.h"
+
+#define NODES 2000
+#define KEYS 500
+
+typedef struct {
+  int key;
+  int seq;
+  avltree_node_t tree_data;
+  dlist_node_t list_data;
+} mynode_t;
+
+int mynode_cmp(const mynode_t *a, const mynode_t *b) {
+  return a->key < b->key ? -1 : a->key > b->key;
+}
+
+DEFINE_AVLTREE(mynode_t, tree_data, mynode_cmp)
+DEFINE_DLIST(mynode_t, list_data)
+
+avltree_mynode_t tree;
+mynode_t nodes[NODES];
+// Whether nodes[i] is in the tree
+char present[NODES];
+// How many nodes with each key are in the tree
+int key_count[KEYS];
+
+// Asserts the tree holds exactly the nodes marked in "present", in key
+// order, equal keys in insertion (seq) order
+void expect_tree(avltree_mynode_t *tree) {
+  mynode_t *n;
+  mynode_t *last = NULL;
+  size_t count = 0;
+  int x;
+  avltree_mynode_t_check(tree);
+  AVLTREE_FOREACH(mynode_t, tree, n) {
+    assert(present[n - nodes]);
+    if (last && last->key == n->key)
+      assert(last->seq < n->seq);
+    last = n;
+    count++;
+  }
+  assert(count == avltree_mynode_t_size(tree));
+  AVLTREE_FOREACH_REVERSE(mynode_t, tree, n) {
+    count--;
+  }
+  assert(count == 0);
+  for (x = 0; x < NODES; x++) {
+    if (present[x])
+      count++;
+  }
+  assert(count == avltree_mynode_t_size(tree));
+}
+
+int main(unsigned int argc, char **argv) {
+  dlist_mynode_t list;
+  mynode_t probe;
+  mynode_t to;
+  mynode_t *n;
+  mynode_t *tmp;
+  int seq = 0;
+  int x;
+
+  printf("initializing tree\n");
+  avltree_mynode_t_init(&tree);
+  expect_tree(&tree);
+  assert(avltree_mynode_t_empty(&tree));
+  assert(!avltree_mynode_t_first(&tree));
+  assert(!avltree_mynode_t_last(&tree));
+  probe.key = 1;
+  assert(!avltree_mynode_t_find(&tree, &probe));
+  assert(!avltree_mynode_t_lower_bound(&tree, &probe));
+
+  printf("ascending and descending inserts\n");
+  for (x = 0; x < 100; x++) {
+    nodes[x].key = x * 2;
+    nodes[x].seq = seq++;
+    avltree_mynode_t_insert(&tree, &nodes[x]);
+    present[x] = 1;
+    avltree_mynode_t_check(&tree);
+  }
+  for (x = 199; x >= 100; x--) {
+    nodes[x].key = (x - 100) * 2 + 1;
+    nodes[x].seq = seq++;
+    avltree_mynode_t_insert(&tree, &nodes[x]);
+    present[x] = 1;
+    avltree_mynode_t_check(&tree);
+  }
+  expect_tree(&tree);
+  // The sparsest AVL tree of height 11 has 232 nodes
+  assert(avltree_mynode_t_height(&tree) <= 10);
+  x = 0;
+  AVLTREE_FOREACH(mynode_t, &tree, n) {
+    assert(n->key == x++);
+  }
+
+  printf("bounds\n");
+  probe.key = 10;
+  assert(avltree_mynode_t_find(&tree, &probe)->key == 10);
+  assert(avltree_mynode_t_lower_bound(&tree, &probe)->key == 10);
+  assert(avltree_mynode_t_upper_bound(&tree, &probe)->key == 11);
+  probe.key = -5;
+  assert(avltree_mynode_t_lower_bound(&tree, &probe)->key == 0);
+  probe.key = 199;
+  assert(!avltree_mynode_t_upper_bound(&tree, &probe));
+  probe.key = 500;
+  assert(!avltree_mynode_t_lower_bound(&tree, &probe));
+  assert(!avltree_mynode_t_find(&tree, &probe));
+
+  printf("range\n");
+  probe.key = 50;
+  to.key = 60;
+  x = 50;
+  AVLTREE_FOREACH_RANGE(mynode_t, &tree, n, &probe, &to) {
+    assert(n->key == x++);
+  }
+  assert(x == 60);
+
+  printf("nodes in a tree and a list at once\n");
+  dlist_mynode_t_init(&list);
+  AVLTREE_FOREACH_REVERSE(mynode_t, &tree, n) {
+    if (n->key % 3 == 0)
+      dlist_mynode_t_push(&list, n);
+  }
+  x = 0;
+  DLIST_FOREACH(mynode_t, &list, n) {
+    assert(n->key == x);
+    probe.key = x;
+    assert(avltree_mynode_t_find(&tree, &probe) == n);
+    x += 3;
+  }
+  while ((n = dlist_mynode_t_first(&list)))
+    dlist_mynode_t_remove(&list, n);
+  dlist_mynode_t_destroy(&list);
+  expect_tree(&tree);
+
+  printf("foreach_safe erase odds\n");
+  AVLTREE_FOREACH_SAFE(mynode_t, &tree, n, tmp) {
+    if (n->key % 2) {
+      avltree_mynode_t_erase(&tree, n);
+      present[n - nodes] = 0;
+    }
+  }
+  expect_tree(&tree);
+  probe.key = 11;
+  assert(!avltree_mynode_t_find(&tree, &probe));
+  assert(avltree_mynode_t_lower_bound(&tree, &probe)->key == 12);
+  AVLTREE_FOREACH_SAFE(mynode_t, &tree, n, tmp) {
+    avltree_mynode_t_erase(&tree, n);
+    present[n - nodes] = 0;
+  }
+  expect_tree(&tree);
+
+  printf("random churn with duplicate keys\n");
+  srand(1);
+  for (x = 0; x < 50000; x++) {
+    int i = rand() % NODES;
+    if (present[i]) {
+      avltree_mynode_t_erase(&tree, &nodes[i]);
+      present[i] = 0;
+      key_count[nodes[i].key]--;
+    } else {
+      nodes[i].key = rand() % KEYS;
+      nodes[i].seq = seq++;
+      avltree_mynode_t_insert(&tree, &nodes[i]);
+      present[i] = 1;
+      key_count[nodes[i].key]++;
+    }
+    if (x % 997 == 0)
+      expect_tree(&tree);
+  }
+  expect_tree(&tree);
+  for (x = 0; x < KEYS; x++) {
+    int count = 0;
+    probe.key = x;
+    n = avltree_mynode_t_find(&tree, &probe);
+    assert(!n == !key_count[x]);
+    assert(n == avltree_mynode_t_lower_bound(&tree, &probe) || !n);
+    for (; n && n->key == x; n = avltree_mynode_t_next(n))
+      count++;
+    assert(count == key_count[x]);
+  }
+
+  AVLTREE_FOREACH_SAFE(mynode_t, &tree, n, tmp) {
+    avltree_mynode_t_erase(&tree, n);
+  }
+  assert(avltree_mynode_t_empty(&tree));
+  avltree_mynode_t_check(&tree);
+  avltree_mynode_t_destroy(&tree);
+
+  printf("PASSED!\n");
+}
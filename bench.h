@@ -0,0 +1,60 @@
+// Helpers shared by the *_bench.c benchmarks
+//
+// Usage:
+//   Each benchmark is a standalone program, like the unittests, and should be
+//   built with optimization, e.g.
+//     gcc -O2 -o dlist_bench dlist_bench.c
+//   The threaded ones also need -lpthread. Sizes can be given on the command
+//   line, see the top of each benchmark.
+//
+// Design Decisions:
+//   * Times are taken with CLOCK_MONOTONIC, and each benchmark reports the
+//     best of a few runs, which is the least disturbed by the rest of the
+//     machine.
+//   * The random numbers come from xorshift64, so the generator is cheap next
+//     to what's being timed, and runs are repeatable.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef BENCH_H
+#define BENCH_H
+
+// Monotonic time, in seconds
+double bench_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// xorshift64, "state" must start non-zero
+uint64_t bench_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+// Shuffles "count" pointers into a random order (Fisher-Yates)
+void bench_shuffle(void **array, size_t count, uint64_t *state) {
+  size_t i;
+  for (i = count; i > 1; i--) {
+    size_t j = bench_rand(state) % i;
+    void *tmp = array[i - 1];
+    array[i - 1] = array[j];
+    array[j] = tmp;
+  }
+}
+
+// Reads a size from argv[index], or returns "def" if it isn't there
+size_t bench_arg(int argc, char **argv, int index, size_t def) {
+  if (argc > index)
+    return (size_t) strtoull(argv[index], NULL, 0);
+  return def;
+}
+
+#endif
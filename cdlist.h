@@ -0,0 +1,267 @@
+// Generic circular doubly-linked list, with a sentinel head
+//
+// Usage:
+//   The same as dlist.h, with "cdlist" in place of "dlist"
+//   1) include this header
+//   2) declare a "node" type, with a "cdlist_node_t" as a member
+//   3) call "DEFINE_CDLIST" with their node-type, and the member name
+//   4) The user must allocate a "cdlist_t", to store the list, and call
+//      cdlist_init() on it.
+//   5) The user must allocate all nodes before passing them in
+//   6) When done with the list user must call "cdlist_destroy" on the list head
+//
+//   See cdlist_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   The list head contains a node that the list points back to, so a
+//   "cdlist_t" must not be copied or moved once it's initialized.
+//
+// Design Decisions:
+//   * The list is circular through a sentinel node in the head, so every
+//     node always has a non-NULL next and prev. Insert and remove are then a
+//     fixed sequence of pointer writes, with no branches, unlike dlist.h
+//     which must special-case the first and last nodes.
+//   * The price is that the end of the list is found by comparing against
+//     the sentinel, so "next" and "prev" need the list head, and that the
+//     head is not relocatable.
+//   * Otherwise we follow dlist.h - everything is in the header, backend
+//     functions are shared by all types, and macros write a typesafe
+//     interface over them.
+
+#include <assert.h>
+#include "offset.h"
+#include "panic.h"
+
+#ifndef CDLIST_H
+#define CDLIST_H
+
+// ******************* typedefs ****************
+
+// User should include this as a field in their node struct
+typedef struct cdlist_node_struct {
+  struct cdlist_node_struct *next;
+  struct cdlist_node_struct *prev;
+} cdlist_node_t;
+
+// User should use this type to store the list
+typedef struct {
+  cdlist_node_t sentinel;
+} cdlist_t;
+
+// As in dlist.h we define a *new* struct that wraps the original, for
+// typechecking, and cast to call the backend.
+#define DEFINE_CDLIST(type, metaname)  \
+  typedef struct {  \
+    cdlist_t list;  \
+  } cdlist_##type;  \
+  void cdlist_##type##_init(cdlist_##type *root) {  \
+    cdlist_init((cdlist_t*) root);  \
+  }  \
+  void cdlist_##type##_destroy(cdlist_##type *root) {  \
+    cdlist_destroy((cdlist_t*) root);  \
+  }  \
+  void cdlist_##type##_check(const cdlist_##type *root) {  \
+    cdlist_check((const cdlist_t*) root);  \
+  }  \
+  int cdlist_##type##_empty(const cdlist_##type *root) {  \
+    return cdlist_empty((const cdlist_t*) root);  \
+  }  \
+  void cdlist_##type##_enqueue(cdlist_##type *root, type *data) {  \
+    cdlist_enqueue((cdlist_t*) root, &(data->metaname));  \
+  }  \
+  void cdlist_##type##_pushback(cdlist_##type *root, type *data) {  \
+    cdlist_pushback((cdlist_t*) root, &(data->metaname));  \
+  }  \
+  void cdlist_##type##_push(cdlist_##type *root, type *data) {  \
+    cdlist_push((cdlist_t*) root, &(data->metaname));  \
+  }  \
+  type * cdlist_##type##_dequeue(cdlist_##type *root) {  \
+    cdlist_node_t *ptr = cdlist_dequeue((cdlist_t*) root);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * cdlist_##type##_pop(cdlist_##type *root) {  \
+    cdlist_node_t *ptr = cdlist_pop((cdlist_t*) root);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  void cdlist_##type##_remove(cdlist_##type *root, type *data) {  \
+    cdlist_remove((cdlist_t*) root, &(data->metaname));  \
+  }  \
+  void cdlist_##type##_concat(cdlist_##type *root, cdlist_##type *src) {  \
+    cdlist_concat((cdlist_t*) root, (cdlist_t*) src);  \
+  }  \
+  type * cdlist_##type##_head(const cdlist_##type *root) {  \
+    cdlist_node_t *ptr = cdlist_head((const cdlist_t*) root);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * cdlist_##type##_tail(const cdlist_##type *root) {  \
+    cdlist_node_t *ptr = cdlist_tail((const cdlist_t*) root);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * cdlist_##type##_next(const cdlist_##type *root, const type *data) {  \
+    cdlist_node_t *ptr = data->metaname.next;  \
+    return ptr != &root->list.sentinel ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * cdlist_##type##_prev(const cdlist_##type *root, const type *data) {  \
+    cdlist_node_t *ptr = data->metaname.prev;  \
+    return ptr != &root->list.sentinel ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  void * cdlist_##type##_foldr(  \
+      const cdlist_##type *root,  \
+      void *(*func)(type*, void*, char*),  \
+      void *init) {  \
+    cdlist_node_t *ptr;  \
+    void* result = init;  \
+    for (ptr = root->list.sentinel.next; ptr != &root->list.sentinel;  \
+         ptr = ptr->next) {  \
+      char terminate = 0;  \
+      result = (*func)(GET_CONTAINER(ptr, type, metaname), result, &terminate);  \
+      if (terminate)  \
+        break;  \
+    }  \
+    return result;  \
+  }  \
+  void * cdlist_##type##_foldl(  \
+      const cdlist_##type *root,  \
+      void *(*func)(type*, void*, char*),  \
+      void *init) {  \
+    cdlist_node_t *ptr;  \
+    void* result = init;  \
+    for (ptr = root->list.sentinel.prev; ptr != &root->list.sentinel;  \
+         ptr = ptr->prev) {  \
+      char terminate = 0;  \
+      result = (*func)(GET_CONTAINER(ptr, type, metaname), result, &terminate);  \
+      if (terminate)  \
+        break;  \
+    }  \
+    return result;  \
+  }
+
+// Inline iteration, as DLIST_FOREACH in dlist.h
+#define CDLIST_FOREACH(type, root, var)  \
+  for ((var) = cdlist_##type##_head(root);  \
+       (var);  \
+       (var) = cdlist_##type##_next((root), (var)))
+
+// As CDLIST_FOREACH, but from tail to head
+#define CDLIST_FOREACH_REVERSE(type, root, var)  \
+  for ((var) = cdlist_##type##_tail(root);  \
+       (var);  \
+       (var) = cdlist_##type##_prev((root), (var)))
+
+// As CDLIST_FOREACH, but "var" may be removed (and freed) by the body.
+#define CDLIST_FOREACH_SAFE(type, root, var, tmp)  \
+  for ((var) = cdlist_##type##_head(root);  \
+       (var) && (((tmp) = cdlist_##type##_next((root), (var))), 1);  \
+       (var) = (tmp))
+
+
+// ******************* private functions ****************
+
+void cdlist_init(cdlist_t *root) {
+  root->sentinel.next = &root->sentinel;
+  root->sentinel.prev = &root->sentinel;
+}
+
+int cdlist_empty(const cdlist_t *root) {
+  return root->sentinel.next == &root->sentinel;
+}
+
+void cdlist_destroy(cdlist_t *root) {
+  if (!cdlist_empty(root)) {
+    PANIC("cdlist_destroy: list is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->sentinel.next = (cdlist_node_t*) 0xdeadbeef;
+  root->sentinel.prev = (cdlist_node_t*) 0xdeadbeef;
+}
+
+// Links "data" in between two adjacent nodes (either may be the sentinel)
+void cdlist_insert_between(cdlist_node_t *prev, cdlist_node_t *next,
+                           cdlist_node_t *data) {
+  data->prev = prev;
+  data->next = next;
+  prev->next = data;
+  next->prev = data;
+}
+
+void cdlist_enqueue(cdlist_t *root, cdlist_node_t *data) {
+  cdlist_insert_between(&root->sentinel, root->sentinel.next, data);
+}
+
+void cdlist_pushback(cdlist_t *root, cdlist_node_t *data) {
+  cdlist_insert_between(root->sentinel.prev, &root->sentinel, data);
+}
+
+void cdlist_push(cdlist_t *root, cdlist_node_t *data) {
+  cdlist_enqueue(root, data);
+}
+
+// "root" is only used for sanity checking, it's taken so the signature
+// matches dlist_remove
+void cdlist_remove(cdlist_t *root, cdlist_node_t *data) {
+  cdlist_node_t *prev = data->prev;
+  cdlist_node_t *next = data->next;
+  assert(data != &root->sentinel);
+  prev->next = next;
+  next->prev = prev;
+}
+
+cdlist_node_t * cdlist_dequeue(cdlist_t *root) {
+  cdlist_node_t *retnode = root->sentinel.prev;
+  if (retnode == &root->sentinel)
+    return NULL;
+  cdlist_remove(root, retnode);
+  return retnode;
+}
+
+cdlist_node_t * cdlist_pop(cdlist_t *root) {
+  cdlist_node_t *retnode = root->sentinel.next;
+  if (retnode == &root->sentinel)
+    return NULL;
+  cdlist_remove(root, retnode);
+  return retnode;
+}
+
+// Moves every node of "src" onto the tail of "root", "src" is left empty.
+void cdlist_concat(cdlist_t *root, cdlist_t *src) {
+  if (cdlist_empty(src))
+    return;
+  cdlist_node_t *first = src->sentinel.next;
+  cdlist_node_t *last = src->sentinel.prev;
+  cdlist_node_t *tail = root->sentinel.prev;
+  tail->next = first;
+  first->prev = tail;
+  last->next = &root->sentinel;
+  root->sentinel.prev = last;
+  cdlist_init(src);
+}
+
+cdlist_node_t * cdlist_head(const cdlist_t *root) {
+  cdlist_node_t *ptr = root->sentinel.next;
+  return ptr != &root->sentinel ? ptr : NULL;
+}
+
+cdlist_node_t * cdlist_tail(const cdlist_t *root) {
+  cdlist_node_t *ptr = root->sentinel.prev;
+  return ptr != &root->sentinel ? ptr : NULL;
+}
+
+void cdlist_check(const cdlist_t *root) {
+  const cdlist_node_t *ptr;
+  const cdlist_node_t *last_ptr = &root->sentinel;
+  for (ptr = root->sentinel.next; ptr != &root->sentinel; ptr = ptr->next) {
+    assert(ptr);
+    assert(ptr->prev == last_ptr);
+    last_ptr = ptr;
+  }
+  assert(root->sentinel.prev == last_ptr);
+}
+
+#endif
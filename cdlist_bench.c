@@ -0,0 +1,182 @@
+// Benchmark for cdlist (sentinel-headed circular list) against dlist
+//
+// Usage:
+//   gcc -O2 -o cdlist_bench cdlist_bench.c
+//   ./cdlist_bench [ops]
+// "ops" defaults to 20000000. Branch mispredicts can be compared by running
+// it under "perf stat -e branches,branch-misses".
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "cdlist.h"
+#include "dlist.h"
+
+#define RUNS 5
+#define NODES 4096
+#define LISTS 1024
+
+typedef struct {
+  cdlist_node_t clist_data;
+  dlist_node_t dlist_data;
+  // Which list the node is in, -1 for none
+  int list;
+} mynode_t;
+
+DEFINE_CDLIST(mynode_t, clist_data)
+DEFINE_DLIST(mynode_t, dlist_data)
+
+mynode_t nodes[NODES];
+cdlist_mynode_t clists[LISTS];
+dlist_mynode_t dlists[LISTS];
+
+// Runs "ops" random operations over many short lists, so whether a list is
+// empty, or a node is at an end, is unpredictable. Each op picks a node, and
+// removes it if it's in a list, otherwise pushes it on either end of a
+// random list. Every fourth op pops from either end of a random list
+// instead. The same seed gives both list types the same sequence.
+double churn_cdlist(size_t ops) {
+  uint64_t seed = 1;
+  size_t i;
+  double start = bench_now();
+  for (i = 0; i < ops; i++) {
+    uint64_t r = bench_rand(&seed);
+    int list = (r >> 16) % LISTS;
+    mynode_t *n;
+    if (!(r & 3)) {
+      n = (r & 4) ? cdlist_mynode_t_pop(&clists[list])
+                  : cdlist_mynode_t_dequeue(&clists[list]);
+      if (n)
+        n->list = -1;
+      continue;
+    }
+    n = &nodes[(r >> 32) % NODES];
+    if (n->list >= 0) {
+      cdlist_mynode_t_remove(&clists[n->list], n);
+      n->list = -1;
+    } else {
+      if (r & 4)
+        cdlist_mynode_t_enqueue(&clists[list], n);
+      else
+        cdlist_mynode_t_pushback(&clists[list], n);
+      n->list = list;
+    }
+  }
+  return bench_now() - start;
+}
+
+double churn_dlist(size_t ops) {
+  uint64_t seed = 1;
+  size_t i;
+  double start = bench_now();
+  for (i = 0; i < ops; i++) {
+    uint64_t r = bench_rand(&seed);
+    int list = (r >> 16) % LISTS;
+    mynode_t *n;
+    if (!(r & 3)) {
+      n = (r & 4) ? dlist_mynode_t_first(&dlists[list])
+                  : dlist_mynode_t_last(&dlists[list]);
+      if (n) {
+        dlist_mynode_t_remove(&dlists[list], n);
+        n->list = -1;
+      }
+      continue;
+    }
+    n = &nodes[(r >> 32) % NODES];
+    if (n->list >= 0) {
+      dlist_mynode_t_remove(&dlists[n->list], n);
+      n->list = -1;
+    } else {
+      if (r & 4)
+        dlist_mynode_t_enqueue(&dlists[list], n);
+      else
+        dlist_mynode_t_pushback(&dlists[list], n);
+      n->list = list;
+    }
+  }
+  return bench_now() - start;
+}
+
+// A FIFO that stays about half full, so the branches are predictable
+double queue_cdlist(size_t ops) {
+  size_t i;
+  double start = bench_now();
+  for (i = 0; i < NODES / 2; i++)
+    cdlist_mynode_t_pushback(&clists[0], &nodes[i]);
+  for (i = 0; i < ops; i++)
+    cdlist_mynode_t_pushback(&clists[0], cdlist_mynode_t_pop(&clists[0]));
+  while (cdlist_mynode_t_pop(&clists[0]))
+    ;
+  return bench_now() - start;
+}
+
+double queue_dlist(size_t ops) {
+  size_t i;
+  double start = bench_now();
+  for (i = 0; i < NODES / 2; i++)
+    dlist_mynode_t_pushback(&dlists[0], &nodes[i]);
+  for (i = 0; i < ops; i++) {
+    mynode_t *n = dlist_mynode_t_first(&dlists[0]);
+    dlist_mynode_t_remove(&dlists[0], n);
+    dlist_mynode_t_pushback(&dlists[0], n);
+  }
+  while (dlist_mynode_t_first(&dlists[0]))
+    dlist_mynode_t_remove(&dlists[0], dlist_mynode_t_first(&dlists[0]));
+  return bench_now() - start;
+}
+
+// Empties and checks all the lists, and marks every node free
+void reset(void) {
+  int x;
+  for (x = 0; x < LISTS; x++) {
+    mynode_t *n;
+    cdlist_mynode_t_check(&clists[x]);
+    dlist_mynode_t_check(&dlists[x]);
+    while (cdlist_mynode_t_pop(&clists[x]))
+      ;
+    while ((n = dlist_mynode_t_first(&dlists[x])))
+      dlist_mynode_t_remove(&dlists[x], n);
+  }
+  for (x = 0; x < NODES; x++)
+    nodes[x].list = -1;
+}
+
+int main(int argc, char **argv) {
+  size_t ops = bench_arg(argc, argv, 1, 20000000);
+  double best[4] = {1e9, 1e9, 1e9, 1e9};
+  int run;
+  int x;
+
+  for (x = 0; x < LISTS; x++) {
+    cdlist_mynode_t_init(&clists[x]);
+    dlist_mynode_t_init(&dlists[x]);
+  }
+  reset();
+  for (run = 0; run < RUNS; run++) {
+    double t;
+    if ((t = churn_cdlist(ops)) < best[0])
+      best[0] = t;
+    reset();
+    if ((t = churn_dlist(ops)) < best[1])
+      best[1] = t;
+    reset();
+    if ((t = queue_cdlist(ops)) < best[2])
+      best[2] = t;
+    reset();
+    if ((t = queue_dlist(ops)) < best[3])
+      best[3] = t;
+    reset();
+  }
+  printf("%zu ops over %d short lists (ns/op)\n", ops, LISTS);
+  printf("  cdlist %6.2f   dlist %6.2f\n", best[0] * 1e9 / ops,
+         best[1] * 1e9 / ops);
+  printf("%zu pop+pushback ops on a %d node FIFO (ns/op)\n", ops, NODES / 2);
+  printf("  cdlist %6.2f   dlist %6.2f\n", best[2] * 1e9 / ops,
+         best[3] * 1e9 / ops);
+  for (x = 0; x < LISTS; x++) {
+    cdlist_mynode_t_destroy(&clists[x]);
+    dlist_mynode_t_destroy(&dlists[x]);
+  }
+  return 0;
+}
@@ -0,0 +1,176 @@
+// Unittest for cdlist (circular doubly linked list)
+
+
+#include <stdio.h>
+#include "assert.h"
+#include "cdlist.h"
+
+typedef struct {
+  int data;
+  cdlist_node_t list_data;
+} mynode_t;
+
+DEFINE_CDLIST(mynode_t, list_data)
+
+cdlist_mynode_t list;
+
+void* print_node(mynode_t *n, void *last, char* term) {
+  printf("%d ", n->data);
+  return 0;
+}
+
+void* is_5(mynode_t *n, void *last, char* term) {
+  if (n->data == 5) {
+    // This short-circuits
+    *term = 1;
+    return n;
+  }
+  return 0;
+}
+
+void print_list(cdlist_mynode_t *list) {
+  printf("flist = [");
+  cdlist_mynode_t_foldl(list, print_node, 0);
+  printf("]\n");
+  printf("blist = [");
+  cdlist_mynode_t_foldr(list, print_node, 0);
+  printf("]\n");
+}
+
+// Asserts "list" holds exactly "expect", in order, and is well formed
+void expect_list(cdlist_mynode_t *list, const int *expect, int len) {
+  mynode_t *n;
+  int i = 0;
+  cdlist_mynode_t_check(list);
+  CDLIST_FOREACH(mynode_t, list, n) {
+    assert(i < len);
+    assert(n->data == expect[i]);
+    i++;
+  }
+  assert(i == len);
+  CDLIST_FOREACH_REVERSE(mynode_t, list, n) {
+    i--;
+    assert(n->data == expect[i]);
+  }
+  assert(i == 0);
+  assert(cdlist_mynode_t_empty(list) == (len == 0));
+}
+
+int main(unsigned int argc, char **argv) {
+  mynode_t *n;
+  mynode_t *tmp;
+  int x;
+
+  printf("initializing list\n");
+  cdlist_mynode_t_init(&list);
+  expect_list(&list, NULL, 0);
+  assert(!cdlist_mynode_t_head(&list));
+  assert(!cdlist_mynode_t_tail(&list));
+  assert(!cdlist_mynode_t_pop(&list));
+  assert(!cdlist_mynode_t_dequeue(&list));
+
+  printf("test base cases\n");
+  n = malloc(sizeof(mynode_t));
+  n->data = 1;
+  printf("pushback\n");
+  cdlist_mynode_t_pushback(&list, n);
+  expect_list(&list, &n->data, 1);
+  printf("remove\n");
+  cdlist_mynode_t_remove(&list, n);
+  expect_list(&list, NULL, 0);
+  printf("enqueue\n");
+  cdlist_mynode_t_enqueue(&list, n);
+  print_list(&list);
+  printf("pop\n");
+  n = cdlist_mynode_t_pop(&list);
+  assert(n->data == 1);
+  printf("push\n");
+  cdlist_mynode_t_push(&list, n);
+  printf("dequeue\n");
+  n = cdlist_mynode_t_dequeue(&list);
+  assert(n->data == 1);
+  free(n);
+  printf("destroy\n");
+  cdlist_mynode_t_destroy(&list);
+  cdlist_mynode_t_init(&list);
+
+  printf("inserting elements\n");
+  for (x = 0; x < 10; x++) {
+    n = malloc(sizeof(mynode_t));
+    n->data = x;
+    if (x % 2)
+      cdlist_mynode_t_pushback(&list, n);
+    else
+      cdlist_mynode_t_enqueue(&list, n);
+  }
+  print_list(&list);
+  {
+    int expect[] = {8, 6, 4, 2, 0, 1, 3, 5, 7, 9};
+    expect_list(&list, expect, 10);
+  }
+
+  n = cdlist_mynode_t_head(&list);
+  assert(n->data == 8);
+  n = cdlist_mynode_t_pop(&list);
+  assert(n->data == 8);
+  free(n);
+  n = cdlist_mynode_t_tail(&list);
+  assert(n->data == 9);
+  n = cdlist_mynode_t_dequeue(&list);
+  assert(n->data == 9);
+  free(n);
+
+  printf("find and remove 5 from the list\n");
+  n = cdlist_mynode_t_foldl(&list, is_5, 0);
+  assert(n && n->data == 5);
+  cdlist_mynode_t_remove(&list, n);
+  free(n);
+  assert(!cdlist_mynode_t_foldl(&list, is_5, 0));
+  {
+    int expect[] = {6, 4, 2, 0, 1, 3, 7};
+    expect_list(&list, expect, 7);
+  }
+
+  printf("concat\n");
+  {
+    cdlist_mynode_t other;
+    cdlist_mynode_t_init(&other);
+    cdlist_mynode_t_concat(&list, &other);
+    for (x = 20; x < 22; x++) {
+      n = malloc(sizeof(mynode_t));
+      n->data = x;
+      cdlist_mynode_t_pushback(&other, n);
+    }
+    cdlist_mynode_t_concat(&list, &other);
+    expect_list(&other, NULL, 0);
+    int expect[] = {6, 4, 2, 0, 1, 3, 7, 20, 21};
+    expect_list(&list, expect, 9);
+    cdlist_mynode_t_concat(&other, &list);
+    expect_list(&list, NULL, 0);
+    expect_list(&other, expect, 9);
+    cdlist_mynode_t_concat(&list, &other);
+    cdlist_mynode_t_destroy(&other);
+  }
+
+  printf("foreach_safe remove odds\n");
+  CDLIST_FOREACH_SAFE(mynode_t, &list, n, tmp) {
+    if (n->data % 2) {
+      cdlist_mynode_t_remove(&list, n);
+      free(n);
+    }
+  }
+  {
+    int expect[] = {6, 4, 2, 0, 20};
+    expect_list(&list, expect, 5);
+  }
+
+  printf("foreach_safe remove all\n");
+  CDLIST_FOREACH_SAFE(mynode_t, &list, n, tmp) {
+    cdlist_mynode_t_remove(&list, n);
+    free(n);
+  }
+  expect_list(&list, NULL, 0);
+  cdlist_mynode_t_destroy(&list);
+
+  printf("PASSED!\n");
+}
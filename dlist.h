@@ -9,6 +9,7 @@
 //   1) include this header
 //   2) declare a "node" type, with a "dlist_node_t" as a member
 //   3) call "DEFINE_DLIST" with their node-type, and the member name
+//      (or "DEFINE_DLIST_COUNTED" if they want an O(1) size)
 //   4) "DEFINE_DLIST" will define a set of dlist functions over the users
 //     node-type
 //   5) The user must allocate a "dlist_t", to store the list, and call
@@ -44,6 +45,16 @@
 //   * It was decided that having foldr and foldl be cleanly abstract was more
 //     important than the icache - another advantage is fast offset calculation
 //     (since an offset must be computed every iteration)
+//   * For hot loops use DLIST_FOREACH and friends instead, the loop body is
+//     written at the call site so there's no jump indirect and no "terminate"
+//     flag, just use "break"
+//   * Walking a long list whose nodes are scattered stalls on a cache miss per
+//     node. DEFINE_DLIST_PREFETCH and DLIST_FOREACH_PREFETCH add traversals
+//     that run a second pointer ahead, prefetching as it goes. That only
+//     hides the misses behind the work done on each node, so it helps when
+//     that work is about as slow as a miss, and not for a bare walk (see
+//     dlist_bench.c). They're opt-in, for short or cache-resident lists the
+//     extra loads are pure overhead.
 
 #include <assert.h>
 #include "offset.h"
@@ -66,14 +77,22 @@ typedef struct {
   dlist_node_t *tail;
 } dlist_t;
 
-// We define a *new* struct that's identical to the original
+// As dlist_t, but also tracks the number of nodes in the list.
+// The list comes first, so it may be cast to a dlist_t for read-only use.
+typedef struct {
+  dlist_t list;
+  size_t size;
+} dlist_counted_t;
+
+// We define a *new* struct that wraps the original
 // Struct types are generative, so this gives us typechecking on the listtype.
-// We can then simply perform a cast to call our backend functions, since
-// we know the two types are actually the same.
+// We can then simply perform a cast to call our backend functions, since a
+// pointer to a struct may be cast to a pointer to its first member. All reads
+// and writes of the list go through the dlist_t, so the compiler's aliasing
+// rules can't reorder them.
 #define DEFINE_DLIST(type, metaname)  \
   typedef struct {  \
-    dlist_node_t *head;  \
-    dlist_node_t *tail;  \
+    dlist_t list;  \
   } dlist_##type;  \
   void dlist_##type##_init(dlist_##type *root) {  \
     dlist_init((dlist_t*) root);  \
@@ -102,19 +121,147 @@ typedef struct {
   dlist_##type##_remove(dlist_##type *root, type *data) {  \
     dlist_remove((dlist_t*) root, &(data->metaname));  \
   }  \
+  void dlist_##type##_concat(dlist_##type *root, dlist_##type *src) {  \
+    dlist_concat((dlist_t*) root, (dlist_t*) src);  \
+  }  \
+  void dlist_##type##_enqueue_array(dlist_##type *root, type **data,  \
+                                    size_t count) {  \
+    dlist_t chain;  \
+    size_t i;  \
+    dlist_init(&chain);  \
+    for (i = 0; i < count; i++)  \
+      dlist_enqueue(&chain, &(data[i]->metaname));  \
+    dlist_splice_after((dlist_t*) root, NULL, &chain);  \
+  }  \
+  void dlist_##type##_pushback_array(dlist_##type *root, type **data,  \
+                                     size_t count) {  \
+    dlist_t chain;  \
+    size_t i;  \
+    dlist_init(&chain);  \
+    for (i = 0; i < count; i++)  \
+      dlist_pushback(&chain, &(data[i]->metaname));  \
+    dlist_concat((dlist_t*) root, &chain);  \
+  }  \
+  void dlist_##type##_splice_after(dlist_##type *root, type *data,  \
+                                   dlist_##type *src) {  \
+    dlist_splice_after((dlist_t*) root, data ? &(data->metaname) : NULL,  \
+                       (dlist_t*) src);  \
+  }  \
+  void dlist_##type##_split_at(dlist_##type *root, type *data,  \
+                               dlist_##type *rest) {  \
+    dlist_split_at((dlist_t*) root, &(data->metaname), (dlist_t*) rest);  \
+  }  \
+  DEFINE_DLIST_ACCESSORS(type, metaname)
+
+// Identical to DEFINE_DLIST, except the list head also carries the number
+// of nodes it holds, maintained by every operation. dlist_##type##_size() is
+// then O(1). Defines the same function names as DEFINE_DLIST, so existing code
+// (and DLIST_FOREACH) works unchanged with either, only one of the two may be
+// used for a given type.
+// Costs one extra word in the head, and an increment on every insert/remove.
+// Note that split_at has to count the nodes it moves, so it is O(moved).
+#define DEFINE_DLIST_COUNTED(type, metaname)  \
+  typedef struct {  \
+    dlist_counted_t list;  \
+  } dlist_##type;  \
+  void dlist_##type##_init(dlist_##type *root) {  \
+    dlist_counted_init((dlist_counted_t*) root);  \
+  }  \
+  void dlist_##type##_destroy(dlist_##type *root) {  \
+    dlist_counted_destroy((dlist_counted_t*) root);  \
+  }  \
+  void dlist_##type##_check(const dlist_##type *root) { \
+    dlist_counted_check((const dlist_counted_t *) root); \
+  }  \
+  size_t dlist_##type##_size(const dlist_##type *root) { \
+    return dlist_counted_size((const dlist_counted_t *) root); \
+  }  \
+  void dlist_##type##_enqueue(dlist_##type *root, type *data) {  \
+    dlist_counted_enqueue((dlist_counted_t*) root, &(data->metaname));  \
+  }  \
+  void dlist_##type##_pushback(dlist_##type *root, type *data) {  \
+    dlist_counted_pushback((dlist_counted_t*) root, &(data->metaname)); \
+  }  \
+  void dlist_##type##_push(dlist_##type *root, type *data) {  \
+    dlist_counted_push((dlist_counted_t*) root, &(data->metaname));  \
+  }  \
+  type * dlist_##type##_dequeue(dlist_##type *root) {  \
+    dlist_node_t *ptr = dlist_counted_dequeue((dlist_counted_t*) root);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * dlist_##type##_pop(dlist_##type *root) {  \
+    dlist_node_t *ptr = dlist_counted_pop((dlist_counted_t*) root);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  void dlist_##type##_remove(dlist_##type *root, type *data) {  \
+    dlist_counted_remove((dlist_counted_t*) root, &(data->metaname));  \
+  }  \
+  void dlist_##type##_concat(dlist_##type *root, dlist_##type *src) {  \
+    dlist_counted_concat((dlist_counted_t*) root, (dlist_counted_t*) src);  \
+  }  \
+  void dlist_##type##_enqueue_array(dlist_##type *root, type **data,  \
+                                    size_t count) {  \
+    dlist_counted_t chain;  \
+    size_t i;  \
+    dlist_counted_init(&chain);  \
+    for (i = 0; i < count; i++)  \
+      dlist_counted_enqueue(&chain, &(data[i]->metaname));  \
+    dlist_counted_splice_after((dlist_counted_t*) root, NULL, &chain);  \
+  }  \
+  void dlist_##type##_pushback_array(dlist_##type *root, type **data,  \
+                                     size_t count) {  \
+    dlist_counted_t chain;  \
+    size_t i;  \
+    dlist_counted_init(&chain);  \
+    for (i = 0; i < count; i++)  \
+      dlist_counted_pushback(&chain, &(data[i]->metaname));  \
+    dlist_counted_concat((dlist_counted_t*) root, &chain);  \
+  }  \
+  void dlist_##type##_splice_after(dlist_##type *root, type *data,  \
+                                   dlist_##type *src) {  \
+    dlist_counted_splice_after((dlist_counted_t*) root,  \
+                               data ? &(data->metaname) : NULL,  \
+                               (dlist_counted_t*) src);  \
+  }  \
+  void dlist_##type##_split_at(dlist_##type *root, type *data,  \
+                               dlist_##type *rest) {  \
+    dlist_counted_split_at((dlist_counted_t*) root, &(data->metaname),  \
+                           (dlist_counted_t*) rest);  \
+  }  \
+  DEFINE_DLIST_ACCESSORS(type, metaname)
+
+// The read-only part of the typed interface, shared by DEFINE_DLIST and
+// DEFINE_DLIST_COUNTED. Not meant to be used directly.
+#define DEFINE_DLIST_ACCESSORS(type, metaname)  \
   type * dlist_##type##_head(const dlist_##type *root){  \
     return GET_CONTAINER(dlist_head((dlist_t*) root), type, metaname);  \
   }  \
   type * dlist_##type##_tail(const dlist_##type *root){  \
     return GET_CONTAINER(dlist_tail((dlist_t*) root), type, metaname);  \
   }  \
+  type * dlist_##type##_first(const dlist_##type *root){  \
+    dlist_node_t *ptr = dlist_head((const dlist_t*) root);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * dlist_##type##_last(const dlist_##type *root){  \
+    dlist_node_t *ptr = dlist_tail((const dlist_t*) root);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * dlist_##type##_next(const type *data){  \
+    dlist_node_t *ptr = data->metaname.next;  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * dlist_##type##_prev(const type *data){  \
+    dlist_node_t *ptr = data->metaname.prev;  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
   void * dlist_##type##_foldr(  \
       const dlist_##type *root,  \
       void *(*func)(type*, void*, char*),  \
       void *init) {  \
     dlist_node_t *ptr;  \
     void* result = init;  \
-    for (ptr = root->head; ptr; ptr = ptr->next) {  \
+    for (ptr = dlist_head((const dlist_t*) root); ptr; ptr = ptr->next) {  \
       char terminate = 0;  \
       result = (*func)(GET_CONTAINER(ptr, type, metaname), result, &terminate);  \
       if (terminate)  \
@@ -128,14 +275,335 @@ typedef struct {
       void *init) {  \
     dlist_node_t *ptr;  \
     void* result = init;  \
-    for (ptr = root->tail; ptr; ptr = ptr->prev) {  \
+    for (ptr = dlist_tail((const dlist_t*) root); ptr; ptr = ptr->prev) {  \
+      char terminate = 0;  \
+      result = (*func)(GET_CONTAINER(ptr, type, metaname), result, &terminate);  \
+      if (terminate)  \
+        break;  \
+    }  \
+    return result;  \
+  }
+
+// Inline iteration, the body is the statement following the macro.
+//   type - the node-type given to DEFINE_DLIST
+//   root - pointer to the list
+//   var  - a "type *" that is set to each node in turn
+// Unlike foldr/foldl there is no function pointer, so the body is inlined
+// and may simply "break" or "return".
+// The body must not remove "var" from the list, use DLIST_FOREACH_SAFE for
+// that.
+#define DLIST_FOREACH(type, root, var)  \
+  for ((var) = dlist_##type##_first(root);  \
+       (var);  \
+       (var) = dlist_##type##_next(var))
+
+// As DLIST_FOREACH, but from tail to head
+#define DLIST_FOREACH_REVERSE(type, root, var)  \
+  for ((var) = dlist_##type##_last(root);  \
+       (var);  \
+       (var) = dlist_##type##_prev(var))
+
+// As DLIST_FOREACH, but "var" may be removed (and freed) by the body.
+//   tmp - a second "type *", used to hold the next node
+#define DLIST_FOREACH_SAFE(type, root, var, tmp)  \
+  for ((var) = dlist_##type##_first(root);  \
+       (var) && (((tmp) = dlist_##type##_next(var)), 1);  \
+       (var) = (tmp))
+
+// Prefetch hint, a no-op on compilers without __builtin_prefetch.
+// Prefetching never faults, so "addr" may be NULL.
+#if defined(__GNUC__)
+#define DLIST_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define DLIST_PREFETCH(addr) ((void) (addr))
+#endif
+
+// How many nodes ahead of the current one the prefetching traversals
+// fetch. May be overridden before including this header.
+#ifndef DLIST_PREFETCH_DISTANCE
+#define DLIST_PREFETCH_DISTANCE 2
+#endif
+
+// As DLIST_FOREACH, but keeps "ahead" DLIST_PREFETCH_DISTANCE nodes in
+// front of "var", and each step moves it on one node and prefetches that
+// node, so it's in cache by the time "var" gets there. Only worth it on
+// lists too big for the cache, whose nodes are scattered.
+//   ahead - a "dlist_node_t *", used by the loop
+#define DLIST_FOREACH_PREFETCH(type, root, var, ahead)  \
+  for ((var) = dlist_##type##_first(root),  \
+       (ahead) = dlist_prefetch_ahead(dlist_head((const dlist_t*) (root)), 0);  \
+       (var) && (((ahead) = dlist_prefetch_step((ahead), 0)), 1);  \
+       (var) = dlist_##type##_next(var))
+
+// Opt-in, per type, prefetching traversals for a list made by DEFINE_DLIST
+// or DEFINE_DLIST_COUNTED. Defines dlist_##type##_foldr_prefetch() and
+// dlist_##type##_foldl_prefetch(), which behave exactly as foldr and foldl
+// but keep a second pointer DLIST_PREFETCH_DISTANCE nodes ahead, prefetching
+// as it goes, and dlist_##type##_check_prefetch(), which does the same for
+// dlist_check().
+#define DEFINE_DLIST_PREFETCH(type, metaname)  \
+  void * dlist_##type##_foldr_prefetch(  \
+      const dlist_##type *root,  \
+      void *(*func)(type*, void*, char*),  \
+      void *init) {  \
+    dlist_node_t *ptr;  \
+    dlist_node_t *ahead = dlist_prefetch_ahead(  \
+        dlist_head((const dlist_t*) root), 0);  \
+    void* result = init;  \
+    for (ptr = dlist_head((const dlist_t*) root); ptr; ptr = ptr->next) {  \
       char terminate = 0;  \
+      ahead = dlist_prefetch_step(ahead, 0);  \
       result = (*func)(GET_CONTAINER(ptr, type, metaname), result, &terminate);  \
       if (terminate)  \
         break;  \
     }  \
     return result;  \
-  } \
+  }  \
+  void * dlist_##type##_foldl_prefetch(  \
+      const dlist_##type *root,  \
+      void *(*func)(type*, void*, char*),  \
+      void *init) {  \
+    dlist_node_t *ptr;  \
+    dlist_node_t *ahead = dlist_prefetch_ahead(  \
+        dlist_tail((const dlist_t*) root), 1);  \
+    void* result = init;  \
+    for (ptr = dlist_tail((const dlist_t*) root); ptr; ptr = ptr->prev) {  \
+      char terminate = 0;  \
+      ahead = dlist_prefetch_step(ahead, 1);  \
+      result = (*func)(GET_CONTAINER(ptr, type, metaname), result, &terminate);  \
+      if (terminate)  \
+        break;  \
+    }  \
+    return result;  \
+  }  \
+  void dlist_##type##_check_prefetch(const dlist_##type *root) {  \
+    dlist_check_prefetch((const dlist_t*) root);  \
+  }
+
+// Defines dlist_##type##_sort(), dlist_##type##_merge() and
+// dlist_##type##_merge_k() for lists made by DEFINE_DLIST or
+// DEFINE_DLIST_COUNTED.
+//   cmp - a function or macro taking two "const type *", returning <0, 0, or
+//         >0 like strcmp. It's called directly, so the compiler can inline it
+//         (dlist_sort() has to go through a function pointer)
+#define DEFINE_DLIST_SORT(type, metaname, cmp)  \
+  int dlist_##type##_sort_cmp(const dlist_node_t *a,  \
+                              const dlist_node_t *b) {  \
+    return cmp(GET_CONTAINER(a, type, metaname),  \
+               GET_CONTAINER(b, type, metaname));  \
+  }  \
+  void dlist_##type##_sort(dlist_##type *root) {  \
+    DLIST_MERGESORT((dlist_t*) root, dlist_##type##_sort_cmp);  \
+  }  \
+  void dlist_##type##_merge(dlist_##type *root, dlist_##type *src) {  \
+    dlist_node_t *mid = dlist_head((const dlist_t*) src);  \
+    dlist_##type##_concat(root, src);  \
+    DLIST_MERGE((dlist_t*) root, mid, dlist_##type##_sort_cmp);  \
+  }  \
+  void dlist_##type##_merge_k(dlist_##type *root, dlist_##type **srcs,  \
+                              size_t count) {  \
+    DLIST_MERGE_K(root, srcs, count, dlist_##type##_concat,  \
+                  dlist_##type##_sort_cmp);  \
+  }
+
+// The body of dlist_sort() and the typed sorts.
+// This is the bottom-up list mergesort: each pass merges neighbouring runs
+// of length "insize", doubling it until a single pass does one merge. So
+// it's O(n log n), stable, and needs no stack or scratch space. prev
+// pointers are rebuilt as nodes are appended to the output.
+#define DLIST_MERGESORT(root, cmp)  \
+  do {  \
+    dlist_t *sort_root_ = (root);  \
+    dlist_node_t *list_ = sort_root_->head;  \
+    dlist_node_t *tail_ = NULL;  \
+    size_t insize_ = 1;  \
+    if (!list_)  \
+      break;  \
+    for (;;) {  \
+      dlist_node_t *p_ = list_;  \
+      size_t nmerges_ = 0;  \
+      list_ = NULL;  \
+      tail_ = NULL;  \
+      while (p_) {  \
+        dlist_node_t *q_ = p_;  \
+        dlist_node_t *e_;  \
+        size_t psize_ = 0;  \
+        size_t qsize_ = insize_;  \
+        nmerges_++;  \
+        while (q_ && psize_ < insize_) {  \
+          psize_++;  \
+          q_ = q_->next;  \
+        }  \
+        while (psize_ > 0 || (qsize_ > 0 && q_)) {  \
+          if (psize_ == 0) {  \
+            e_ = q_; q_ = q_->next; qsize_--;  \
+          } else if (qsize_ == 0 || !q_) {  \
+            e_ = p_; p_ = p_->next; psize_--;  \
+          } else if (cmp(p_, q_) <= 0) {  \
+            e_ = p_; p_ = p_->next; psize_--;  \
+          } else {  \
+            e_ = q_; q_ = q_->next; qsize_--;  \
+          }  \
+          if (tail_)  \
+            tail_->next = e_;  \
+          else  \
+            list_ = e_;  \
+          e_->prev = tail_;  \
+          tail_ = e_;  \
+        }  \
+        p_ = q_;  \
+      }  \
+      tail_->next = NULL;  \
+      if (nmerges_ <= 1)  \
+        break;  \
+      insize_ *= 2;  \
+    }  \
+    sort_root_->head = list_;  \
+    sort_root_->tail = tail_;  \
+  } while (0)
+
+// The body of dlist_merge() and the typed merges.
+// "list" holds two sorted runs, the second starting at "mid", as left by
+// concatenating the two lists being merged. Walks both runs once, relinking
+// nodes in order. Once either run is used up the remainder of the other is
+// already linked, so it's attached in one step.
+// On ties nodes from the first run go first, so merging is stable.
+#define DLIST_MERGE(list, mid, cmp)  \
+  do {  \
+    dlist_t *merge_list_ = (list);  \
+    dlist_node_t *a_ = merge_list_->head;  \
+    dlist_node_t *b_ = (mid);  \
+    dlist_node_t *a_last_;  \
+    dlist_node_t *head_ = NULL;  \
+    dlist_node_t *tail_ = NULL;  \
+    dlist_node_t *e_;  \
+    if (!b_ || a_ == b_)  \
+      break;  \
+    a_last_ = b_->prev;  \
+    a_last_->next = NULL;  \
+    while (a_ && b_) {  \
+      if (cmp(b_, a_) < 0) {  \
+        e_ = b_; b_ = b_->next;  \
+      } else {  \
+        e_ = a_; a_ = a_->next;  \
+      }  \
+      if (tail_)  \
+        tail_->next = e_;  \
+      else  \
+        head_ = e_;  \
+      e_->prev = tail_;  \
+      tail_ = e_;  \
+    }  \
+    e_ = a_ ? a_ : b_;  \
+    tail_->next = e_;  \
+    e_->prev = tail_;  \
+    merge_list_->head = head_;  \
+    if (a_)  \
+      merge_list_->tail = a_last_;  \
+  } while (0)
+
+// Number of lists DLIST_MERGE_K merges at once. Its heap lives on the stack,
+// so this bounds the stack used. More lists than this are merged in groups.
+#ifndef DLIST_MERGE_K_MAX
+#define DLIST_MERGE_K_MAX 32
+#endif
+
+// The body of the k-way merges.
+// "list" holds "count" sorted runs, at most DLIST_MERGE_K_MAX + 1, run i
+// starting at starts[i], none empty. Each run is cut off at its last node,
+// then they're merged through a binary min-heap of run indices, keyed on
+// each run's next node, ties broken by index so the merge is stable.
+#define DLIST_MERGE_RUNS(list, starts, count, cmp)  \
+  do {  \
+    dlist_t *mr_list_ = (list);  \
+    dlist_node_t **mr_starts_ = (starts);  \
+    size_t mr_count_ = (count);  \
+    dlist_node_t *cur_[DLIST_MERGE_K_MAX + 1];  \
+    dlist_node_t *last_[DLIST_MERGE_K_MAX + 1];  \
+    size_t heap_[DLIST_MERGE_K_MAX + 1];  \
+    size_t nheap_ = 0;  \
+    size_t i_;  \
+    size_t c_;  \
+    int r_;  \
+    dlist_node_t *head_ = NULL;  \
+    dlist_node_t *tail_ = NULL;  \
+    if (mr_count_ < 2)  \
+      break;  \
+    for (i_ = 0; i_ < mr_count_; i_++) {  \
+      cur_[i_] = mr_starts_[i_];  \
+      if (i_ + 1 < mr_count_)  \
+        last_[i_] = mr_starts_[i_ + 1]->prev;  \
+      else  \
+        last_[i_] = mr_list_->tail;  \
+      last_[i_]->next = NULL;  \
+      for (c_ = nheap_++; c_ > 0; c_ = (c_ - 1) / 2) {  \
+        size_t p_ = heap_[(c_ - 1) / 2];  \
+        if (cmp(cur_[i_], cur_[p_]) >= 0)  \
+          break;  \
+        heap_[c_] = p_;  \
+      }  \
+      heap_[c_] = i_;  \
+    }  \
+    while (nheap_ > 1) {  \
+      size_t top_ = heap_[0];  \
+      dlist_node_t *e_ = cur_[top_];  \
+      cur_[top_] = e_->next;  \
+      if (tail_)  \
+        tail_->next = e_;  \
+      else  \
+        head_ = e_;  \
+      e_->prev = tail_;  \
+      tail_ = e_;  \
+      if (!cur_[top_])  \
+        top_ = heap_[--nheap_];  \
+      for (c_ = 0; 2 * c_ + 1 < nheap_; ) {  \
+        size_t l_ = 2 * c_ + 1;  \
+        if (l_ + 1 < nheap_) {  \
+          r_ = cmp(cur_[heap_[l_ + 1]], cur_[heap_[l_]]);  \
+          if (r_ < 0 || (r_ == 0 && heap_[l_ + 1] < heap_[l_]))  \
+            l_++;  \
+        }  \
+        r_ = cmp(cur_[heap_[l_]], cur_[top_]);  \
+        if (r_ > 0 || (r_ == 0 && heap_[l_] > top_))  \
+          break;  \
+        heap_[c_] = heap_[l_];  \
+        c_ = l_;  \
+      }  \
+      heap_[c_] = top_;  \
+    }  \
+    tail_->next = cur_[heap_[0]];  \
+    cur_[heap_[0]]->prev = tail_;  \
+    mr_list_->head = head_;  \
+    mr_list_->tail = last_[heap_[0]];  \
+  } while (0)
+
+// The body of dlist_merge_k() and the typed k-way merges.
+// Each group of up to DLIST_MERGE_K_MAX lists is moved onto the end of
+// "root" with "concat" (so a counted list's size stays right), noting where
+// each starts, then merged in place with DLIST_MERGE_RUNS.
+#define DLIST_MERGE_K(root, srcs, count, concat, cmp)  \
+  do {  \
+    dlist_node_t *mk_starts_[DLIST_MERGE_K_MAX + 1];  \
+    size_t mk_count_ = (count);  \
+    size_t mk_base_;  \
+    size_t mk_i_;  \
+    for (mk_base_ = 0; mk_base_ < mk_count_; mk_base_ += DLIST_MERGE_K_MAX) {  \
+      size_t mk_runs_ = 0;  \
+      dlist_node_t *mk_head_ = dlist_head((const dlist_t*) (root));  \
+      if (mk_head_)  \
+        mk_starts_[mk_runs_++] = mk_head_;  \
+      for (mk_i_ = mk_base_;  \
+           mk_i_ < mk_count_ && mk_i_ < mk_base_ + DLIST_MERGE_K_MAX;  \
+           mk_i_++) {  \
+        mk_head_ = dlist_head((const dlist_t*) (srcs)[mk_i_]);  \
+        if (!mk_head_)  \
+          continue;  \
+        mk_starts_[mk_runs_++] = mk_head_;  \
+        concat((root), (srcs)[mk_i_]);  \
+      }  \
+      DLIST_MERGE_RUNS((dlist_t*) (root), mk_starts_, mk_runs_, cmp);  \
+    }  \
+  } while (0)
 
 
 // ******************* private functions ****************
@@ -146,10 +614,12 @@ void dlist_init(dlist_t *root) {
 }
 
 void dlist_destroy(dlist_t *root) {
-  if(root->head)
-    panic("dlist_destroy: root->head is non-null\n");
-  if(root->tail)
-    panic("dlist_destroy: root->head is non-null\n");
+  if(root->head) {
+    PANIC("dlist_destroy: root->head is non-null");
+  }
+  if(root->tail) {
+    PANIC("dlist_destroy: root->tail is non-null");
+  }
   // Drop some magic, so we notice if it gets used again without initialization
   root->head = (dlist_node_t*) 0xdeadbeef;
   root->tail = (dlist_node_t*) 0xdeadbeef;
@@ -240,6 +710,118 @@ dlist_node_t* dlist_tail(const dlist_t *root) {
   return root->tail;
 }
 
+// Moves every node of "src" into "root" directly after "data", in order.
+// If "data" is NULL the nodes go on the front of "root".
+// "src" is left empty. This is O(1) regardless of the length of either list.
+void dlist_splice_after(dlist_t *root, dlist_node_t *data, dlist_t *src) {
+  dlist_node_t *first = src->head;
+  dlist_node_t *last = src->tail;
+  if (!first) {
+    assert(!last);
+    return;
+  }
+  assert(!first->prev);
+  assert(!last->next);
+
+  dlist_node_t *next;
+  if (data) {
+    next = data->next;
+    data->next = first;
+  } else {
+    next = root->head;
+    root->head = first;
+  }
+  first->prev = data;
+  last->next = next;
+  if (next) {
+    next->prev = last;
+  } else {
+    assert(root->tail == data);
+    root->tail = last;
+  }
+
+  src->head = NULL;
+  src->tail = NULL;
+}
+
+// Moves every node of "src" onto the tail of "root", "src" is left empty.
+void dlist_concat(dlist_t *root, dlist_t *src) {
+  dlist_splice_after(root, root->tail, src);
+}
+
+// Equivalent to calling dlist_enqueue on each of "nodes" in order (so the
+// last one ends up at the head), but the nodes are linked to each other
+// first, and "root" is only touched once.
+// To insert a chain that's already linked, build it in a dlist_t and use
+// dlist_splice_after or dlist_concat.
+void dlist_enqueue_array(dlist_t *root, dlist_node_t **nodes, size_t count) {
+  dlist_t chain;
+  size_t i;
+  dlist_init(&chain);
+  for (i = 0; i < count; i++)
+    dlist_enqueue(&chain, nodes[i]);
+  dlist_splice_after(root, NULL, &chain);
+}
+
+// Equivalent to calling dlist_pushback on each of "nodes" in order, but
+// "root" is only touched once.
+void dlist_pushback_array(dlist_t *root, dlist_node_t **nodes, size_t count) {
+  dlist_t chain;
+  size_t i;
+  dlist_init(&chain);
+  for (i = 0; i < count; i++)
+    dlist_pushback(&chain, nodes[i]);
+  dlist_concat(root, &chain);
+}
+
+// Moves "data" and every node after it out of "root" and into "rest".
+// "rest" must be empty. This is O(1).
+void dlist_split_at(dlist_t *root, dlist_node_t *data, dlist_t *rest) {
+  assert(!rest->head);
+  assert(!rest->tail);
+  dlist_node_t *prev = data->prev;
+
+  rest->head = data;
+  rest->tail = root->tail;
+  data->prev = NULL;
+
+  root->tail = prev;
+  if (prev) {
+    prev->next = NULL;
+  } else {
+    assert(root->head == data);
+    root->head = NULL;
+  }
+}
+
+// Sorts the list in place, stable, never allocates.
+//   cmp - returns <0, 0, or >0 like strcmp
+// For a typed list prefer DEFINE_DLIST_SORT, which can inline the comparison.
+void dlist_sort(dlist_t *root,
+                int (*cmp)(const dlist_node_t*, const dlist_node_t*)) {
+  DLIST_MERGESORT(root, cmp);
+}
+
+// Merges the sorted list "src" into the sorted list "root", leaving "src"
+// empty. O(n+m), stable (on ties nodes from "root" come first), never
+// allocates.
+// Not for dlist_counted_t, use the typed merge from DEFINE_DLIST_SORT.
+void dlist_merge(dlist_t *root, dlist_t *src,
+                 int (*cmp)(const dlist_node_t*, const dlist_node_t*)) {
+  dlist_node_t *mid = src->head;
+  dlist_concat(root, src);
+  DLIST_MERGE(root, mid, cmp);
+}
+
+// Merges "count" sorted lists into the sorted list "root", leaving them all
+// empty. Stable, in the order root, srcs[0], srcs[1], ...
+// O(n log k) for k <= DLIST_MERGE_K_MAX, never allocates.
+// Not for dlist_counted_t, use the typed merge from DEFINE_DLIST_SORT.
+void dlist_merge_k(dlist_t *root, dlist_t **srcs, size_t count,
+                   int (*cmp)(const dlist_node_t*, const dlist_node_t*)) {
+  DLIST_MERGE_K(root, srcs, count, dlist_concat, cmp);
+}
+
 void dlist_check(const dlist_t *root) {
   dlist_node_t *ptr;
   dlist_node_t *last_ptr = NULL;
@@ -255,5 +837,138 @@ void dlist_check(const dlist_t *root) {
   assert(last_ptr == root->tail);
 }
 
+// Returns the node DLIST_PREFETCH_DISTANCE steps from "ptr" (towards the
+// head if "backward"), or NULL if the list ends first
+dlist_node_t * dlist_prefetch_ahead(dlist_node_t *ptr, int backward) {
+  int i;
+  for (i = 0; i < DLIST_PREFETCH_DISTANCE && ptr; i++)
+    ptr = backward ? ptr->prev : ptr->next;
+  return ptr;
+}
+
+// Moves "ahead" on one node and prefetches that node. The load of "ahead"
+// itself was prefetched a step earlier. The new node isn't read until the
+// next step, so its miss overlaps with the work on the current node.
+dlist_node_t * dlist_prefetch_step(dlist_node_t *ahead, int backward) {
+  if (!ahead)
+    return NULL;
+  ahead = backward ? ahead->prev : ahead->next;
+  DLIST_PREFETCH(ahead);
+  return ahead;
+}
+
+// As dlist_check, but prefetches DLIST_PREFETCH_DISTANCE nodes ahead
+void dlist_check_prefetch(const dlist_t *root) {
+  dlist_node_t *ptr;
+  dlist_node_t *last_ptr = NULL;
+  dlist_node_t *ahead = dlist_prefetch_ahead(root->head, 0);
+  for (ptr = root->head; ptr; ptr = ptr->next) {
+    ahead = dlist_prefetch_step(ahead, 0);
+    assert(ptr->prev == last_ptr);
+    if (last_ptr)
+      assert(last_ptr->next == ptr);
+    last_ptr = ptr;
+  }
+  assert(last_ptr == root->tail);
+}
+
+// ******************* counted list functions ****************
+
+void dlist_counted_init(dlist_counted_t *root) {
+  dlist_init(&root->list);
+  root->size = 0;
+}
+
+void dlist_counted_destroy(dlist_counted_t *root) {
+  if (root->size) {
+    PANIC("dlist_counted_destroy: root->size is non-zero");
+  }
+  dlist_destroy(&root->list);
+}
+
+size_t dlist_counted_size(const dlist_counted_t *root) {
+  return root->size;
+}
+
+void dlist_counted_enqueue(dlist_counted_t *root, dlist_node_t *data) {
+  dlist_enqueue(&root->list, data);
+  root->size++;
+}
+
+void dlist_counted_pushback(dlist_counted_t *root, dlist_node_t *data) {
+  dlist_pushback(&root->list, data);
+  root->size++;
+}
+
+void dlist_counted_push(dlist_counted_t *root, dlist_node_t *data) {
+  dlist_counted_enqueue(root, data);
+}
+
+dlist_node_t * dlist_counted_dequeue(dlist_counted_t *root) {
+  dlist_node_t *retnode = dlist_dequeue(&root->list);
+  if (retnode)
+    root->size--;
+  return retnode;
+}
+
+dlist_node_t * dlist_counted_pop(dlist_counted_t *root) {
+  dlist_node_t *retnode = dlist_pop(&root->list);
+  if (retnode)
+    root->size--;
+  return retnode;
+}
+
+void dlist_counted_remove(dlist_counted_t *root, dlist_node_t *data) {
+  assert(root->size);
+  dlist_remove(&root->list, data);
+  root->size--;
+}
+
+void dlist_counted_splice_after(dlist_counted_t *root, dlist_node_t *data,
+                                dlist_counted_t *src) {
+  dlist_splice_after(&root->list, data, &src->list);
+  root->size += src->size;
+  src->size = 0;
+}
+
+void dlist_counted_concat(dlist_counted_t *root, dlist_counted_t *src) {
+  dlist_counted_splice_after(root, root->list.tail, src);
+}
+
+void dlist_counted_enqueue_array(dlist_counted_t *root, dlist_node_t **nodes,
+                                 size_t count) {
+  dlist_enqueue_array(&root->list, nodes, count);
+  root->size += count;
+}
+
+void dlist_counted_pushback_array(dlist_counted_t *root, dlist_node_t **nodes,
+                                  size_t count) {
+  dlist_pushback_array(&root->list, nodes, count);
+  root->size += count;
+}
+
+// Unlike the uncounted version this must walk the moved nodes to count them
+void dlist_counted_split_at(dlist_counted_t *root, dlist_node_t *data,
+                            dlist_counted_t *rest) {
+  assert(!rest->size);
+  size_t moved = 0;
+  dlist_node_t *ptr;
+  for (ptr = data; ptr; ptr = ptr->next)
+    moved++;
+  dlist_split_at(&root->list, data, &rest->list);
+  assert(moved <= root->size);
+  root->size -= moved;
+  rest->size = moved;
+}
+
+void dlist_counted_check(const dlist_counted_t *root) {
+  dlist_check(&root->list);
+  size_t size = 0;
+  dlist_node_t *ptr;
+  for (ptr = root->list.head; ptr; ptr = ptr->next)
+    size++;
+  assert(size == root->size);
+}
+
 #endif
 
@@ -0,0 +1,234 @@
+// Benchmark for dlist (doubly linked list)
+//
+// Usage:
+//   gcc -O2 -o dlist_bench dlist_bench.c
+//   ./dlist_bench [nodes]
+// "nodes" defaults to 10000000, it's the size of the lists scanned, and the
+// number of nodes pushed in the batch test.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "dlist.h"
+
+#define RUNS 5
+
+typedef struct {
+  dlist_node_t list_data;
+  long data;
+} mynode_t;
+
+DEFINE_DLIST(mynode_t, list_data)
+DEFINE_DLIST_PREFETCH(mynode_t, list_data)
+
+dlist_mynode_t list;
+
+void* sum_node(mynode_t *n, void *sum, char *term) {
+  (void) term;
+  *(long*) sum += n->data;
+  return sum;
+}
+
+// Links "count" nodes into "list", in array order if "shuffle" is 0,
+// otherwise in a random order, so each hop is to a random address
+void build(mynode_t *nodes, size_t count, int shuffle) {
+  mynode_t **order = malloc(count * sizeof(mynode_t*));
+  uint64_t seed = 1;
+  size_t i;
+  for (i = 0; i < count; i++) {
+    order[i] = &nodes[i];
+    nodes[i].data = i;
+  }
+  if (shuffle)
+    bench_shuffle((void**) order, count, &seed);
+  dlist_mynode_t_init(&list);
+  for (i = 0; i < count; i++)
+    dlist_mynode_t_pushback(&list, order[i]);
+  free(order);
+}
+
+void empty(void) {
+  mynode_t *n;
+  while ((n = dlist_mynode_t_first(&list)))
+    dlist_mynode_t_remove(&list, n);
+  dlist_mynode_t_destroy(&list);
+}
+
+// Sums the list with foldr, and with DLIST_FOREACH, and prints the best
+// time per node of each. foldr is timed twice, with "sum_node" visible to
+// the compiler (it inlines it here, since everything's in one file), and
+// through a volatile pointer, as if it were in another file.
+void scan(size_t count, const char *name) {
+  void *(* volatile opaque)(mynode_t*, void*, char*) = sum_node;
+  double best[3] = {1e9, 1e9, 1e9};
+  long expect = (long) count * (long) (count - 1) / 2;
+  int run;
+  for (run = 0; run < RUNS; run++) {
+    double times[4];
+    long sums[3] = {0, 0, 0};
+    mynode_t *n;
+    int i;
+    times[0] = bench_now();
+    dlist_mynode_t_foldr(&list, sum_node, &sums[0]);
+    times[1] = bench_now();
+    dlist_mynode_t_foldr(&list, opaque, &sums[1]);
+    times[2] = bench_now();
+    DLIST_FOREACH(mynode_t, &list, n) {
+      sums[2] += n->data;
+    }
+    times[3] = bench_now();
+    for (i = 0; i < 3; i++) {
+      if (sums[i] != expect)
+        abort();
+      if (times[i + 1] - times[i] < best[i])
+        best[i] = times[i + 1] - times[i];
+    }
+  }
+  printf("  %-9s foldr %6.2f   foldr (opaque) %6.2f   DLIST_FOREACH %6.2f\n",
+         name, best[0] * 1e9 / count, best[1] * 1e9 / count,
+         best[2] * 1e9 / count);
+}
+
+// Pushes nodes onto an empty list "size" at a time, one by one with
+// pushback, and with pushback_array, and the same with enqueue, and prints
+// the best time per node of each
+void batch(mynode_t *nodes, size_t count, size_t size) {
+  mynode_t **ptrs = malloc(size * sizeof(mynode_t*));
+  size_t rounds = count / size;
+  double best[4] = {1e9, 1e9, 1e9, 1e9};
+  size_t i;
+  int run;
+  for (i = 0; i < size; i++)
+    ptrs[i] = &nodes[i];
+  for (run = 0; run < RUNS; run++) {
+    double times[5];
+    size_t round;
+    int way;
+    for (way = 0; way < 4; way++) {
+      times[way] = bench_now();
+      for (round = 0; round < rounds; round++) {
+        // The list is emptied by starting it again, and the same nodes
+        // reused, so they stay in cache and the linking is what's timed
+        dlist_mynode_t_init(&list);
+        switch (way) {
+          case 0:
+            for (i = 0; i < size; i++)
+              dlist_mynode_t_pushback(&list, ptrs[i]);
+            break;
+          case 1:
+            dlist_mynode_t_pushback_array(&list, ptrs, size);
+            break;
+          case 2:
+            for (i = 0; i < size; i++)
+              dlist_mynode_t_enqueue(&list, ptrs[i]);
+            break;
+          default:
+            dlist_mynode_t_enqueue_array(&list, ptrs, size);
+            break;
+        }
+      }
+    }
+    times[4] = bench_now();
+    for (way = 0; way < 4; way++) {
+      if (times[way + 1] - times[way] < best[way])
+        best[way] = times[way + 1] - times[way];
+    }
+  }
+  printf("  %4zu  pushback %5.2f  pushback_array %5.2f"
+         "  enqueue %5.2f  enqueue_array %5.2f\n", size,
+         best[0] * 1e9 / (rounds * size), best[1] * 1e9 / (rounds * size),
+         best[2] * 1e9 / (rounds * size), best[3] * 1e9 / (rounds * size));
+  free(ptrs);
+}
+
+// Stands in for the work done on each node, "work" dependent multiplies
+long busy(long v, int work) {
+  int i;
+  for (i = 0; i < work; i++)
+    v = v * 31 + i;
+  return v;
+}
+
+// Walks the (shuffled) list with DLIST_FOREACH and DLIST_FOREACH_PREFETCH,
+// doing "work" on each node, and prints the best time per node of each
+void prefetch(size_t count, int work) {
+  double best[2] = {1e9, 1e9};
+  int run;
+  for (run = 0; run < RUNS; run++) {
+    double times[3];
+    long sums[2] = {0, 0};
+    dlist_node_t *ahead;
+    mynode_t *n;
+    int i;
+    times[0] = bench_now();
+    DLIST_FOREACH(mynode_t, &list, n) {
+      sums[0] += busy(n->data, work);
+    }
+    times[1] = bench_now();
+    DLIST_FOREACH_PREFETCH(mynode_t, &list, n, ahead) {
+      sums[1] += busy(n->data, work);
+    }
+    times[2] = bench_now();
+    if (sums[0] != sums[1])
+      abort();
+    for (i = 0; i < 2; i++) {
+      if (times[i + 1] - times[i] < best[i])
+        best[i] = times[i + 1] - times[i];
+    }
+  }
+  printf("  work %3d  DLIST_FOREACH %6.2f   DLIST_FOREACH_PREFETCH %6.2f\n",
+         work, best[0] * 1e9 / count, best[1] * 1e9 / count);
+}
+
+// As prefetch, for dlist_check and dlist_check_prefetch
+void check(size_t count) {
+  double best[2] = {1e9, 1e9};
+  int run;
+  for (run = 0; run < RUNS; run++) {
+    double start = bench_now();
+    dlist_mynode_t_check(&list);
+    double mid = bench_now();
+    dlist_mynode_t_check_prefetch(&list);
+    double end = bench_now();
+    if (mid - start < best[0])
+      best[0] = mid - start;
+    if (end - mid < best[1])
+      best[1] = end - mid;
+  }
+  printf("  check %6.2f   check_prefetch %6.2f\n", best[0] * 1e9 / count,
+         best[1] * 1e9 / count);
+}
+
+int main(int argc, char **argv) {
+  size_t count = bench_arg(argc, argv, 1, 10000000);
+  mynode_t *nodes = malloc(count * sizeof(mynode_t));
+
+  printf("scan %zu nodes, foldr vs DLIST_FOREACH (ns/node)\n", count);
+  build(nodes, count, 0);
+  scan(count, "in order");
+  empty();
+  build(nodes, count, 1);
+  scan(count, "shuffled");
+  empty();
+
+  printf("walk %zu shuffled nodes, prefetching %d ahead (ns/node)\n", count,
+         DLIST_PREFETCH_DISTANCE);
+  build(nodes, count, 1);
+  prefetch(count, 0);
+  prefetch(count, 20);
+  prefetch(count, 100);
+  check(count);
+  empty();
+
+  printf("push %zu nodes in batches, per-node vs _array (ns/node)\n", count);
+  batch(nodes, count, 64);
+  batch(nodes, count, 128);
+  batch(nodes, count, 256);
+  batch(nodes, count, 512);
+  dlist_mynode_t_init(&list);
+  dlist_mynode_t_destroy(&list);
+
+  free(nodes);
+  return 0;
+}
@@ -15,7 +15,33 @@ typedef struct {
 } mynode_t;
 
 DEFINE_DLIST(mynode_t, list_data)
+DEFINE_DLIST_PREFETCH(mynode_t, list_data)
+
+typedef struct {
+  int data;
+  dlist_node_t list_data;
+} mycnode_t;
+
+DEFINE_DLIST_COUNTED(mycnode_t, list_data)
   
+// Orders by data/1000 only, so ties are common and stability can be tested
+int mynode_cmp(const mynode_t *a, const mynode_t *b) {
+  return a->data / 1000 - b->data / 1000;
+}
+
+DEFINE_DLIST_SORT(mynode_t, list_data, mynode_cmp)
+
+int mycnode_cmp(const mycnode_t *a, const mycnode_t *b) {
+  return a->data / 1000 - b->data / 1000;
+}
+
+DEFINE_DLIST_SORT(mycnode_t, list_data, mycnode_cmp)
+
+int mycnode_node_cmp(const dlist_node_t *a, const dlist_node_t *b) {
+  return GET_CONTAINER(a, mycnode_t, list_data)->data / 1000 -
+         GET_CONTAINER(b, mycnode_t, list_data)->data / 1000;
+}
+
 dlist_mynode_t list;
 
 void* print_node(mynode_t *n, void *last, char* term) {
@@ -67,6 +93,69 @@ void print_list(dlist_mynode_t *list) {
   printf("]\n");
 }
 
+// Asserts "list" holds exactly "expect", in order, and is well formed
+void expect_list(dlist_mynode_t *list, const int *expect, int len) {
+  mynode_t *n;
+  int i = 0;
+  dlist_mynode_t_check(list);
+  DLIST_FOREACH(mynode_t, list, n) {
+    assert(i < len);
+    assert(n->data == expect[i]);
+    i++;
+  }
+  assert(i == len);
+}
+
+// Appends nodes with data from..to-1 onto list
+void fill_list(dlist_mynode_t *list, int from, int to) {
+  mynode_t *n;
+  int x;
+  for (x = from; x < to; x++) {
+    n = malloc(sizeof(mynode_t));
+    n->data = x;
+    dlist_mynode_t_pushback(list, n);
+  }
+}
+
+// Fills list with "len" nodes in key order, random keys below 10.
+// data = key * 1000 + (*seq)++, so after a stable merge of lists filled in
+// order the merged list is ordered by data.
+void fill_sorted(dlist_mynode_t *list, int len, int *seq) {
+  mynode_t *n;
+  int key = 0;
+  int x;
+  for (x = 0; x < len; x++) {
+    key += rand() % 3;
+    if (key > 9)
+      key = 9;
+    n = malloc(sizeof(mynode_t));
+    n->data = key * 1000 + (*seq)++;
+    dlist_mynode_t_pushback(list, n);
+  }
+}
+
+// Asserts list is ordered by data, and holds "len" nodes
+void expect_ordered(dlist_mynode_t *list, int len) {
+  mynode_t *n;
+  int last = -1;
+  dlist_mynode_t_check(list);
+  DLIST_FOREACH(mynode_t, list, n) {
+    assert(n->data > last);
+    last = n->data;
+    len--;
+  }
+  assert(len == 0);
+}
+
+// Removes and frees every node in list
+void empty_list(dlist_mynode_t *list) {
+  mynode_t *n;
+  while ((n = dlist_mynode_t_first(list))) {
+    dlist_mynode_t_remove(list, n);
+    free(n);
+  }
+}
+
 int main(unsigned int argc, char **argv) {
   mynode_t *n;
 
@@ -194,5 +283,395 @@ int main(unsigned int argc, char **argv) {
 
   print_list(&list);
 
+  // Inline iteration should visit the same nodes as the folds
+  printf("foreach\n");
+  mynode_t *tmp;
+  int count = 0;
+  int last = -1;
+  DLIST_FOREACH(mynode_t, &list, n) {
+    printf("%d ", n->data);
+    count++;
+    last = n->data;
+  }
+  printf("\n");
+  assert(last == dlist_mynode_t_tail(&list)->data);
+
+  printf("foreach_reverse\n");
+  int rcount = 0;
+  DLIST_FOREACH_REVERSE(mynode_t, &list, n) {
+    printf("%d ", n->data);
+    rcount++;
+    last = n->data;
+  }
+  printf("\n");
+  assert(count == rcount);
+  assert(last == dlist_mynode_t_head(&list)->data);
+
+  printf("foreach break on 20\n");
+  DLIST_FOREACH(mynode_t, &list, n) {
+    if (n->data == 20)
+      break;
+  }
+  assert(n && n->data == 20);
+
+  printf("prefetching traversals\n");
+  dlist_node_t *ahead;
+  rcount = 0;
+  DLIST_FOREACH_PREFETCH(mynode_t, &list, n, ahead) {
+    rcount++;
+    last = n->data;
+  }
+  assert(rcount == count);
+  assert(last == dlist_mynode_t_tail(&list)->data);
+  dlist_mynode_t_check_prefetch(&list);
+  assert(dlist_mynode_t_foldr_prefetch(&list, is_5, 0) ==
+         dlist_mynode_t_foldr(&list, is_5, 0));
+  assert(dlist_mynode_t_foldl_prefetch(&list, is_5, 0) ==
+         dlist_mynode_t_foldl(&list, is_5, 0));
+  print_list(&list);
+
+  // Remove odd elements while iterating
+  printf("foreach_safe remove odds\n");
+  DLIST_FOREACH_SAFE(mynode_t, &list, n, tmp) {
+    if (n->data % 2) {
+      dlist_mynode_t_remove(&list, n);
+      free(n);
+      count--;
+    }
+  }
+  dlist_mynode_t_check(&list);
+  print_list(&list);
+  rcount = 0;
+  DLIST_FOREACH(mynode_t, &list, n) {
+    assert(n->data % 2 == 0);
+    rcount++;
+  }
+  assert(rcount == count);
+
+  // Empty the list, and make sure we can destroy it
+  printf("foreach_safe remove all\n");
+  DLIST_FOREACH_SAFE(mynode_t, &list, n, tmp) {
+    dlist_mynode_t_remove(&list, n);
+    free(n);
+  }
+  dlist_mynode_t_check(&list);
+  DLIST_FOREACH(mynode_t, &list, n) {
+    assert(0);
+  }
+  dlist_mynode_t_destroy(&list);
+
+  // Moving whole chains between lists
+  printf("concat\n");
+  dlist_mynode_t other;
+  dlist_mynode_t_init(&list);
+  dlist_mynode_t_init(&other);
+  dlist_mynode_t_concat(&list, &other);
+  expect_list(&list, NULL, 0);
+  fill_list(&other, 0, 3);
+  dlist_mynode_t_concat(&list, &other);
+  {
+    int expect[] = {0, 1, 2};
+    expect_list(&list, expect, 3);
+    expect_list(&other, NULL, 0);
+  }
+  fill_list(&other, 3, 5);
+  dlist_mynode_t_concat(&list, &other);
+  {
+    int expect[] = {0, 1, 2, 3, 4};
+    expect_list(&list, expect, 5);
+    expect_list(&other, NULL, 0);
+  }
+
+  printf("splice_after\n");
+  fill_list(&other, 10, 12);
+  dlist_mynode_t_splice_after(&list, NULL, &other);
+  {
+    int expect[] = {10, 11, 0, 1, 2, 3, 4};
+    expect_list(&list, expect, 7);
+    expect_list(&other, NULL, 0);
+  }
+  fill_list(&other, 20, 22);
+  DLIST_FOREACH(mynode_t, &list, n) {
+    if (n->data == 1)
+      break;
+  }
+  dlist_mynode_t_splice_after(&list, n, &other);
+  {
+    int expect[] = {10, 11, 0, 1, 20, 21, 2, 3, 4};
+    expect_list(&list, expect, 9);
+  }
+  fill_list(&other, 30, 31);
+  dlist_mynode_t_splice_after(&list, dlist_mynode_t_last(&list), &other);
+  {
+    int expect[] = {10, 11, 0, 1, 20, 21, 2, 3, 4, 30};
+    expect_list(&list, expect, 10);
+  }
+
+  printf("split_at\n");
+  DLIST_FOREACH(mynode_t, &list, n) {
+    if (n->data == 2)
+      break;
+  }
+  dlist_mynode_t_split_at(&list, n, &other);
+  {
+    int expect[] = {10, 11, 0, 1, 20, 21};
+    int expect_other[] = {2, 3, 4, 30};
+    expect_list(&list, expect, 6);
+    expect_list(&other, expect_other, 4);
+  }
+  // split at the tail
+  dlist_mynode_t_concat(&list, &other);
+  dlist_mynode_t_split_at(&list, dlist_mynode_t_last(&list), &other);
+  {
+    int expect[] = {10, 11, 0, 1, 20, 21, 2, 3, 4};
+    int expect_other[] = {30};
+    expect_list(&list, expect, 9);
+    expect_list(&other, expect_other, 1);
+  }
+  dlist_mynode_t_concat(&list, &other);
+  // split at the head moves everything
+  dlist_mynode_t_split_at(&list, dlist_mynode_t_first(&list), &other);
+  expect_list(&list, NULL, 0);
+  {
+    int expect_other[] = {10, 11, 0, 1, 20, 21, 2, 3, 4, 30};
+    expect_list(&other, expect_other, 10);
+  }
+  empty_list(&other);
+  dlist_mynode_t_destroy(&list);
+  dlist_mynode_t_destroy(&other);
+
+  // Batch insertion
+  printf("pushback_array/enqueue_array\n");
+  {
+    mynode_t *batch[4];
+    for (x = 0; x < 4; x++) {
+      batch[x] = malloc(sizeof(mynode_t));
+      batch[x]->data = x;
+    }
+    dlist_mynode_t_init(&list);
+    dlist_mynode_t_pushback_array(&list, batch, 0);
+    expect_list(&list, NULL, 0);
+    dlist_mynode_t_pushback_array(&list, batch, 2);
+    {
+      int expect[] = {0, 1};
+      expect_list(&list, expect, 2);
+    }
+    dlist_mynode_t_enqueue_array(&list, batch + 2, 2);
+    {
+      int expect[] = {3, 2, 0, 1};
+      expect_list(&list, expect, 4);
+    }
+    while (dlist_mynode_t_first(&list))
+      dlist_mynode_t_pop(&list);
+    dlist_mynode_t_enqueue_array(&list, batch, 2);
+    dlist_mynode_t_pushback_array(&list, batch + 2, 2);
+    {
+      int expect[] = {1, 0, 2, 3};
+      expect_list(&list, expect, 4);
+    }
+    empty_list(&list);
+    dlist_mynode_t_destroy(&list);
+  }
+
+  // Sorting
+  // Nodes get data = (random key * 1000) + insertion order, the comparator
+  // only looks at the key, so a stable sort leaves the list ordered by data.
+  printf("sort\n");
+  {
+    int len;
+    int lens[] = {0, 1, 2, 3, 7, 8, 9, 100, 1000};
+    srand(1);
+    for (x = 0; x < (int) (sizeof(lens) / sizeof(lens[0])); x++) {
+      len = lens[x];
+      dlist_mynode_t_init(&list);
+      int i;
+      for (i = 0; i < len; i++) {
+        n = malloc(sizeof(mynode_t));
+        n->data = (rand() % 10) * 1000 + i;
+        dlist_mynode_t_pushback(&list, n);
+      }
+      dlist_mynode_t_sort(&list);
+      dlist_mynode_t_check(&list);
+      i = 0;
+      last = -1;
+      DLIST_FOREACH(mynode_t, &list, n) {
+        assert(n->data > last);
+        last = n->data;
+        i++;
+      }
+      assert(i == len);
+      empty_list(&list);
+      dlist_mynode_t_destroy(&list);
+    }
+  }
+
+  // Merging sorted lists
+  printf("merge\n");
+  {
+    int lens[][2] = {{0, 0}, {0, 3}, {3, 0}, {1, 1}, {5, 7}, {50, 20}};
+    int seq;
+    dlist_mynode_t_init(&list);
+    dlist_mynode_t_init(&other);
+    for (x = 0; x < (int) (sizeof(lens) / sizeof(lens[0])); x++) {
+      seq = 0;
+      fill_sorted(&list, lens[x][0], &seq);
+      fill_sorted(&other, lens[x][1], &seq);
+      dlist_mynode_t_merge(&list, &other);
+      expect_ordered(&list, lens[x][0] + lens[x][1]);
+      expect_list(&other, NULL, 0);
+      empty_list(&list);
+    }
+    dlist_mynode_t_destroy(&list);
+    dlist_mynode_t_destroy(&other);
+  }
+
+  printf("merge_k\n");
+  {
+    int counts[] = {0, 1, 2, 5, DLIST_MERGE_K_MAX, DLIST_MERGE_K_MAX * 2 + 3};
+    dlist_mynode_t srcs[DLIST_MERGE_K_MAX * 2 + 3];
+    dlist_mynode_t *psrcs[DLIST_MERGE_K_MAX * 2 + 3];
+    int seq;
+    int total;
+    int i;
+    for (x = 0; x < (int) (sizeof(counts) / sizeof(counts[0])); x++) {
+      seq = 0;
+      dlist_mynode_t_init(&list);
+      fill_sorted(&list, x, &seq);
+      total = x;
+      for (i = 0; i < counts[x]; i++) {
+        int len = rand() % 6;
+        dlist_mynode_t_init(&srcs[i]);
+        fill_sorted(&srcs[i], len, &seq);
+        psrcs[i] = &srcs[i];
+        total += len;
+      }
+      dlist_mynode_t_merge_k(&list, psrcs, counts[x]);
+      expect_ordered(&list, total);
+      for (i = 0; i < counts[x]; i++) {
+        expect_list(&srcs[i], NULL, 0);
+        dlist_mynode_t_destroy(&srcs[i]);
+      }
+      empty_list(&list);
+      dlist_mynode_t_destroy(&list);
+    }
+  }
+
+  // Counted lists
+  printf("counted list\n");
+  dlist_mycnode_t clist;
+  dlist_mycnode_t cother;
+  mycnode_t *cn;
+  mycnode_t *ctmp;
+  dlist_mycnode_t_init(&clist);
+  dlist_mycnode_t_init(&cother);
+  assert(dlist_mycnode_t_size(&clist) == 0);
+  assert(!dlist_mycnode_t_pop(&clist));
+  assert(!dlist_mycnode_t_dequeue(&clist));
+  assert(dlist_mycnode_t_size(&clist) == 0);
+  for (x = 0; x < 10; x++) {
+    cn = malloc(sizeof(mycnode_t));
+    cn->data = x;
+    if (x % 2)
+      dlist_mycnode_t_pushback(&clist, cn);
+    else
+      dlist_mycnode_t_enqueue(&clist, cn);
+    assert(dlist_mycnode_t_size(&clist) == (size_t) x + 1);
+    dlist_mycnode_t_check(&clist);
+  }
+
+  cn = dlist_mycnode_t_pop(&clist);
+  assert(cn->data == 8);
+  free(cn);
+  cn = dlist_mycnode_t_dequeue(&clist);
+  assert(cn->data == 9);
+  free(cn);
+  assert(dlist_mycnode_t_size(&clist) == 8);
+  dlist_mycnode_t_check(&clist);
+
+  printf("counted split/concat\n");
+  DLIST_FOREACH(mycnode_t, &clist, cn) {
+    if (cn->data == 1)
+      break;
+  }
+  dlist_mycnode_t_split_at(&clist, cn, &cother);
+  assert(dlist_mycnode_t_size(&clist) == 4);
+  assert(dlist_mycnode_t_size(&cother) == 4);
+  dlist_mycnode_t_check(&clist);
+  dlist_mycnode_t_check(&cother);
+  dlist_mycnode_t_splice_after(&clist, NULL, &cother);
+  assert(dlist_mycnode_t_size(&clist) == 8);
+  assert(dlist_mycnode_t_size(&cother) == 0);
+  dlist_mycnode_t_check(&clist);
+  dlist_mycnode_t_check(&cother);
+  dlist_mycnode_t_split_at(&clist, dlist_mycnode_t_first(&clist), &cother);
+  dlist_mycnode_t_concat(&clist, &cother);
+  assert(dlist_mycnode_t_size(&clist) == 8);
+  dlist_mycnode_t_check(&clist);
+
+  printf("counted pushback_array/enqueue_array\n");
+  {
+    mycnode_t *batch[3];
+    for (x = 0; x < 3; x++) {
+      batch[x] = malloc(sizeof(mycnode_t));
+      batch[x]->data = 100 + x;
+    }
+    dlist_mycnode_t_pushback_array(&clist, batch, 2);
+    dlist_mycnode_t_enqueue_array(&clist, batch + 2, 1);
+    assert(dlist_mycnode_t_size(&clist) == 11);
+    assert(dlist_mycnode_t_first(&clist)->data == 102);
+    assert(dlist_mycnode_t_last(&clist)->data == 101);
+    dlist_mycnode_t_check(&clist);
+  }
+
+  printf("counted sort\n");
+  DLIST_FOREACH(mycnode_t, &clist, cn) {
+    cn->data = (rand() % 10) * 1000 + cn->data;
+  }
+  dlist_sort((dlist_t*) &clist, mycnode_node_cmp);
+  dlist_mycnode_t_check(&clist);
+  assert(dlist_mycnode_t_size(&clist) == 11);
+  last = -1;
+  DLIST_FOREACH(mycnode_t, &clist, cn) {
+    assert(cn->data / 1000 >= last / 1000);
+    last = cn->data;
+  }
+
+  printf("counted merge\n");
+  {
+    mycnode_t *batch[3];
+    dlist_mycnode_t *pcother = &cother;
+    for (x = 0; x < 3; x++) {
+      batch[x] = malloc(sizeof(mycnode_t));
+      batch[x]->data = x * 4000;
+    }
+    dlist_mycnode_t_pushback_array(&cother, batch, 2);
+    dlist_mycnode_t_merge(&clist, &cother);
+    assert(dlist_mycnode_t_size(&clist) == 13);
+    assert(dlist_mycnode_t_size(&cother) == 0);
+    dlist_mycnode_t_check(&clist);
+    dlist_mycnode_t_check(&cother);
+    dlist_mycnode_t_pushback_array(&cother, batch + 2, 1);
+    dlist_mycnode_t_merge_k(&clist, &pcother, 1);
+    assert(dlist_mycnode_t_size(&clist) == 14);
+    assert(dlist_mycnode_t_size(&cother) == 0);
+    dlist_mycnode_t_check(&clist);
+    dlist_mycnode_t_check(&cother);
+    last = -1;
+    DLIST_FOREACH(mycnode_t, &clist, cn) {
+      assert(cn->data / 1000 >= last / 1000);
+      last = cn->data;
+    }
+  }
+
+  printf("counted remove\n");
+  DLIST_FOREACH_SAFE(mycnode_t, &clist, cn, ctmp) {
+    dlist_mycnode_t_remove(&clist, cn);
+    free(cn);
+    dlist_mycnode_t_check(&clist);
+  }
+  assert(dlist_mycnode_t_size(&clist) == 0);
+  dlist_mycnode_t_destroy(&clist);
+  dlist_mycnode_t_destroy(&cother);
+
   printf("PASSED!\n");
 }
@@ -0,0 +1,345 @@
+// Open-addressing hash map of pointers, probed a group of slots at a time
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) declare a "node" type with a key field (nothing needs embedding)
+//   3) call "DEFINE_FLATMAP" with their node-type, the key's type and field
+//      name, a hash function and an equality function
+//   4) allocate a "flatmap_##type", an array of FLATMAP_CTRL_SIZE(capacity)
+//      "signed char" control bytes and an array of "capacity" "type *"
+//      slots, where capacity is a power of two, at least FLATMAP_GROUP, and
+//      call flatmap_##type##_init() with them
+//   5) The user must allocate all nodes before passing them in
+//   6) When done with the map, empty it (or flatmap_##type##_clear() it),
+//      then call "flatmap_##type##_destroy". The arrays may then be freed.
+//
+//   See flatmap_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   The map stores pointers, so a node may be in a map and (say) a dlist at
+//   once, and in several maps.
+//   A key may only be in the map once, find it before inserting.
+//   Insert returns 0 when the map is full, that is 7/8 of the slots used.
+//   Erased slots stay used (as tombstones) until the map is resized, so a
+//   map with many erases should be resized (to the same capacity is fine)
+//   when insert fails.
+//
+// Design Decisions:
+//   * This is the "Swiss table" layout. Each slot has a control byte: empty,
+//     deleted, or the low 7 bits of the hash (H2) of the node it holds. The
+//     rest of the hash (H1) picks where to start probing.
+//   * Probing looks at FLATMAP_GROUP (16) control bytes at once. With SSE2
+//     that's one load, compare and movemask, giving a bitmask of candidates,
+//     so the node (and its key) is only touched on a 1 in 128 false match.
+//     Without SSE2 the same masks are built with a plain loop.
+//     A wider AVX2 group was not used, since a probe almost always ends in
+//     the first group, so the wider compare rarely saves anything.
+//   * The first FLATMAP_GROUP control bytes are repeated after the last, so
+//     a group can be loaded at any slot without wrapping.
+//   * Groups are probed in triangular order, which visits every group of a
+//     power of two sized table.
+//   * Erase leaves a tombstone rather than an empty byte, so probe chains
+//     passing through the slot aren't cut.
+//   * Hash and equality are called directly by the generated code, so the
+//     compiler can inline them.
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "panic.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifndef FLATMAP_H
+#define FLATMAP_H
+
+#define FLATMAP_GROUP 16
+#define FLATMAP_EMPTY ((signed char) -128)
+#define FLATMAP_DELETED ((signed char) -2)
+
+// Number of control bytes a map of "capacity" slots needs
+#define FLATMAP_CTRL_SIZE(capacity) ((capacity) + FLATMAP_GROUP)
+
+// ******************* typedefs ****************
+
+// The backend map, the typed map wraps this
+typedef struct {
+  signed char *ctrl;
+  void **slots;
+  size_t mask;
+  size_t size;
+  // full and deleted slots, insert fails once this reaches "max_used"
+  size_t used;
+  size_t max_used;
+} flatmap_t;
+
+// Defines the typed map.
+//   keytype - the type of the key field, passed by value
+//   key     - the name of the key field in "type"
+//   hashfn  - a function or macro taking a keytype, returning a size_t. All
+//             bits should be well mixed, the low 7 are used separately.
+//   eqfn    - a function or macro taking two keytypes, non-zero if equal
+// resize moves every node to new arrays (which may be the same size, but
+// not the same arrays), and returns 0 if they're too small, leaving the map
+// unchanged.
+#define DEFINE_FLATMAP(type, keytype, key, hashfn, eqfn)  \
+  typedef struct {  \
+    flatmap_t map;  \
+  } flatmap_##type;  \
+  void flatmap_##type##_init(flatmap_##type *root, signed char *ctrl,  \
+                             type **slots, size_t capacity) {  \
+    flatmap_init(&root->map, ctrl, (void**) slots, capacity);  \
+  }  \
+  void flatmap_##type##_destroy(flatmap_##type *root) {  \
+    flatmap_destroy(&root->map);  \
+  }  \
+  void flatmap_##type##_clear(flatmap_##type *root) {  \
+    flatmap_clear(&root->map);  \
+  }  \
+  size_t flatmap_##type##_size(const flatmap_##type *root) {  \
+    return root->map.size;  \
+  }  \
+  size_t flatmap_##type##_capacity(const flatmap_##type *root) {  \
+    return root->map.mask + 1;  \
+  }  \
+  type * flatmap_##type##_find(const flatmap_##type *root, keytype k) {  \
+    const flatmap_t *map = &root->map;  \
+    size_t hash = hashfn(k);  \
+    size_t pos = flatmap_h1(hash) & map->mask;  \
+    size_t stride = 0;  \
+    for (;;) {  \
+      uint32_t match = flatmap_match(map->ctrl + pos, flatmap_h2(hash));  \
+      for (; match; match &= match - 1) {  \
+        type *data = (type*) map->slots[(pos + flatmap_ctz(match)) &  \
+                                         map->mask];  \
+        if (eqfn(data->key, k))  \
+          return data;  \
+      }  \
+      if (flatmap_match_empty(map->ctrl + pos))  \
+        return NULL;  \
+      stride += FLATMAP_GROUP;  \
+      pos = (pos + stride) & map->mask;  \
+    }  \
+  }  \
+  int flatmap_##type##_insert(flatmap_##type *root, type *data) {  \
+    assert(!flatmap_##type##_find(root, data->key));  \
+    return flatmap_insert(&root->map, data, hashfn(data->key));  \
+  }  \
+  void flatmap_##type##_erase(flatmap_##type *root, type *data) {  \
+    flatmap_erase(&root->map, data, hashfn(data->key));  \
+  }  \
+  int flatmap_##type##_resize(flatmap_##type *root, signed char *ctrl,  \
+                              type **slots, size_t capacity) {  \
+    flatmap_t old = root->map;  \
+    size_t i;  \
+    assert(ctrl != old.ctrl && (void**) slots != old.slots);  \
+    if (old.size > flatmap_max_used(capacity))  \
+      return 0;  \
+    flatmap_init(&root->map, ctrl, (void**) slots, capacity);  \
+    for (i = 0; i <= old.mask; i++) {  \
+      if (old.ctrl[i] >= 0) {  \
+        type *data = (type*) old.slots[i];  \
+        flatmap_insert(&root->map, data, hashfn(data->key));  \
+      }  \
+    }  \
+    assert(root->map.size == old.size);  \
+    return 1;  \
+  }  \
+  void flatmap_##type##_check(const flatmap_##type *root) {  \
+    const flatmap_t *map = &root->map;  \
+    size_t i;  \
+    flatmap_check(map);  \
+    for (i = 0; i <= map->mask; i++) {  \
+      if (map->ctrl[i] >= 0) {  \
+        type *data = (type*) map->slots[i];  \
+        assert(map->ctrl[i] == flatmap_h2(hashfn(data->key)));  \
+        assert(flatmap_##type##_find(root, data->key) == data);  \
+      }  \
+    }  \
+  }
+
+// Inline iteration over every node, in no particular order.
+//   var - a "type *", set to each node in turn, it must be a plain
+//         identifier (it's used to name the loop's index)
+// The body must not insert, erase or resize.
+#define FLATMAP_FOREACH(type, root, var)  \
+  for (size_t flatmap_i_##var = flatmap_next_full(&(root)->map, 0);  \
+       flatmap_i_##var <= (root)->map.mask &&  \
+       (((var) = (type*) (root)->map.slots[flatmap_i_##var]), 1);  \
+       flatmap_i_##var = flatmap_next_full(&(root)->map, flatmap_i_##var + 1))
+
+
+// ******************* private functions ****************
+
+size_t flatmap_h1(size_t hash) {
+  return hash >> 7;
+}
+
+signed char flatmap_h2(size_t hash) {
+  return (signed char) (hash & 0x7f);
+}
+
+unsigned int flatmap_ctz(uint32_t match) {
+  return __builtin_ctz(match);
+}
+
+// Bit i is set if group[i] == h2
+uint32_t flatmap_match(const signed char *group, signed char h2) {
+#if defined(__SSE2__)
+  __m128i ctrl = _mm_loadu_si128((const __m128i*) group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+#else
+  uint32_t match = 0;
+  int i;
+  for (i = 0; i < FLATMAP_GROUP; i++)
+    match |= (uint32_t) (group[i] == h2) << i;
+  return match;
+#endif
+}
+
+uint32_t flatmap_match_empty(const signed char *group) {
+  return flatmap_match(group, FLATMAP_EMPTY);
+}
+
+// Bit i is set if group[i] is empty or deleted, both are below -1
+uint32_t flatmap_match_free(const signed char *group) {
+#if defined(__SSE2__)
+  __m128i ctrl = _mm_loadu_si128((const __m128i*) group);
+  return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl));
+#else
+  uint32_t match = 0;
+  int i;
+  for (i = 0; i < FLATMAP_GROUP; i++)
+    match |= (uint32_t) (group[i] < -1) << i;
+  return match;
+#endif
+}
+
+// We keep at least 1/8 of the slots empty, so probes always terminate
+size_t flatmap_max_used(size_t capacity) {
+  return capacity - capacity / 8;
+}
+
+// Sets a control byte, and its copy past the end if it has one
+void flatmap_set_ctrl(flatmap_t *root, size_t index, signed char value) {
+  root->ctrl[index] = value;
+  if (index < FLATMAP_GROUP)
+    root->ctrl[root->mask + 1 + index] = value;
+}
+
+void flatmap_clear(flatmap_t *root) {
+  memset(root->ctrl, FLATMAP_EMPTY, FLATMAP_CTRL_SIZE(root->mask + 1));
+  root->size = 0;
+  root->used = 0;
+}
+
+// "ctrl" holds FLATMAP_CTRL_SIZE(capacity) bytes, "slots" capacity pointers.
+// "capacity" must be a power of two, at least FLATMAP_GROUP
+void flatmap_init(flatmap_t *root, signed char *ctrl, void **slots,
+                  size_t capacity) {
+  assert(capacity >= FLATMAP_GROUP);
+  assert(!(capacity & (capacity - 1)));
+  root->ctrl = ctrl;
+  root->slots = slots;
+  root->mask = capacity - 1;
+  root->max_used = flatmap_max_used(capacity);
+  flatmap_clear(root);
+}
+
+void flatmap_destroy(flatmap_t *root) {
+  if (root->size) {
+    PANIC("flatmap_destroy: map is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->ctrl = (signed char*) 0xdeadbeef;
+  root->slots = (void**) 0xdeadbeef;
+}
+
+// Puts "data" in the first free slot on its probe sequence.
+// Returns 0 if that would use an empty slot and the map is full.
+int flatmap_insert(flatmap_t *root, void *data, size_t hash) {
+  size_t pos = flatmap_h1(hash) & root->mask;
+  size_t stride = 0;
+  uint32_t match;
+  while (!(match = flatmap_match_free(root->ctrl + pos))) {
+    stride += FLATMAP_GROUP;
+    pos = (pos + stride) & root->mask;
+  }
+  size_t index = (pos + flatmap_ctz(match)) & root->mask;
+  if (root->ctrl[index] == FLATMAP_EMPTY) {
+    if (root->used >= root->max_used)
+      return 0;
+    root->used++;
+  }
+  flatmap_set_ctrl(root, index, flatmap_h2(hash));
+  root->slots[index] = data;
+  root->size++;
+  return 1;
+}
+
+// Finds "data" by pointer on its probe sequence, and leaves a tombstone
+void flatmap_erase(flatmap_t *root, void *data, size_t hash) {
+  size_t pos = flatmap_h1(hash) & root->mask;
+  size_t stride = 0;
+  for (;;) {
+    uint32_t match = flatmap_match(root->ctrl + pos, flatmap_h2(hash));
+    for (; match; match &= match - 1) {
+      size_t index = (pos + flatmap_ctz(match)) & root->mask;
+      if (root->slots[index] == data) {
+        flatmap_set_ctrl(root, index, FLATMAP_DELETED);
+        root->size--;
+        return;
+      }
+    }
+    if (flatmap_match_empty(root->ctrl + pos)) {
+      PANIC("flatmap_erase: node is not in the map");
+    }
+    stride += FLATMAP_GROUP;
+    pos = (pos + stride) & root->mask;
+  }
+}
+
+// Returns the index of the first full slot at or after "index", or the
+// capacity if there are none
+size_t flatmap_next_full(const flatmap_t *root, size_t index) {
+  for (; index <= root->mask; index++) {
+    if (root->ctrl[index] >= 0)
+      return index;
+  }
+  return index;
+}
+
+// Checks the counts, the copied control bytes, and that an empty slot is
+// left. The typed check also checks each node can be found.
+void flatmap_check(const flatmap_t *root) {
+  size_t full = 0;
+  size_t deleted = 0;
+  size_t i;
+  for (i = 0; i <= root->mask; i++) {
+    signed char c = root->ctrl[i];
+    assert(c >= 0 || c == FLATMAP_EMPTY || c == FLATMAP_DELETED);
+    if (c >= 0)
+      full++;
+    else if (c == FLATMAP_DELETED)
+      deleted++;
+  }
+  for (i = 0; i < FLATMAP_GROUP; i++)
+    assert(root->ctrl[root->mask + 1 + i] == root->ctrl[i]);
+  assert(full == root->size);
+  assert(full + deleted == root->used);
+  assert(root->used <= root->max_used);
+  assert(root->used < root->mask + 1);
+}
+
+#endif
@@ -0,0 +1,129 @@
+// Benchmark for flatmap (open-addressing hash map) against hashtable
+//
+// Usage:
+//   gcc -O2 -o flatmap_bench flatmap_bench.c
+//   ./flatmap_bench [keys]
+// Runs at 10000 keys, which stay in cache, and at "keys", which defaults to
+// 1000000. Times inserting every key (in a random order), looking each up,
+// and looking up as many keys that aren't there. Both tables are sized for
+// the keys up front, flatmap to the smallest power of two it fits in (at
+// most 7/8 full), hashtable to a load of at most 1.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "flatmap.h"
+#include "hashtable.h"
+
+#define RUNS 5
+
+typedef struct {
+  long key;
+  dlist_node_t table_data;
+} mynode_t;
+
+// The murmur3 finalizer, so both tables get well mixed high and low bits
+size_t long_hash(long k) {
+  uint64_t h = (uint64_t) k;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+#define long_eq(a, b) ((a) == (b))
+
+DEFINE_FLATMAP(mynode_t, long, key, long_hash, long_eq)
+DEFINE_HASHTABLE(mynode_t, long, key, table_data, long_hash, long_eq)
+
+void bench(size_t count) {
+  mynode_t *nodes = malloc(count * sizeof(mynode_t));
+  mynode_t **order = malloc(count * sizeof(mynode_t*));
+  size_t capacity = FLATMAP_GROUP;
+  size_t nbuckets = 1;
+  signed char *ctrl;
+  mynode_t **slots;
+  dlist_t *buckets;
+  flatmap_mynode_t map;
+  hashtable_mynode_t table;
+  // insert, hit and miss, for flatmap then hashtable
+  double best[6] = {1e9, 1e9, 1e9, 1e9, 1e9, 1e9};
+  uint64_t seed = 1;
+  size_t i;
+  int run;
+
+  while (capacity - capacity / 8 < count)
+    capacity *= 2;
+  while (nbuckets < count)
+    nbuckets *= 2;
+  ctrl = malloc(FLATMAP_CTRL_SIZE(capacity));
+  slots = malloc(capacity * sizeof(mynode_t*));
+  buckets = malloc(nbuckets * sizeof(dlist_t));
+  for (i = 0; i < count; i++) {
+    // Spread out, so the misses (odd keys) land among the hits
+    nodes[i].key = 2 * i;
+    order[i] = &nodes[i];
+  }
+  bench_shuffle((void**) order, count, &seed);
+
+  for (run = 0; run < RUNS; run++) {
+    double times[7];
+    size_t found = 0;
+    flatmap_mynode_t_init(&map, ctrl, slots, capacity);
+    hashtable_mynode_t_init(&table, buckets, nbuckets);
+    times[0] = bench_now();
+    for (i = 0; i < count; i++) {
+      if (!flatmap_mynode_t_insert(&map, order[i]))
+        abort();
+    }
+    times[1] = bench_now();
+    for (i = 0; i < count; i++)
+      found += flatmap_mynode_t_find(&map, nodes[i].key) != NULL;
+    times[2] = bench_now();
+    for (i = 0; i < count; i++)
+      found += flatmap_mynode_t_find(&map, nodes[i].key + 1) != NULL;
+    times[3] = bench_now();
+    for (i = 0; i < count; i++)
+      hashtable_mynode_t_insert(&table, order[i]);
+    times[4] = bench_now();
+    for (i = 0; i < count; i++)
+      found += hashtable_mynode_t_find(&table, nodes[i].key) != NULL;
+    times[5] = bench_now();
+    for (i = 0; i < count; i++)
+      found += hashtable_mynode_t_find(&table, nodes[i].key + 1) != NULL;
+    times[6] = bench_now();
+    if (found != 2 * count)
+      abort();
+    for (i = 0; i < 6; i++) {
+      if (times[i + 1] - times[i] < best[i])
+        best[i] = times[i + 1] - times[i];
+    }
+    flatmap_mynode_t_clear(&map);
+    flatmap_mynode_t_destroy(&map);
+    for (i = 0; i < count; i++)
+      hashtable_mynode_t_remove(&table, &nodes[i]);
+    hashtable_mynode_t_destroy(&table);
+  }
+  printf("  %8zu keys  flatmap   insert %6.2f  hit %6.2f  miss %6.2f"
+         "  (%zu slots)\n", count, best[0] * 1e9 / count,
+         best[1] * 1e9 / count, best[2] * 1e9 / count, capacity);
+  printf("  %8zu keys  hashtable insert %6.2f  hit %6.2f  miss %6.2f"
+         "  (%zu buckets)\n", count, best[3] * 1e9 / count,
+         best[4] * 1e9 / count, best[5] * 1e9 / count, nbuckets);
+  free(buckets);
+  free(slots);
+  free(ctrl);
+  free(order);
+  free(nodes);
+}
+
+int main(int argc, char **argv) {
+  size_t count = bench_arg(argc, argv, 1, 1000000);
+
+  printf("ns/op\n");
+  bench(10000);
+  bench(count);
+  return 0;
+}
@@ -0,0 +1,182 @@
+// Unittest for flatmap (open-addressing hash map of pointers)
+
+
+#include <stdio.h>
+#include "assert.h"
+#include "dlist.h"
+#include "flatmap.h"
+
+#define KEYS 1000
+#define SMALL 16
+#define BIG 1024
+
+typedef struct {
+  dlist_node_t list_data;
+  int key;
+} mynode_t;
+
+DEFINE_DLIST(mynode_t, list_data)
+
+// Spread the key over every bit, as flatmap wants
+size_t int_hash(int k) {
+  uint64_t h = (uint64_t) k * 0x9e3779b97f4a7c15ull;
+  return (size_t) (h ^ (h >> 29));
+}
+
+// A terrible hash, everything collides in the first group, and H2 only
+// ever has two values
+#define bad_hash(k) ((size_t) ((k) & 1))
+#define int_eq(a, b) ((a) == (b))
+
+DEFINE_FLATMAP(mynode_t, int, key, int_hash, int_eq)
+
+typedef struct {
+  int key;
+} badnode_t;
+
+DEFINE_FLATMAP(badnode_t, int, key, bad_hash, int_eq)
+
+flatmap_mynode_t map;
+signed char small_ctrl[FLATMAP_CTRL_SIZE(SMALL)];
+mynode_t *small_slots[SMALL];
+signed char big_ctrl[FLATMAP_CTRL_SIZE(BIG)];
+mynode_t *big_slots[BIG];
+signed char spare_ctrl[FLATMAP_CTRL_SIZE(BIG)];
+mynode_t *spare_slots[BIG];
+
+flatmap_badnode_t bad_map;
+badnode_t *bad_slots[SMALL];
+badnode_t bad_nodes[SMALL];
+
+mynode_t nodes[KEYS];
+// Whether nodes[i] is in the map
+char present[KEYS];
+
+// Asserts exactly the nodes marked in "present" are in the map
+void expect_map(flatmap_mynode_t *map) {
+  mynode_t *n;
+  size_t count = 0;
+  int x;
+  flatmap_mynode_t_check(map);
+  FLATMAP_FOREACH(mynode_t, map, n) {
+    assert(present[n->key]);
+    count++;
+  }
+  assert(count == flatmap_mynode_t_size(map));
+  for (x = 0; x < KEYS; x++) {
+    n = flatmap_mynode_t_find(map, x);
+    assert(present[x] ? n == &nodes[x] : !n);
+    if (present[x])
+      count--;
+  }
+  assert(count == 0);
+}
+
+int main(unsigned int argc, char **argv) {
+  dlist_mynode_t list;
+  mynode_t *n;
+  int x;
+
+  for (x = 0; x < KEYS; x++)
+    nodes[x].key = x;
+
+  printf("initializing map\n");
+  flatmap_mynode_t_init(&map, small_ctrl, small_slots, SMALL);
+  expect_map(&map);
+  assert(flatmap_mynode_t_capacity(&map) == SMALL);
+
+  printf("fill to 7/8\n");
+  for (x = 0; x < SMALL - SMALL / 8; x++) {
+    assert(flatmap_mynode_t_insert(&map, &nodes[x]));
+    present[x] = 1;
+  }
+  assert(!flatmap_mynode_t_insert(&map, &nodes[x]));
+  expect_map(&map);
+
+  printf("tombstones are reused\n");
+  flatmap_mynode_t_erase(&map, &nodes[3]);
+  present[3] = 0;
+  expect_map(&map);
+  assert(flatmap_mynode_t_insert(&map, &nodes[3]));
+  present[3] = 1;
+  expect_map(&map);
+
+  printf("grow\n");
+  assert(flatmap_mynode_t_resize(&map, big_ctrl, big_slots, BIG));
+  expect_map(&map);
+
+  printf("nodes in a map and a list at once\n");
+  dlist_mynode_t_init(&list);
+  for (x = 100; x < 700; x++) {
+    assert(flatmap_mynode_t_insert(&map, &nodes[x]));
+    present[x] = 1;
+    dlist_mynode_t_pushback(&list, &nodes[x]);
+  }
+  expect_map(&map);
+  assert(!flatmap_mynode_t_resize(&map, small_ctrl, small_slots, SMALL));
+  assert(flatmap_mynode_t_capacity(&map) == BIG);
+  expect_map(&map);
+  x = 100;
+  DLIST_FOREACH(mynode_t, &list, n) {
+    assert(flatmap_mynode_t_find(&map, n->key) == n);
+    assert(n->key == x++);
+  }
+  while ((n = dlist_mynode_t_first(&list))) {
+    dlist_mynode_t_remove(&list, n);
+    flatmap_mynode_t_erase(&map, n);
+    present[n->key] = 0;
+  }
+  dlist_mynode_t_destroy(&list);
+  expect_map(&map);
+
+  printf("random churn\n");
+  srand(1);
+  for (x = 0; x < 50000; x++) {
+    int key = rand() % KEYS;
+    if (present[key]) {
+      flatmap_mynode_t_erase(&map, &nodes[key]);
+      present[key] = 0;
+    } else if (flatmap_mynode_t_insert(&map, &nodes[key])) {
+      present[key] = 1;
+    } else {
+      // Full, likely of tombstones, so rehash to get rid of them
+      if (map.map.ctrl == big_ctrl)
+        assert(flatmap_mynode_t_resize(&map, spare_ctrl, spare_slots, BIG));
+      else
+        assert(flatmap_mynode_t_resize(&map, big_ctrl, big_slots, BIG));
+      if (flatmap_mynode_t_insert(&map, &nodes[key]))
+        present[key] = 1;
+      else
+        assert(flatmap_mynode_t_size(&map) == BIG - BIG / 8);
+    }
+    if (x % 211 == 0)
+      expect_map(&map);
+  }
+  expect_map(&map);
+  flatmap_mynode_t_clear(&map);
+  memset(present, 0, sizeof(present));
+  expect_map(&map);
+  flatmap_mynode_t_destroy(&map);
+
+  printf("colliding hashes\n");
+  signed char bad_ctrl[FLATMAP_CTRL_SIZE(SMALL)];
+  flatmap_badnode_t_init(&bad_map, bad_ctrl, bad_slots, SMALL);
+  for (x = 0; x < SMALL - SMALL / 8; x++) {
+    bad_nodes[x].key = x;
+    assert(flatmap_badnode_t_insert(&bad_map, &bad_nodes[x]));
+  }
+  flatmap_badnode_t_check(&bad_map);
+  for (x = 0; x < SMALL - SMALL / 8; x++)
+    assert(flatmap_badnode_t_find(&bad_map, x) == &bad_nodes[x]);
+  assert(!flatmap_badnode_t_find(&bad_map, 100));
+  for (x = 0; x < SMALL - SMALL / 8; x += 2)
+    flatmap_badnode_t_erase(&bad_map, &bad_nodes[x]);
+  flatmap_badnode_t_check(&bad_map);
+  for (x = 1; x < SMALL - SMALL / 8; x += 2)
+    assert(flatmap_badnode_t_find(&bad_map, x) == &bad_nodes[x]);
+  assert(flatmap_badnode_t_size(&bad_map) == (SMALL - SMALL / 8) / 2);
+  flatmap_badnode_t_clear(&bad_map);
+  flatmap_badnode_t_destroy(&bad_map);
+
+  printf("PASSED!\n");
+}
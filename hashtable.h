@@ -0,0 +1,334 @@
+// Intrusive chained hash table, with dlist.h lists as buckets
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) declare a "node" type, with a key field and a "dlist_node_t" member
+//   3) call "DEFINE_HASHTABLE" with their node-type, the key's type and
+//      field name, the member name, a hash function and an equality function
+//   4) allocate a "hashtable_##type" and an array of "dlist_t" buckets (a
+//      power of two long), and call hashtable_##type##_init() with them
+//   5) The user must allocate all nodes before passing them in
+//   6) To grow (or shrink) the table, allocate a new bucket array and call
+//      hashtable_##type##_resize() with it. Once
+//      hashtable_##type##_rehashing() returns 0 the old array is unused, and
+//      may be freed. hashtable_##type##_rehash_step() may be called when
+//      idle to get there sooner.
+//   7) When done with the table, empty it (hashtable_##type##_pop() until
+//      NULL will do), then call "hashtable_##type##_destroy".
+//
+//   See hashtable_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   A key may only be in the table once, find it before inserting.
+//   The table never resizes itself, since it can't allocate. Check
+//   hashtable_##type##_size() against hashtable_##type##_nbuckets() and call
+//   resize when the load gets too high.
+//   Only one resize may be under way, resize returns 0 (and does nothing)
+//   if called during another. Growing 2x at a load of 1 finishes moving
+//   before the new array reaches that load, as long as
+//   HASHTABLE_REHASH_STEP is at least 1.
+//
+// Design Decisions:
+//   * A bucket is a dlist_t and nodes carry a plain dlist_node_t, so the same
+//     node type can move between a hash table and any dlist. Removal is
+//     dlist_remove, with the bucket found by rehashing the node's key.
+//   * Resizing is incremental. resize just records the new array, then
+//     every insert and remove moves HASHTABLE_REHASH_STEP buckets of the old
+//     array over. Lookups check the old array for buckets not yet moved. So
+//     no operation ever pays for rehashing the whole table, the worst case
+//     is HASHTABLE_REHASH_STEP chains, which is flat in the table size.
+//   * Likewise the new array isn't initialized up front, each new bucket is
+//     initialized just before the old bucket that feeds it is moved (for 2x
+//     growth, two per old bucket). Until then nothing reads it.
+//   * For the same reason a resize during a resize is refused, rather than
+//     finishing the first one.
+//   * Hash and equality are called directly by the generated code, so the
+//     compiler can inline them.
+
+#include <assert.h>
+#include <stddef.h>
+#include "dlist.h"
+#include "offset.h"
+#include "panic.h"
+
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+// Old buckets moved per insert or remove while resizing. More finishes a
+// resize sooner, fewer bounds the extra work per operation tighter. May be
+// overridden before including this header.
+#ifndef HASHTABLE_REHASH_STEP
+#define HASHTABLE_REHASH_STEP 1
+#endif
+
+// ******************* typedefs ****************
+
+// The backend table, the typed table wraps this
+typedef struct {
+  dlist_t *buckets;
+  size_t mask;
+  // While resizing, the array we're moving out of, and the index of the
+  // next bucket in it to move. NULL otherwise.
+  dlist_t *old;
+  size_t old_mask;
+  size_t migrate;
+  size_t size;
+} hashtable_t;
+
+// Defines the typed table.
+//   keytype  - the type of the key field, passed by value
+//   key      - the name of the key field in "type"
+//   metaname - the name of the dlist_node_t member
+//   hashfn   - a function or macro taking a keytype, returning a size_t
+//   eqfn     - a function or macro taking two keytypes, non-zero if equal
+// pop removes and returns an arbitrary node, NULL if empty. first and next
+// walk every node, see HASHTABLE_FOREACH. rehash_step moves up to "count"
+// old buckets, and returns how many are left to move.
+#define DEFINE_HASHTABLE(type, keytype, key, metaname, hashfn, eqfn)  \
+  typedef struct {  \
+    hashtable_t table;  \
+  } hashtable_##type;  \
+  void hashtable_##type##_init(hashtable_##type *root, dlist_t *buckets,  \
+                               size_t nbuckets) {  \
+    hashtable_init(&root->table, buckets, nbuckets);  \
+  }  \
+  void hashtable_##type##_destroy(hashtable_##type *root) {  \
+    hashtable_destroy(&root->table);  \
+  }  \
+  size_t hashtable_##type##_size(const hashtable_##type *root) {  \
+    return root->table.size;  \
+  }  \
+  size_t hashtable_##type##_nbuckets(const hashtable_##type *root) {  \
+    return root->table.mask + 1;  \
+  }  \
+  int hashtable_##type##_rehashing(const hashtable_##type *root) {  \
+    return root->table.old != NULL;  \
+  }  \
+  size_t hashtable_##type##_rehash_step(hashtable_##type *root,  \
+                                        size_t count) {  \
+    hashtable_t *table = &root->table;  \
+    dlist_node_t *ptr;  \
+    for (; count && table->old; count--) {  \
+      hashtable_prepare(table);  \
+      while ((ptr = dlist_pop(&table->old[table->migrate]))) {  \
+        size_t hash = hashfn(GET_CONTAINER(ptr, type, metaname)->key);  \
+        dlist_pushback(&table->buckets[hash & table->mask], ptr);  \
+      }  \
+      hashtable_migrated(table);  \
+    }  \
+    return table->old ? table->old_mask + 1 - table->migrate : 0;  \
+  }  \
+  type * hashtable_##type##_find(const hashtable_##type *root, keytype k) {  \
+    dlist_node_t *ptr;  \
+    for (ptr = hashtable_bucket(&root->table, hashfn(k))->head; ptr;  \
+         ptr = ptr->next) {  \
+      if (eqfn(GET_CONTAINER(ptr, type, metaname)->key, k))  \
+        return GET_CONTAINER(ptr, type, metaname);  \
+    }  \
+    return NULL;  \
+  }  \
+  void hashtable_##type##_insert(hashtable_##type *root, type *data) {  \
+    assert(!hashtable_##type##_find(root, data->key));  \
+    if (root->table.old)  \
+      hashtable_##type##_rehash_step(root, HASHTABLE_REHASH_STEP);  \
+    dlist_enqueue(hashtable_bucket(&root->table, hashfn(data->key)),  \
+                  &(data->metaname));  \
+    root->table.size++;  \
+  }  \
+  void hashtable_##type##_remove(hashtable_##type *root, type *data) {  \
+    assert(root->table.size);  \
+    dlist_remove(hashtable_bucket(&root->table, hashfn(data->key)),  \
+                 &(data->metaname));  \
+    root->table.size--;  \
+    if (root->table.old)  \
+      hashtable_##type##_rehash_step(root, HASHTABLE_REHASH_STEP);  \
+  }  \
+  type * hashtable_##type##_pop(hashtable_##type *root) {  \
+    dlist_node_t *ptr = hashtable_first(&root->table);  \
+    if (!ptr)  \
+      return NULL;  \
+    type *data = GET_CONTAINER(ptr, type, metaname);  \
+    hashtable_##type##_remove(root, data);  \
+    return data;  \
+  }  \
+  int hashtable_##type##_resize(hashtable_##type *root, dlist_t *buckets,  \
+                                size_t nbuckets) {  \
+    return hashtable_resize(&root->table, buckets, nbuckets);  \
+  }  \
+  type * hashtable_##type##_first(const hashtable_##type *root) {  \
+    dlist_node_t *ptr = hashtable_first(&root->table);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * hashtable_##type##_next(const hashtable_##type *root,  \
+                                 const type *data) {  \
+    dlist_node_t *ptr = data->metaname.next;  \
+    if (!ptr)  \
+      ptr = hashtable_next_bucket(&root->table,  \
+                                  hashtable_bucket(&root->table,  \
+                                                   hashfn(data->key)));  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  void hashtable_##type##_check(const hashtable_##type *root) {  \
+    const hashtable_t *table = &root->table;  \
+    size_t size = 0;  \
+    type *data;  \
+    hashtable_check(table);  \
+    for (data = hashtable_##type##_first(root); data;  \
+         data = hashtable_##type##_next(root, data)) {  \
+      dlist_node_t *ptr;  \
+      dlist_t *bucket = hashtable_bucket(table, hashfn(data->key));  \
+      for (ptr = bucket->head; ptr != &(data->metaname); ptr = ptr->next)  \
+        assert(ptr);  \
+      size++;  \
+    }  \
+    assert(size == table->size);  \
+  }
+
+// Inline iteration over every node, in no particular order.
+//   var - a "type *", set to each node in turn
+// The body must not insert or remove.
+#define HASHTABLE_FOREACH(type, root, var)  \
+  for ((var) = hashtable_##type##_first(root);  \
+       (var);  \
+       (var) = hashtable_##type##_next((root), (var)))
+
+
+// ******************* private functions ****************
+
+void hashtable_init_buckets(dlist_t *buckets, size_t nbuckets) {
+  size_t i;
+  assert(nbuckets && !(nbuckets & (nbuckets - 1)));
+  for (i = 0; i < nbuckets; i++)
+    dlist_init(&buckets[i]);
+}
+
+// "nbuckets" must be a power of two
+void hashtable_init(hashtable_t *root, dlist_t *buckets, size_t nbuckets) {
+  hashtable_init_buckets(buckets, nbuckets);
+  root->buckets = buckets;
+  root->mask = nbuckets - 1;
+  root->old = NULL;
+  root->old_mask = 0;
+  root->migrate = 0;
+  root->size = 0;
+}
+
+void hashtable_destroy(hashtable_t *root) {
+  if (root->size) {
+    PANIC("hashtable_destroy: table is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->buckets = (dlist_t*) 0xdeadbeef;
+  root->old = (dlist_t*) 0xdeadbeef;
+}
+
+// True if new bucket "i" has been initialized, see hashtable_prepare
+int hashtable_ready(const hashtable_t *root, size_t i) {
+  return !root->old || (i & root->old_mask) < root->migrate;
+}
+
+// Initializes the new buckets that the old bucket at "migrate" moves into.
+// Nodes only land in a new bucket from the old bucket with the same low
+// bits, or from an insert into a bucket that's already been moved, so this
+// is always in time.
+void hashtable_prepare(hashtable_t *root) {
+  size_t i;
+  for (i = root->migrate; i <= root->mask; i += root->old_mask + 1)
+    dlist_init(&root->buckets[i]);
+}
+
+// The bucket that holds (or would hold) nodes with hash "hash"
+dlist_t * hashtable_bucket(const hashtable_t *root, size_t hash) {
+  if (root->old && (hash & root->old_mask) >= root->migrate)
+    return &root->old[hash & root->old_mask];
+  return &root->buckets[hash & root->mask];
+}
+
+// Called once the old bucket at "migrate" has been emptied
+void hashtable_migrated(hashtable_t *root) {
+  assert(!root->old[root->migrate].head);
+  root->migrate++;
+  if (root->migrate > root->old_mask) {
+    root->old = NULL;
+    root->old_mask = 0;
+    root->migrate = 0;
+  }
+}
+
+// Starts moving everything to "buckets", returns 0 (doing nothing) if a
+// resize is already under way.
+// Nodes are moved by the typed code, HASHTABLE_REHASH_STEP buckets per
+// insert or remove. "buckets" needn't be initialized, it's done as nodes are
+// moved into it.
+int hashtable_resize(hashtable_t *root, dlist_t *buckets, size_t nbuckets) {
+  if (root->old)
+    return 0;
+  assert(buckets != root->buckets);
+  assert(nbuckets && !(nbuckets & (nbuckets - 1)));
+  root->old = root->buckets;
+  root->old_mask = root->mask;
+  root->migrate = 0;
+  root->buckets = buckets;
+  root->mask = nbuckets - 1;
+  return 1;
+}
+
+// Returns the first node in a non-empty bucket after "bucket", which must be
+// a bucket in use. The new array is walked first, then what's left of the
+// old one.
+dlist_node_t * hashtable_next_bucket(const hashtable_t *root,
+                                     const dlist_t *bucket) {
+  const dlist_t *end = root->buckets + root->mask + 1;
+  if (bucket >= root->buckets && bucket < end) {
+    for (bucket++; bucket < end; bucket++) {
+      if (hashtable_ready(root, bucket - root->buckets) && bucket->head)
+        return bucket->head;
+    }
+    if (!root->old)
+      return NULL;
+    bucket = &root->old[root->migrate];
+  } else {
+    bucket++;
+  }
+  end = root->old + root->old_mask + 1;
+  for (; bucket < end; bucket++) {
+    if (bucket->head)
+      return bucket->head;
+  }
+  return NULL;
+}
+
+dlist_node_t * hashtable_first(const hashtable_t *root) {
+  if (hashtable_ready(root, 0) && root->buckets->head)
+    return root->buckets->head;
+  return hashtable_next_bucket(root, root->buckets);
+}
+
+// Checks every bucket in use is a well formed list, and the moved part of
+// the old array is empty. The typed check also checks each node is in the
+// right bucket.
+void hashtable_check(const hashtable_t *root) {
+  size_t i;
+  for (i = 0; i <= root->mask; i++) {
+    if (hashtable_ready(root, i))
+      dlist_check(&root->buckets[i]);
+  }
+  if (root->old) {
+    assert(root->migrate <= root->old_mask);
+    for (i = 0; i <= root->old_mask; i++) {
+      dlist_check(&root->old[i]);
+      if (i < root->migrate)
+        assert(!root->old[i].head);
+    }
+  }
+}
+
+#endif
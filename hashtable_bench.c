@@ -0,0 +1,116 @@
+// Benchmark for hashtable (intrusive chained hash table)
+//
+// Usage:
+//   gcc -O2 -o hashtable_bench hashtable_bench.c
+//   ./hashtable_bench [nodes]
+// "nodes" defaults to 4000000. Inserts that many keys into a table that
+// starts with 16 buckets and doubles whenever the load reaches 1, timing
+// every insert (the resize included, when one starts) on its own. Done
+// with the incremental rehash, and with the whole rehash done at once in
+// resize, as a table without incremental rehashing would.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "hashtable.h"
+
+#define RUNS 3
+#define START_BUCKETS 16
+
+typedef struct {
+  long key;
+  dlist_node_t hash_data;
+} mynode_t;
+
+// Fibonacci hashing, spreads sequential keys over the buckets
+#define long_hash(k) ((size_t) (k) * 0x9E3779B97F4A7C15ull >> 16)
+#define long_eq(a, b) ((a) == (b))
+
+DEFINE_HASHTABLE(mynode_t, long, key, hash_data, long_hash, long_eq)
+
+hashtable_mynode_t table;
+
+int cmp_double(const void *a, const void *b) {
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+// Inserts every node, storing each insert's latency in "lat". "arrays"
+// holds a bucket array for each size, allocated (and touched) up front, so
+// only the table's own work is timed.
+void fill(mynode_t *nodes, size_t count, dlist_t **arrays, int at_once,
+          double *lat) {
+  size_t i;
+  int next = 1;
+  hashtable_mynode_t_init(&table, arrays[0], START_BUCKETS);
+  for (i = 0; i < count; i++) {
+    double start = bench_now();
+    size_t nbuckets = hashtable_mynode_t_nbuckets(&table);
+    if (hashtable_mynode_t_size(&table) >= nbuckets &&
+        hashtable_mynode_t_resize(&table, arrays[next], nbuckets * 2)) {
+      next++;
+      if (at_once)
+        hashtable_mynode_t_rehash_step(&table, nbuckets);
+    }
+    hashtable_mynode_t_insert(&table, &nodes[i]);
+    lat[i] = bench_now() - start;
+  }
+  // Finish moving, so the arrays can be reused
+  hashtable_mynode_t_rehash_step(&table, (size_t) -1);
+  // (pop would rescan the emptied buckets each time)
+  for (i = 0; i < count; i++)
+    hashtable_mynode_t_remove(&table, &nodes[i]);
+  hashtable_mynode_t_destroy(&table);
+}
+
+int main(int argc, char **argv) {
+  size_t count = bench_arg(argc, argv, 1, 4000000);
+  mynode_t *nodes = malloc(count * sizeof(mynode_t));
+  double *lat = malloc(count * sizeof(double));
+  dlist_t *arrays[64];
+  size_t nbuckets;
+  size_t i;
+  int narrays = 0;
+  int at_once;
+  int x;
+
+  for (nbuckets = START_BUCKETS; nbuckets <= 4 * count; nbuckets *= 2) {
+    arrays[narrays] = malloc(nbuckets * sizeof(dlist_t));
+    for (i = 0; i < nbuckets; i++)
+      dlist_init(&arrays[narrays][i]);
+    narrays++;
+  }
+  for (i = 0; i < count; i++)
+    nodes[i].key = i;
+  printf("insert %zu keys from %d buckets, doubling at load 1 (ns/insert,"
+         " clock overhead included)\n", count, START_BUCKETS);
+  for (at_once = 0; at_once < 2; at_once++) {
+    double best[5] = {1e9, 1e9, 1e9, 1e9, 1e9};
+    int run;
+    for (run = 0; run < RUNS; run++) {
+      double total = 0;
+      fill(nodes, count, arrays, at_once, lat);
+      for (i = 0; i < count; i++)
+        total += lat[i];
+      qsort(lat, count, sizeof(double), cmp_double);
+      double stats[5] = {total / count, lat[count / 2],
+                         lat[count - count / 100 - 1],
+                         lat[count - count / 1000 - 1], lat[count - 1]};
+      for (x = 0; x < 5; x++) {
+        if (stats[x] < best[x])
+          best[x] = stats[x];
+      }
+    }
+    printf("  %-11s mean %5.0f  p50 %5.0f  p99 %6.0f  p99.9 %6.0f"
+           "  max %10.0f\n", at_once ? "all at once" : "incremental",
+           best[0] * 1e9, best[1] * 1e9, best[2] * 1e9, best[3] * 1e9,
+           best[4] * 1e9);
+  }
+  for (x = 0; x < narrays; x++)
+    free(arrays[x]);
+  free(lat);
+  free(nodes);
+  return 0;
+}
@@ -0,0 +1,167 @@
+// Unittest for hashtable (intrusive chained hash table)
+
+
+#include <stdio.h>
+#include <string.h>
+#include "assert.h"
+#include "hashtable.h"
+
+#define KEYS 1000
+
+typedef struct {
+  int key;
+  dlist_node_t table_data;
+} mynode_t;
+
+#define int_hash(k) ((size_t) (k) * 2654435761u)
+#define int_eq(a, b) ((a) == (b))
+
+DEFINE_HASHTABLE(mynode_t, int, key, table_data, int_hash, int_eq)
+
+hashtable_mynode_t table;
+dlist_t small_buckets[4];
+dlist_t medium_buckets[64];
+dlist_t big_buckets[1024];
+
+mynode_t nodes[KEYS];
+// Whether nodes[i] is in the table
+char present[KEYS];
+
+// Asserts exactly the nodes marked in "present" are in the table
+void expect_table(hashtable_mynode_t *table) {
+  mynode_t *n;
+  size_t count = 0;
+  int x;
+  hashtable_mynode_t_check(table);
+  HASHTABLE_FOREACH(mynode_t, table, n) {
+    assert(present[n->key]);
+    count++;
+  }
+  for (x = 0; x < KEYS; x++) {
+    n = hashtable_mynode_t_find(table, x);
+    assert(present[x] ? n == &nodes[x] : !n);
+    if (present[x])
+      count--;
+  }
+  assert(count == 0);
+}
+
+void insert(hashtable_mynode_t *table, int x) {
+  assert(!present[x]);
+  hashtable_mynode_t_insert(table, &nodes[x]);
+  present[x] = 1;
+}
+
+void remove_key(hashtable_mynode_t *table, int x) {
+  assert(present[x]);
+  hashtable_mynode_t_remove(table, &nodes[x]);
+  present[x] = 0;
+}
+
+// Scribbles over "buckets" first, resize mustn't rely on them being
+// initialized. Not while resizing, when they may be the array in use.
+int resize(hashtable_mynode_t *table, dlist_t *buckets, size_t nbuckets) {
+  if (!hashtable_mynode_t_rehashing(table))
+    memset(buckets, 0xa5, nbuckets * sizeof(dlist_t));
+  return hashtable_mynode_t_resize(table, buckets, nbuckets);
+}
+
+int main(unsigned int argc, char **argv) {
+  mynode_t *n;
+  int x;
+
+  for (x = 0; x < KEYS; x++)
+    nodes[x].key = x;
+
+  printf("initializing table\n");
+  hashtable_mynode_t_init(&table, small_buckets, 4);
+  expect_table(&table);
+  assert(!hashtable_mynode_t_first(&table));
+  assert(!hashtable_mynode_t_pop(&table));
+  assert(hashtable_mynode_t_nbuckets(&table) == 4);
+
+  printf("insert and remove\n");
+  for (x = 0; x < 20; x++)
+    insert(&table, x);
+  expect_table(&table);
+  for (x = 0; x < 20; x += 3)
+    remove_key(&table, x);
+  expect_table(&table);
+  assert(hashtable_mynode_t_size(&table) == 13);
+
+  printf("grow incrementally\n");
+  assert(resize(&table, medium_buckets, 64));
+  assert(hashtable_mynode_t_rehashing(&table));
+  assert(hashtable_mynode_t_nbuckets(&table) == 64);
+  expect_table(&table);
+  // Each insert or remove moves one of the 4 old buckets
+  insert(&table, 100);
+  expect_table(&table);
+  remove_key(&table, 1);
+  expect_table(&table);
+  insert(&table, 101);
+  assert(hashtable_mynode_t_rehashing(&table));
+  insert(&table, 102);
+  assert(!hashtable_mynode_t_rehashing(&table));
+  expect_table(&table);
+
+  printf("resize while resizing is refused\n");
+  assert(resize(&table, big_buckets, 1024));
+  insert(&table, 103);
+  assert(!resize(&table, small_buckets, 4));
+  assert(hashtable_mynode_t_nbuckets(&table) == 1024);
+  assert(hashtable_mynode_t_rehash_step(&table, 0) == 63);
+  assert(hashtable_mynode_t_rehash_step(&table, 30) == 33);
+  expect_table(&table);
+  assert(hashtable_mynode_t_rehash_step(&table, 100) == 0);
+  assert(!hashtable_mynode_t_rehashing(&table));
+  expect_table(&table);
+
+  printf("shrink\n");
+  assert(resize(&table, small_buckets, 4));
+  // Moving the 1024 old buckets takes 1024 inserts and removes
+  for (x = 0; hashtable_mynode_t_rehashing(&table); x++) {
+    if (x % 2)
+      remove_key(&table, 200);
+    else
+      insert(&table, 200);
+    if (x % 101 == 0)
+      expect_table(&table);
+  }
+  assert(x == 1024);
+  expect_table(&table);
+
+  printf("random churn with resizes\n");
+  srand(1);
+  for (x = 0; x < 20000; x++) {
+    int key = rand() % KEYS;
+    if (present[key])
+      remove_key(&table, key);
+    else
+      insert(&table, key);
+    if (!hashtable_mynode_t_rehashing(&table) && rand() % 100 == 0) {
+      size_t nbuckets = hashtable_mynode_t_nbuckets(&table);
+      if (nbuckets == 4)
+        resize(&table, medium_buckets, 64);
+      else if (nbuckets == 64 && rand() % 2)
+        resize(&table, big_buckets, 1024);
+      else if (nbuckets == 64)
+        resize(&table, small_buckets, 4);
+      else
+        resize(&table, medium_buckets, 64);
+    }
+    if (x % 113 == 0)
+      expect_table(&table);
+  }
+  expect_table(&table);
+
+  printf("pop everything\n");
+  while ((n = hashtable_mynode_t_pop(&table))) {
+    assert(present[n->key]);
+    present[n->key] = 0;
+  }
+  expect_table(&table);
+  hashtable_mynode_t_destroy(&table);
+
+  printf("PASSED!\n");
+}
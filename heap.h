@@ -0,0 +1,246 @@
+// Generic intrusive d-ary heap (priority queue)
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) declare a "node" type, with a "heap_node_t" as a member
+//   3) call "DEFINE_HEAP" with their node-type, the member name, and a
+//      comparison function
+//   4) allocate a "heap_##type" and an array of "capacity" "heap_node_t *",
+//      and call heap_##type##_init() with them
+//   5) The user must allocate all nodes before passing them in
+//   6) When done with the heap user must call "heap_##type##_destroy" on it.
+//      The array may then be freed.
+//
+//   See heap_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   It's a min-heap, pop returns the node "cmp" orders first. Reverse "cmp"
+//   for a max-heap.
+//   Push returns 0 when the array is full, resize moves the heap to a
+//   bigger one.
+//   To change a node's priority (e.g. decrease-key) while it's in the heap,
+//   change its fields and call heap_##type##_update() on it.
+//   Each node records its position in the array, so update and remove are
+//   O(log n) with no search. heap_##type##_queued() says if a node is in a
+//   heap, which works once the node has been through
+//   heap_##type##_node_init(), or been popped or removed.
+//   A node may be in a heap and a dlist at once, with a member for each.
+//
+// Design Decisions:
+//   * Each parent has HEAP_ARITY (default 4) children. Against a binary heap
+//     that makes the tree half as deep, so push and update do half the
+//     moves, while pop compares a few more children, which sit next to each
+//     other in the array, so in the same one or two cache lines.
+//   * The array holds pointers to the nodes, rather than the nodes, so nodes
+//     don't move and can be in other datastructures.
+//   * Sifting is written by the typed macros, so "cmp" is called directly
+//     and can be inlined, as in DEFINE_DLIST_SORT.
+//   * Sifting moves the hole rather than swapping, so each level is one
+//     pointer and one index write.
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "offset.h"
+#include "panic.h"
+
+#ifndef HEAP_H
+#define HEAP_H
+
+// Children per parent, may be defined before including this header
+#ifndef HEAP_ARITY
+#define HEAP_ARITY 4
+#endif
+
+// Index of a node that isn't in a heap
+#define HEAP_NIL SIZE_MAX
+
+// ******************* typedefs ****************
+
+// User should include this as a field in their node struct
+typedef struct {
+  size_t index;
+} heap_node_t;
+
+// The backend heap, the typed heap wraps this
+typedef struct {
+  heap_node_t **array;
+  size_t size;
+  size_t capacity;
+} heap_t;
+
+// Defines the typed heap.
+//   cmp - a function or macro taking two "const type *", returning <0, 0, or
+//         >0 like strcmp
+// peek and pop return NULL if the heap is empty.
+// resize moves the heap to a new array, and returns 0 if it's too small,
+// leaving the heap unchanged.
+#define DEFINE_HEAP(type, metaname, cmp)  \
+  typedef struct {  \
+    heap_t heap;  \
+  } heap_##type;  \
+  void heap_##type##_init(heap_##type *root, heap_node_t **array,  \
+                          size_t capacity) {  \
+    heap_init(&root->heap, array, capacity);  \
+  }  \
+  void heap_##type##_destroy(heap_##type *root) {  \
+    heap_destroy(&root->heap);  \
+  }  \
+  int heap_##type##_empty(const heap_##type *root) {  \
+    return !root->heap.size;  \
+  }  \
+  size_t heap_##type##_size(const heap_##type *root) {  \
+    return root->heap.size;  \
+  }  \
+  size_t heap_##type##_capacity(const heap_##type *root) {  \
+    return root->heap.capacity;  \
+  }  \
+  void heap_##type##_node_init(type *data) {  \
+    data->metaname.index = HEAP_NIL;  \
+  }  \
+  int heap_##type##_queued(const type *data) {  \
+    return data->metaname.index != HEAP_NIL;  \
+  }  \
+  void heap_##type##_sift_up(heap_##type *root, heap_node_t *node,  \
+                             size_t i) {  \
+    heap_node_t **array = root->heap.array;  \
+    while (i) {  \
+      size_t parent = (i - 1) / HEAP_ARITY;  \
+      if (cmp(GET_CONTAINER(node, type, metaname),  \
+              GET_CONTAINER(array[parent], type, metaname)) >= 0)  \
+        break;  \
+      array[i] = array[parent];  \
+      array[i]->index = i;  \
+      i = parent;  \
+    }  \
+    array[i] = node;  \
+    node->index = i;  \
+  }  \
+  void heap_##type##_sift_down(heap_##type *root, heap_node_t *node,  \
+                               size_t i) {  \
+    heap_node_t **array = root->heap.array;  \
+    size_t size = root->heap.size;  \
+    for (;;) {  \
+      size_t child = i * HEAP_ARITY + 1;  \
+      size_t end = child + HEAP_ARITY;  \
+      size_t best = child;  \
+      if (child >= size)  \
+        break;  \
+      if (end > size)  \
+        end = size;  \
+      for (child++; child < end; child++) {  \
+        if (cmp(GET_CONTAINER(array[child], type, metaname),  \
+                GET_CONTAINER(array[best], type, metaname)) < 0)  \
+          best = child;  \
+      }  \
+      if (cmp(GET_CONTAINER(array[best], type, metaname),  \
+              GET_CONTAINER(node, type, metaname)) >= 0)  \
+        break;  \
+      array[i] = array[best];  \
+      array[i]->index = i;  \
+      i = best;  \
+    }  \
+    array[i] = node;  \
+    node->index = i;  \
+  }  \
+  int heap_##type##_push(heap_##type *root, type *data) {  \
+    if (root->heap.size == root->heap.capacity)  \
+      return 0;  \
+    heap_##type##_sift_up(root, &(data->metaname), root->heap.size++);  \
+    return 1;  \
+  }  \
+  type * heap_##type##_peek(const heap_##type *root) {  \
+    if (!root->heap.size)  \
+      return NULL;  \
+    return GET_CONTAINER(root->heap.array[0], type, metaname);  \
+  }  \
+  void heap_##type##_update(heap_##type *root, type *data) {  \
+    heap_node_t *node = &(data->metaname);  \
+    assert(root->heap.array[node->index] == node);  \
+    heap_##type##_sift_up(root, node, node->index);  \
+    heap_##type##_sift_down(root, node, node->index);  \
+  }  \
+  void heap_##type##_remove(heap_##type *root, type *data) {  \
+    heap_node_t *node = &(data->metaname);  \
+    heap_node_t *last;  \
+    size_t i = node->index;  \
+    assert(i < root->heap.size && root->heap.array[i] == node);  \
+    last = root->heap.array[--root->heap.size];  \
+    node->index = HEAP_NIL;  \
+    if (last == node)  \
+      return;  \
+    heap_##type##_sift_up(root, last, i);  \
+    heap_##type##_sift_down(root, last, last->index);  \
+  }  \
+  type * heap_##type##_pop(heap_##type *root) {  \
+    heap_node_t *top;  \
+    heap_node_t *last;  \
+    if (!root->heap.size)  \
+      return NULL;  \
+    top = root->heap.array[0];  \
+    last = root->heap.array[--root->heap.size];  \
+    if (last != top)  \
+      heap_##type##_sift_down(root, last, 0);  \
+    top->index = HEAP_NIL;  \
+    return GET_CONTAINER(top, type, metaname);  \
+  }  \
+  int heap_##type##_resize(heap_##type *root, heap_node_t **array,  \
+                           size_t capacity) {  \
+    return heap_resize(&root->heap, array, capacity);  \
+  }  \
+  void heap_##type##_check(const heap_##type *root) {  \
+    heap_node_t **array = root->heap.array;  \
+    size_t i;  \
+    heap_check(&root->heap);  \
+    for (i = 1; i < root->heap.size; i++) {  \
+      assert(cmp(GET_CONTAINER(array[(i - 1) / HEAP_ARITY], type, metaname),  \
+                 GET_CONTAINER(array[i], type, metaname)) <= 0);  \
+    }  \
+  }
+
+
+// ******************* private functions ****************
+
+void heap_init(heap_t *root, heap_node_t **array, size_t capacity) {
+  root->array = array;
+  root->size = 0;
+  root->capacity = capacity;
+}
+
+void heap_destroy(heap_t *root) {
+  if (root->size) {
+    PANIC("heap_destroy: heap is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->array = (heap_node_t**) 0xdeadbeef;
+}
+
+int heap_resize(heap_t *root, heap_node_t **array, size_t capacity) {
+  if (capacity < root->size)
+    return 0;
+  // Indexes don't change, so the nodes needn't be touched
+  memmove(array, root->array, root->size * sizeof(heap_node_t*));
+  root->array = array;
+  root->capacity = capacity;
+  return 1;
+}
+
+// Checks the size and each node's index. The typed check also checks the
+// order.
+void heap_check(const heap_t *root) {
+  size_t i;
+  assert(root->size <= root->capacity);
+  for (i = 0; i < root->size; i++)
+    assert(root->array[i]->index == i);
+}
+
+#endif
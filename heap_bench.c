@@ -0,0 +1,132 @@
+// Benchmark for heap (intrusive d-ary heap) against a sorted dlist
+//
+// Usage:
+//   gcc -O2 -o heap_bench heap_bench.c
+//   ./heap_bench [largest]
+// Holds 10000 and "largest" (default 1000000) pending timers. Each op pops
+// the earliest, and re-arms it at a random delay after its deadline, which
+// is how a timer queue is used. The dlist is kept sorted by walking from
+// the head, it's O(n), so at the larger size it's only sampled with a few
+// ops. Build with -DHEAP_ARITY=2 to compare against a binary heap.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "dlist.h"
+#include "heap.h"
+
+#define RUNS 5
+#define HEAP_OPS 1000000
+#define DELAY 1000000
+
+typedef struct {
+  unsigned long deadline;
+  heap_node_t heap_data;
+  dlist_node_t list_data;
+} mytimer_t;
+
+int mytimer_cmp(const mytimer_t *a, const mytimer_t *b) {
+  return a->deadline < b->deadline ? -1 : a->deadline > b->deadline;
+}
+
+DEFINE_HEAP(mytimer_t, heap_data, mytimer_cmp)
+DEFINE_DLIST(mytimer_t, list_data)
+
+int cmp_ptr(const void *a, const void *b) {
+  return mytimer_cmp(*(mytimer_t* const*) a, *(mytimer_t* const*) b);
+}
+
+// Inserts "data" after the last timer that isn't later than it
+void sorted_insert(dlist_mytimer_t *list, mytimer_t *data) {
+  dlist_mytimer_t one;
+  mytimer_t *prev = NULL;
+  mytimer_t *n;
+  DLIST_FOREACH(mytimer_t, list, n) {
+    if (mytimer_cmp(n, data) > 0)
+      break;
+    prev = n;
+  }
+  dlist_mytimer_t_init(&one);
+  dlist_mytimer_t_pushback(&one, data);
+  dlist_mytimer_t_splice_after(list, prev, &one);
+  dlist_mytimer_t_destroy(&one);
+}
+
+void bench(size_t count) {
+  size_t list_ops = 20000000 / count;
+  // The heap and the list each get their own timers, since an op changes
+  // the deadline of the timer it re-arms
+  mytimer_t *timers = malloc(2 * count * sizeof(mytimer_t));
+  mytimer_t **order = malloc(2 * count * sizeof(mytimer_t*));
+  heap_node_t **array = malloc(count * sizeof(heap_node_t*));
+  heap_mytimer_t heap;
+  dlist_mytimer_t list;
+  double best[2] = {1e9, 1e9};
+  uint64_t seed = 1;
+  size_t i;
+  int run;
+
+  if (list_ops > 1000)
+    list_ops = 1000;
+  // Timers sit at random addresses, as if malloc'd over time
+  for (i = 0; i < 2 * count; i++)
+    order[i] = &timers[i];
+  bench_shuffle((void**) order, 2 * count, &seed);
+  heap_mytimer_t_init(&heap, array, count);
+  for (i = 0; i < count; i++) {
+    order[i]->deadline = bench_rand(&seed) % DELAY;
+    order[count + i]->deadline = order[i]->deadline;
+    heap_mytimer_t_push(&heap, order[i]);
+  }
+  qsort(order + count, count, sizeof(mytimer_t*), cmp_ptr);
+  dlist_mytimer_t_init(&list);
+  for (i = 0; i < count; i++)
+    dlist_mytimer_t_pushback(&list, order[count + i]);
+
+  for (run = 0; run < RUNS; run++) {
+    double start = bench_now();
+    double mid;
+    double end;
+    for (i = 0; i < HEAP_OPS; i++) {
+      mytimer_t *t = heap_mytimer_t_pop(&heap);
+      t->deadline += bench_rand(&seed) % DELAY;
+      heap_mytimer_t_push(&heap, t);
+    }
+    mid = bench_now();
+    for (i = 0; i < list_ops; i++) {
+      mytimer_t *t = dlist_mytimer_t_first(&list);
+      dlist_mytimer_t_remove(&list, t);
+      t->deadline += bench_rand(&seed) % DELAY;
+      sorted_insert(&list, t);
+    }
+    end = bench_now();
+    if (mid - start < best[0])
+      best[0] = mid - start;
+    if (end - mid < best[1])
+      best[1] = end - mid;
+  }
+  heap_mytimer_t_check(&heap);
+  dlist_mytimer_t_check(&list);
+  printf("  %8zu timers  %d-ary heap %7.1f   sorted dlist %10.1f\n", count,
+         HEAP_ARITY, best[0] * 1e9 / HEAP_OPS, best[1] * 1e9 / list_ops);
+
+  while (heap_mytimer_t_pop(&heap))
+    ;
+  heap_mytimer_t_destroy(&heap);
+  while (dlist_mytimer_t_first(&list))
+    dlist_mytimer_t_remove(&list, dlist_mytimer_t_first(&list));
+  dlist_mytimer_t_destroy(&list);
+  free(array);
+  free(order);
+  free(timers);
+}
+
+int main(int argc, char **argv) {
+  size_t largest = bench_arg(argc, argv, 1, 1000000);
+
+  printf("pop the earliest timer and re-arm it (ns/op)\n");
+  bench(10000);
+  bench(largest);
+  return 0;
+}
@@ -0,0 +1,153 @@
+// Unittest for heap (intrusive d-ary heap)
+
+
+#include <stdio.h>
+#include "assert.h"
+#include "heap.h"
+
+#define TIMERS 1000
+#define SMALL 64
+
+typedef struct {
+  unsigned int deadline;
+  heap_node_t heap_data;
+} mytimer_t;
+
+int mytimer_cmp(const mytimer_t *a, const mytimer_t *b) {
+  return a->deadline < b->deadline ? -1 : a->deadline > b->deadline;
+}
+
+DEFINE_HEAP(mytimer_t, heap_data, mytimer_cmp)
+
+heap_mytimer_t heap;
+heap_node_t *small_array[SMALL];
+heap_node_t *big_array[TIMERS];
+mytimer_t timers[TIMERS];
+
+// Asserts exactly the queued timers are in the heap, and the earliest is on
+// top
+void expect_heap(heap_mytimer_t *heap) {
+  mytimer_t *first = NULL;
+  size_t count = 0;
+  int x;
+  heap_mytimer_t_check(heap);
+  for (x = 0; x < TIMERS; x++) {
+    if (!heap_mytimer_t_queued(&timers[x]))
+      continue;
+    count++;
+    if (!first || timers[x].deadline < first->deadline)
+      first = &timers[x];
+  }
+  assert(count == heap_mytimer_t_size(heap));
+  if (first)
+    assert(heap_mytimer_t_peek(heap)->deadline == first->deadline);
+  else
+    assert(!heap_mytimer_t_peek(heap));
+}
+
+// Pops everything, checking it comes out in order
+void drain(heap_mytimer_t *heap) {
+  mytimer_t *t;
+  unsigned int last = 0;
+  while ((t = heap_mytimer_t_pop(heap))) {
+    assert(t->deadline >= last);
+    assert(!heap_mytimer_t_queued(t));
+    last = t->deadline;
+  }
+  expect_heap(heap);
+}
+
+int main(unsigned int argc, char **argv) {
+  mytimer_t *t;
+  int x;
+
+  for (x = 0; x < TIMERS; x++)
+    heap_mytimer_t_node_init(&timers[x]);
+
+  printf("initializing heap\n");
+  heap_mytimer_t_init(&heap, small_array, SMALL);
+  expect_heap(&heap);
+  assert(heap_mytimer_t_empty(&heap));
+  assert(!heap_mytimer_t_pop(&heap));
+
+  printf("push until full\n");
+  for (x = 0; x < SMALL; x++) {
+    timers[x].deadline = (x * 37) % SMALL;
+    assert(heap_mytimer_t_push(&heap, &timers[x]));
+    expect_heap(&heap);
+  }
+  assert(!heap_mytimer_t_push(&heap, &timers[SMALL]));
+  assert(!heap_mytimer_t_queued(&timers[SMALL]));
+  assert(heap_mytimer_t_peek(&heap)->deadline == 0);
+
+  printf("pop in order\n");
+  for (x = 0; x < SMALL; x++) {
+    t = heap_mytimer_t_pop(&heap);
+    assert(t->deadline == (unsigned int) x);
+    expect_heap(&heap);
+  }
+  assert(heap_mytimer_t_empty(&heap));
+
+  printf("decrease key and remove\n");
+  for (x = 0; x < SMALL; x++) {
+    timers[x].deadline = 1000 + x;
+    assert(heap_mytimer_t_push(&heap, &timers[x]));
+  }
+  timers[40].deadline = 5;
+  heap_mytimer_t_update(&heap, &timers[40]);
+  expect_heap(&heap);
+  assert(heap_mytimer_t_peek(&heap) == &timers[40]);
+  timers[40].deadline = 2000;
+  heap_mytimer_t_update(&heap, &timers[40]);
+  expect_heap(&heap);
+  assert(heap_mytimer_t_peek(&heap) == &timers[0]);
+  heap_mytimer_t_remove(&heap, &timers[0]);
+  assert(!heap_mytimer_t_queued(&timers[0]));
+  expect_heap(&heap);
+  assert(heap_mytimer_t_peek(&heap) == &timers[1]);
+  heap_mytimer_t_remove(&heap, &timers[40]);
+  expect_heap(&heap);
+
+  printf("resize\n");
+  assert(!heap_mytimer_t_resize(&heap, big_array, 10));
+  assert(heap_mytimer_t_resize(&heap, big_array, TIMERS));
+  assert(heap_mytimer_t_capacity(&heap) == TIMERS);
+  expect_heap(&heap);
+  for (x = SMALL; x < TIMERS; x++) {
+    timers[x].deadline = rand() % 5000;
+    assert(heap_mytimer_t_push(&heap, &timers[x]));
+  }
+  expect_heap(&heap);
+  drain(&heap);
+
+  printf("random churn\n");
+  srand(1);
+  for (x = 0; x < 100000; x++) {
+    int i = rand() % TIMERS;
+    switch (rand() % 4) {
+      case 0:
+        heap_mytimer_t_pop(&heap);
+        break;
+      case 1:
+        if (heap_mytimer_t_queued(&timers[i])) {
+          heap_mytimer_t_remove(&heap, &timers[i]);
+          break;
+        }
+        // fallthrough
+      default:
+        timers[i].deadline = rand() % 5000;
+        if (heap_mytimer_t_queued(&timers[i]))
+          heap_mytimer_t_update(&heap, &timers[i]);
+        else
+          assert(heap_mytimer_t_push(&heap, &timers[i]));
+        break;
+    }
+    if (x % 997 == 0)
+      expect_heap(&heap);
+  }
+  expect_heap(&heap);
+  drain(&heap);
+  heap_mytimer_t_destroy(&heap);
+
+  printf("PASSED!\n");
+}
@@ -0,0 +1,283 @@
+// Generic doubly-linked list, linked by 32-bit indices into an array
+//
+// Usage:
+//   The same as dlist.h, with "ilist" in place of "dlist", except all nodes
+//   must live in one array (an arena) that is handed to init
+//   1) include this header
+//   2) declare a "node" type, with an "ilist_node_t" as a member
+//   3) call "DEFINE_ILIST" with their node-type, and the member name
+//   4) The user must allocate an array of nodes, and an "ilist_##type" to
+//      store the list, and call ilist_##type##_init() with them
+//   5) Only nodes from that array may be put on the list
+//   6) When done with the list user must call "ilist_destroy" on the list head
+//
+//   See ilist_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   The links are array indices, not pointers, so the array may be moved
+//   (realloc'd, written to disk and read back, mapped at another address)
+//   with the lists in it intact. Just call ilist_##type##_rebase() on each
+//   list head with the new address.
+//   The array holds at most ILIST_NIL (2^32 - 1) nodes.
+//
+// Design Decisions:
+//   * An ilist_node_t is two uint32_t, 8 bytes rather than dlist_node_t's 16.
+//   * The head holds the array base, the node size, and the offset of the
+//     node in it, so a link is turned into an address with one multiply-add.
+//     The typed interface passes these from sizeof/OFFSET, the compiler
+//     will usually fold them when it inlines.
+//   * ILIST_NIL plays the role of NULL.
+//   * Otherwise we follow dlist.h - everything is in the header, backend
+//     functions are shared by all types, and macros write a typesafe
+//     interface over them.
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "offset.h"
+#include "panic.h"
+
+#ifndef ILIST_H
+#define ILIST_H
+
+#define ILIST_NIL UINT32_MAX
+
+// ******************* typedefs ****************
+
+// User should include this as a field in their node struct
+typedef struct {
+  uint32_t next;
+  uint32_t prev;
+} ilist_node_t;
+
+// User should use this type to store the list
+typedef struct {
+  char *base;
+  size_t stride;
+  size_t nodeoff;
+  uint32_t head;
+  uint32_t tail;
+} ilist_t;
+
+// As in dlist.h we define a *new* struct that wraps the original, for
+// typechecking, and cast to call the backend.
+#define DEFINE_ILIST(type, metaname)  \
+  typedef struct {  \
+    ilist_t list;  \
+  } ilist_##type;  \
+  void ilist_##type##_init(ilist_##type *root, type *base) {  \
+    ilist_init((ilist_t*) root, base, sizeof(type), OFFSET(type, metaname));  \
+  }  \
+  void ilist_##type##_rebase(ilist_##type *root, type *base) {  \
+    root->list.base = (char*) base;  \
+  }  \
+  void ilist_##type##_destroy(ilist_##type *root) {  \
+    ilist_destroy((ilist_t*) root);  \
+  }  \
+  void ilist_##type##_check(const ilist_##type *root) {  \
+    ilist_check((const ilist_t*) root);  \
+  }  \
+  int ilist_##type##_empty(const ilist_##type *root) {  \
+    return root->list.head == ILIST_NIL;  \
+  }  \
+  uint32_t ilist_##type##_index(const ilist_##type *root, const type *data) {  \
+    return (uint32_t) (data - (const type*) root->list.base);  \
+  }  \
+  type * ilist_##type##_node(const ilist_##type *root, uint32_t index) {  \
+    return index != ILIST_NIL ? (type*) root->list.base + index : NULL;  \
+  }  \
+  void ilist_##type##_enqueue(ilist_##type *root, type *data) {  \
+    ilist_enqueue((ilist_t*) root, ilist_##type##_index(root, data));  \
+  }  \
+  void ilist_##type##_pushback(ilist_##type *root, type *data) {  \
+    ilist_pushback((ilist_t*) root, ilist_##type##_index(root, data));  \
+  }  \
+  void ilist_##type##_push(ilist_##type *root, type *data) {  \
+    ilist_push((ilist_t*) root, ilist_##type##_index(root, data));  \
+  }  \
+  type * ilist_##type##_dequeue(ilist_##type *root) {  \
+    return ilist_##type##_node(root, ilist_dequeue((ilist_t*) root));  \
+  }  \
+  type * ilist_##type##_pop(ilist_##type *root) {  \
+    return ilist_##type##_node(root, ilist_pop((ilist_t*) root));  \
+  }  \
+  void ilist_##type##_remove(ilist_##type *root, type *data) {  \
+    ilist_remove((ilist_t*) root, ilist_##type##_index(root, data));  \
+  }  \
+  type * ilist_##type##_head(const ilist_##type *root) {  \
+    return ilist_##type##_node(root, root->list.head);  \
+  }  \
+  type * ilist_##type##_tail(const ilist_##type *root) {  \
+    return ilist_##type##_node(root, root->list.tail);  \
+  }  \
+  type * ilist_##type##_next(const ilist_##type *root, const type *data) {  \
+    return ilist_##type##_node(root, data->metaname.next);  \
+  }  \
+  type * ilist_##type##_prev(const ilist_##type *root, const type *data) {  \
+    return ilist_##type##_node(root, data->metaname.prev);  \
+  }  \
+  void * ilist_##type##_foldr(  \
+      const ilist_##type *root,  \
+      void *(*func)(type*, void*, char*),  \
+      void *init) {  \
+    type *ptr;  \
+    void* result = init;  \
+    for (ptr = ilist_##type##_head(root); ptr;  \
+         ptr = ilist_##type##_next(root, ptr)) {  \
+      char terminate = 0;  \
+      result = (*func)(ptr, result, &terminate);  \
+      if (terminate)  \
+        break;  \
+    }  \
+    return result;  \
+  }  \
+  void * ilist_##type##_foldl(  \
+      const ilist_##type *root,  \
+      void *(*func)(type*, void*, char*),  \
+      void *init) {  \
+    type *ptr;  \
+    void* result = init;  \
+    for (ptr = ilist_##type##_tail(root); ptr;  \
+         ptr = ilist_##type##_prev(root, ptr)) {  \
+      char terminate = 0;  \
+      result = (*func)(ptr, result, &terminate);  \
+      if (terminate)  \
+        break;  \
+    }  \
+    return result;  \
+  }
+
+// Inline iteration, as DLIST_FOREACH in dlist.h
+#define ILIST_FOREACH(type, root, var)  \
+  for ((var) = ilist_##type##_head(root);  \
+       (var);  \
+       (var) = ilist_##type##_next((root), (var)))
+
+// As ILIST_FOREACH, but from tail to head
+#define ILIST_FOREACH_REVERSE(type, root, var)  \
+  for ((var) = ilist_##type##_tail(root);  \
+       (var);  \
+       (var) = ilist_##type##_prev((root), (var)))
+
+// As ILIST_FOREACH, but "var" may be removed by the body.
+#define ILIST_FOREACH_SAFE(type, root, var, tmp)  \
+  for ((var) = ilist_##type##_head(root);  \
+       (var) && (((tmp) = ilist_##type##_next((root), (var))), 1);  \
+       (var) = (tmp))
+
+
+// ******************* private functions ****************
+
+// Turns an index into the address of that node's ilist_node_t
+ilist_node_t * ilist_link(const ilist_t *root, uint32_t index) {
+  assert(index != ILIST_NIL);
+  return (ilist_node_t*) (root->base + index * root->stride + root->nodeoff);
+}
+
+// "base" is the start of the node array, "stride" the size of a node, and
+// "nodeoff" the offset of the ilist_node_t within one
+void ilist_init(ilist_t *root, void *base, size_t stride, size_t nodeoff) {
+  root->base = (char*) base;
+  root->stride = stride;
+  root->nodeoff = nodeoff;
+  root->head = ILIST_NIL;
+  root->tail = ILIST_NIL;
+}
+
+void ilist_destroy(ilist_t *root) {
+  if (root->head != ILIST_NIL) {
+    PANIC("ilist_destroy: list is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->base = (char*) 0xdeadbeef;
+  root->head = 0xdeadbeef;
+  root->tail = 0xdeadbeef;
+}
+
+void ilist_enqueue(ilist_t *root, uint32_t index) {
+  ilist_node_t *data = ilist_link(root, index);
+  uint32_t old_head = root->head;
+  data->prev = ILIST_NIL;
+  data->next = old_head;
+
+  if (old_head == ILIST_NIL) {
+    assert(root->tail == ILIST_NIL);
+    root->tail = index;
+  } else {
+    assert(ilist_link(root, old_head)->prev == ILIST_NIL);
+    ilist_link(root, old_head)->prev = index;
+  }
+  root->head = index;
+}
+
+void ilist_pushback(ilist_t *root, uint32_t index) {
+  ilist_node_t *data = ilist_link(root, index);
+  uint32_t old_tail = root->tail;
+  data->next = ILIST_NIL;
+  data->prev = old_tail;
+
+  if (old_tail == ILIST_NIL) {
+    assert(root->head == ILIST_NIL);
+    root->head = index;
+  } else {
+    assert(ilist_link(root, old_tail)->next == ILIST_NIL);
+    ilist_link(root, old_tail)->next = index;
+  }
+  root->tail = index;
+}
+
+void ilist_push(ilist_t *root, uint32_t index) {
+  ilist_enqueue(root, index);
+}
+
+void ilist_remove(ilist_t *root, uint32_t index) {
+  ilist_node_t *data = ilist_link(root, index);
+  if (data->prev != ILIST_NIL) {
+    ilist_link(root, data->prev)->next = data->next;
+  } else {
+    assert(root->head == index);
+    root->head = data->next;
+  }
+  if (data->next != ILIST_NIL) {
+    ilist_link(root, data->next)->prev = data->prev;
+  } else {
+    assert(root->tail == index);
+    root->tail = data->prev;
+  }
+}
+
+// Returns the index of the removed tail, or ILIST_NIL if the list is empty
+uint32_t ilist_dequeue(ilist_t *root) {
+  uint32_t index = root->tail;
+  if (index != ILIST_NIL)
+    ilist_remove(root, index);
+  return index;
+}
+
+// Returns the index of the removed head, or ILIST_NIL if the list is empty
+uint32_t ilist_pop(ilist_t *root) {
+  uint32_t index = root->head;
+  if (index != ILIST_NIL)
+    ilist_remove(root, index);
+  return index;
+}
+
+void ilist_check(const ilist_t *root) {
+  uint32_t index;
+  uint32_t last_index = ILIST_NIL;
+  for (index = root->head; index != ILIST_NIL;
+       index = ilist_link(root, index)->next) {
+    assert(ilist_link(root, index)->prev == last_index);
+    last_index = index;
+  }
+  assert(root->tail == last_index);
+}
+
+#endif
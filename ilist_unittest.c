@@ -0,0 +1,162 @@
+// Unittest for ilist (index-linked doubly linked list)
+
+
+#include <stdio.h>
+#include <string.h>
+#include "assert.h"
+#include "ilist.h"
+
+#define ARENA_SIZE 100
+
+typedef struct {
+  int data;
+  ilist_node_t list_data;
+} mynode_t;
+
+DEFINE_ILIST(mynode_t, list_data)
+
+mynode_t arena[ARENA_SIZE];
+mynode_t moved_arena[ARENA_SIZE];
+ilist_mynode_t list;
+ilist_mynode_t odds;
+
+void* print_node(mynode_t *n, void *last, char* term) {
+  printf("%d ", n->data);
+  return 0;
+}
+
+void print_list(ilist_mynode_t *list) {
+  printf("flist = [");
+  ilist_mynode_t_foldl(list, print_node, 0);
+  printf("]\n");
+  printf("blist = [");
+  ilist_mynode_t_foldr(list, print_node, 0);
+  printf("]\n");
+}
+
+// Asserts "list" holds exactly "expect", in order, and is well formed
+void expect_list(ilist_mynode_t *list, const int *expect, int len) {
+  mynode_t *n;
+  int i = 0;
+  ilist_mynode_t_check(list);
+  ILIST_FOREACH(mynode_t, list, n) {
+    assert(i < len);
+    assert(n->data == expect[i]);
+    i++;
+  }
+  assert(i == len);
+  ILIST_FOREACH_REVERSE(mynode_t, list, n) {
+    i--;
+    assert(n->data == expect[i]);
+  }
+  assert(i == 0);
+  assert(ilist_mynode_t_empty(list) == (len == 0));
+}
+
+int main(unsigned int argc, char **argv) {
+  mynode_t *n;
+  mynode_t *tmp;
+  int x;
+
+  assert(sizeof(ilist_node_t) == 8);
+  for (x = 0; x < ARENA_SIZE; x++)
+    arena[x].data = x;
+
+  printf("initializing list\n");
+  ilist_mynode_t_init(&list, arena);
+  expect_list(&list, NULL, 0);
+  assert(!ilist_mynode_t_head(&list));
+  assert(!ilist_mynode_t_tail(&list));
+  assert(!ilist_mynode_t_pop(&list));
+  assert(!ilist_mynode_t_dequeue(&list));
+
+  printf("test base cases\n");
+  n = &arena[1];
+  ilist_mynode_t_pushback(&list, n);
+  {
+    const int expect[] = {1};
+    expect_list(&list, expect, 1);
+  }
+  ilist_mynode_t_remove(&list, n);
+  expect_list(&list, NULL, 0);
+  ilist_mynode_t_enqueue(&list, n);
+  assert(ilist_mynode_t_pop(&list) == n);
+  ilist_mynode_t_push(&list, n);
+  assert(ilist_mynode_t_dequeue(&list) == n);
+  expect_list(&list, NULL, 0);
+  ilist_mynode_t_destroy(&list);
+  ilist_mynode_t_init(&list, arena);
+
+  printf("inserting elements\n");
+  for (x = 0; x < 10; x++)
+    ilist_mynode_t_enqueue(&list, &arena[x]);
+  for (x = 10; x < 20; x++)
+    ilist_mynode_t_pushback(&list, &arena[x]);
+  print_list(&list);
+  {
+    const int expect[] = {9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                          10, 11, 12, 13, 14, 15, 16, 17, 18, 19};
+    expect_list(&list, expect, 20);
+  }
+  assert(ilist_mynode_t_index(&list, &arena[7]) == 7);
+  assert(ilist_mynode_t_node(&list, 7) == &arena[7]);
+  assert(!ilist_mynode_t_node(&list, ILIST_NIL));
+
+  printf("pop and dequeue\n");
+  assert(ilist_mynode_t_pop(&list)->data == 9);
+  assert(ilist_mynode_t_dequeue(&list)->data == 19);
+  printf("remove head, tail and middle\n");
+  ilist_mynode_t_remove(&list, &arena[8]);
+  ilist_mynode_t_remove(&list, &arena[18]);
+  ilist_mynode_t_remove(&list, &arena[5]);
+  {
+    const int expect[] = {7, 6, 4, 3, 2, 1, 0,
+                          10, 11, 12, 13, 14, 15, 16, 17};
+    expect_list(&list, expect, 15);
+  }
+
+  printf("foreach_safe move odds to a second list\n");
+  ilist_mynode_t_init(&odds, arena);
+  ILIST_FOREACH_SAFE(mynode_t, &list, n, tmp) {
+    if (n->data % 2) {
+      ilist_mynode_t_remove(&list, n);
+      ilist_mynode_t_pushback(&odds, n);
+    }
+  }
+  {
+    const int expect[] = {6, 4, 2, 0, 10, 12, 14, 16};
+    expect_list(&list, expect, 8);
+  }
+  {
+    const int expect[] = {7, 3, 1, 11, 13, 15, 17};
+    expect_list(&odds, expect, 7);
+  }
+
+  printf("relocate the arena\n");
+  memcpy(moved_arena, arena, sizeof(arena));
+  memset(arena, 0, sizeof(arena));
+  ilist_mynode_t_rebase(&list, moved_arena);
+  ilist_mynode_t_rebase(&odds, moved_arena);
+  {
+    const int expect[] = {6, 4, 2, 0, 10, 12, 14, 16};
+    expect_list(&list, expect, 8);
+  }
+  {
+    const int expect[] = {7, 3, 1, 11, 13, 15, 17};
+    expect_list(&odds, expect, 7);
+  }
+  assert(ilist_mynode_t_head(&list) == &moved_arena[6]);
+
+  printf("empty the lists\n");
+  while ((n = ilist_mynode_t_pop(&list))) {
+    assert(n >= moved_arena && n < moved_arena + ARENA_SIZE);
+  }
+  while (ilist_mynode_t_dequeue(&odds)) {
+  }
+  expect_list(&list, NULL, 0);
+  expect_list(&odds, NULL, 0);
+  ilist_mynode_t_destroy(&list);
+  ilist_mynode_t_destroy(&odds);
+
+  printf("PASSED!\n");
+}
@@ -0,0 +1,245 @@
+// Intrusive LRU cache, a dlist.h list for recency plus a hash index
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) declare a "node" type, with a key field, and both a "dlist_node_t"
+//      and a "lru_hnode_t" as members
+//   3) call "DEFINE_LRU" with their node-type, the key's type and field
+//      name, the two member names, a hash function and an equality function
+//   4) allocate a "lru_##type" and an array of "lru_hnode_t *" buckets (a
+//      power of two long), and call lru_##type##_init() with them and the
+//      capacity
+//   5) The user must allocate all nodes before passing them in, and frees
+//      them once they come back out (from evict, insert, or remove)
+//   6) When done with the cache, empty it (evict until NULL), then call
+//      "lru_##type##_destroy". The buckets may then be reused.
+//
+//   See lru_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired. Note that find moves the node it
+//   finds, so even lookups need an exclusive lock.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   A key may only be in the cache once, find it before inserting.
+//   Inserting past the capacity evicts the least recently used node, and
+//   hands it back to the caller, who owns it again.
+//   The bucket array is fixed, so lookups slow down if the capacity is much
+//   bigger than the number of buckets. One bucket per entry is plenty.
+//
+// Design Decisions:
+//   * Recency is a plain dlist_t: the most recent node is at the head, a hit
+//     is dlist_remove + dlist_enqueue, and eviction is dlist_dequeue.
+//   * The index is chained through a singly-linked "lru_hnode_t" in each
+//     node, so a bucket is one pointer. Unlinking walks the bucket, which
+//     holds about one node.
+//   * The hnode keeps its full hash, so chains are compared on the hash
+//     before calling the (possibly expensive) equality function.
+//   * Hash and equality are called directly by the generated code, so the
+//     compiler can inline them.
+
+#include <assert.h>
+#include <stddef.h>
+#include "dlist.h"
+#include "offset.h"
+#include "panic.h"
+
+#ifndef LRU_H
+#define LRU_H
+
+// ******************* typedefs ****************
+
+// User should include this as a field in their node struct, alongside a
+// dlist_node_t
+typedef struct lru_hnode_struct {
+  struct lru_hnode_struct *next;
+  size_t hash;
+} lru_hnode_t;
+
+// The backend cache, the typed cache wraps this
+typedef struct {
+  dlist_t order;
+  lru_hnode_t **buckets;
+  size_t mask;
+  size_t size;
+  size_t capacity;
+} lru_t;
+
+// Defines the typed cache.
+//   keytype  - the type of the key field, passed by value
+//   key      - the name of the key field in "type"
+//   listname - the name of the dlist_node_t member
+//   hashname - the name of the lru_hnode_t member
+//   hashfn   - a function or macro taking a keytype, returning a size_t
+//   eqfn     - a function or macro taking two keytypes, non-zero if equal
+// find looks a key up and marks the node most recently used, peek looks it
+// up without changing the order. insert adds a node as the most recently
+// used, and if that takes the cache over capacity evicts and returns the
+// least recently used node (else NULL). evict removes and returns the least
+// recently used node, NULL if empty.
+#define DEFINE_LRU(type, keytype, key, listname, hashname, hashfn, eqfn)  \
+  typedef struct {  \
+    lru_t lru;  \
+  } lru_##type;  \
+  void lru_##type##_init(lru_##type *root, lru_hnode_t **buckets,  \
+                         size_t nbuckets, size_t capacity) {  \
+    lru_init(&root->lru, buckets, nbuckets, capacity);  \
+  }  \
+  void lru_##type##_destroy(lru_##type *root) {  \
+    lru_destroy(&root->lru);  \
+  }  \
+  void lru_##type##_check(const lru_##type *root) {  \
+    lru_check(&root->lru, OFFSET(type, hashname) - OFFSET(type, listname));  \
+  }  \
+  size_t lru_##type##_size(const lru_##type *root) {  \
+    return root->lru.size;  \
+  }  \
+  type * lru_##type##_peek(const lru_##type *root, keytype k) {  \
+    size_t hash = hashfn(k);  \
+    lru_hnode_t *ptr;  \
+    for (ptr = *lru_bucket(&root->lru, hash); ptr; ptr = ptr->next) {  \
+      if (ptr->hash == hash &&  \
+          eqfn(GET_CONTAINER(ptr, type, hashname)->key, k))  \
+        return GET_CONTAINER(ptr, type, hashname);  \
+    }  \
+    return NULL;  \
+  }  \
+  void lru_##type##_touch(lru_##type *root, type *data) {  \
+    lru_touch(&root->lru, &(data->listname));  \
+  }  \
+  type * lru_##type##_find(lru_##type *root, keytype k) {  \
+    type *data = lru_##type##_peek(root, k);  \
+    if (data)  \
+      lru_##type##_touch(root, data);  \
+    return data;  \
+  }  \
+  void lru_##type##_remove(lru_##type *root, type *data) {  \
+    lru_remove(&root->lru, &(data->listname), &(data->hashname));  \
+  }  \
+  type * lru_##type##_evict(lru_##type *root) {  \
+    dlist_node_t *ptr = root->lru.order.tail;  \
+    if (!ptr)  \
+      return NULL;  \
+    type *data = GET_CONTAINER(ptr, type, listname);  \
+    lru_##type##_remove(root, data);  \
+    return data;  \
+  }  \
+  type * lru_##type##_insert(lru_##type *root, type *data) {  \
+    assert(!lru_##type##_peek(root, data->key));  \
+    lru_insert(&root->lru, &(data->listname), &(data->hashname),  \
+               hashfn(data->key));  \
+    if (root->lru.size > root->lru.capacity)  \
+      return lru_##type##_evict(root);  \
+    return NULL;  \
+  }  \
+  type * lru_##type##_first(const lru_##type *root) {  \
+    dlist_node_t *ptr = root->lru.order.head;  \
+    return ptr ? GET_CONTAINER(ptr, type, listname) : NULL;  \
+  }  \
+  type * lru_##type##_next(const type *data) {  \
+    dlist_node_t *ptr = data->listname.next;  \
+    return ptr ? GET_CONTAINER(ptr, type, listname) : NULL;  \
+  }
+
+// Inline iteration from most to least recently used, as DLIST_FOREACH.
+//   var - a "type *", set to each node in turn
+// The body must not insert, remove, find or touch.
+#define LRU_FOREACH(type, root, var)  \
+  for ((var) = lru_##type##_first(root);  \
+       (var);  \
+       (var) = lru_##type##_next(var))
+
+
+// ******************* private functions ****************
+
+// "nbuckets" must be a power of two
+void lru_init(lru_t *root, lru_hnode_t **buckets, size_t nbuckets,
+              size_t capacity) {
+  size_t i;
+  assert(nbuckets && !(nbuckets & (nbuckets - 1)));
+  assert(capacity);
+  dlist_init(&root->order);
+  root->buckets = buckets;
+  root->mask = nbuckets - 1;
+  root->size = 0;
+  root->capacity = capacity;
+  for (i = 0; i < nbuckets; i++)
+    buckets[i] = NULL;
+}
+
+void lru_destroy(lru_t *root) {
+  if (root->size) {
+    PANIC("lru_destroy: cache is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->order.head = (dlist_node_t*) 0xdeadbeef;
+  root->order.tail = (dlist_node_t*) 0xdeadbeef;
+  root->buckets = (lru_hnode_t**) 0xdeadbeef;
+}
+
+lru_hnode_t ** lru_bucket(const lru_t *root, size_t hash) {
+  return &root->buckets[hash & root->mask];
+}
+
+void lru_touch(lru_t *root, dlist_node_t *data) {
+  if (root->order.head == data)
+    return;
+  dlist_remove(&root->order, data);
+  dlist_enqueue(&root->order, data);
+}
+
+void lru_insert(lru_t *root, dlist_node_t *data, lru_hnode_t *hdata,
+                size_t hash) {
+  lru_hnode_t **bucket = lru_bucket(root, hash);
+  hdata->hash = hash;
+  hdata->next = *bucket;
+  *bucket = hdata;
+  dlist_enqueue(&root->order, data);
+  root->size++;
+}
+
+void lru_remove(lru_t *root, dlist_node_t *data, lru_hnode_t *hdata) {
+  lru_hnode_t **link = lru_bucket(root, hdata->hash);
+  while (*link != hdata) {
+    assert(*link);
+    link = &(*link)->next;
+  }
+  *link = hdata->next;
+  dlist_remove(&root->order, data);
+  root->size--;
+}
+
+// "hoff" is the offset from a node's dlist_node_t to its lru_hnode_t.
+// Checks the list, and that every node on it is in the right bucket, and
+// that the buckets hold nothing else.
+void lru_check(const lru_t *root, ptrdiff_t hoff) {
+  dlist_node_t *ptr;
+  lru_hnode_t *hptr;
+  size_t size = 0;
+  size_t hsize = 0;
+  size_t i;
+  dlist_check(&root->order);
+  for (ptr = root->order.head; ptr; ptr = ptr->next) {
+    lru_hnode_t *hdata = (lru_hnode_t*) ((char*) ptr + hoff);
+    for (hptr = *lru_bucket(root, hdata->hash); hptr != hdata;
+         hptr = hptr->next)
+      assert(hptr);
+    size++;
+  }
+  for (i = 0; i <= root->mask; i++) {
+    for (hptr = root->buckets[i]; hptr; hptr = hptr->next) {
+      assert((hptr->hash & root->mask) == i);
+      hsize++;
+    }
+  }
+  assert(size == root->size);
+  assert(hsize == root->size);
+  assert(root->size <= root->capacity);
+}
+
+#endif
@@ -0,0 +1,145 @@
+// Benchmark for lru (intrusive LRU cache)
+//
+// Usage:
+//   gcc -O2 -o lru_bench lru_bench.c -lm
+//   ./lru_bench [ops]
+// "ops" defaults to 10000000. Each op looks up a key drawn from KEYS keys,
+// and on a miss inserts it, reusing the evicted node. Keys are drawn
+// uniformly, and from a Zipf distribution (s = 0.99, as in YCSB), with the
+// cache holding 1%, 10% and 50% of the keys.
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "lru.h"
+
+#define RUNS 5
+#define KEYS 1000000
+
+typedef struct {
+  int key;
+  int data;
+  dlist_node_t list_data;
+  lru_hnode_t hash_data;
+} mynode_t;
+
+// Fibonacci hashing, spreads sequential keys over the buckets
+#define int_hash(k) ((size_t) (unsigned) (k) * 0x9E3779B97F4A7C15ull >> 16)
+#define int_eq(a, b) ((a) == (b))
+
+DEFINE_LRU(mynode_t, int, key, list_data, hash_data, int_hash, int_eq)
+
+lru_mynode_t cache;
+
+// Fills "keys" with draws from 0..KEYS-1, uniform if "zipf" is 0. The
+// rank-to-key mapping is shuffled, so hot keys aren't neighbours.
+void make_keys(int *keys, size_t ops, int zipf) {
+  uint64_t seed = 1;
+  size_t i;
+  if (!zipf) {
+    for (i = 0; i < ops; i++)
+      keys[i] = bench_rand(&seed) % KEYS;
+    return;
+  }
+  double *cdf = malloc(KEYS * sizeof(double));
+  int *perm = malloc(KEYS * sizeof(int));
+  double total = 0;
+  for (i = 0; i < KEYS; i++) {
+    total += 1.0 / pow(i + 1, 0.99);
+    cdf[i] = total;
+    perm[i] = i;
+  }
+  for (i = KEYS; i > 1; i--) {
+    size_t j = bench_rand(&seed) % i;
+    int tmp = perm[i - 1];
+    perm[i - 1] = perm[j];
+    perm[j] = tmp;
+  }
+  for (i = 0; i < ops; i++) {
+    double u = (bench_rand(&seed) >> 11) * 0x1p-53 * total;
+    size_t lo = 0;
+    size_t hi = KEYS - 1;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (cdf[mid] < u)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    keys[i] = perm[lo];
+  }
+  free(perm);
+  free(cdf);
+}
+
+// Runs "ops" lookups against a cache of "capacity", returns the best time
+// and sets "hits"
+double run_cache(const int *keys, size_t ops, size_t capacity,
+                 size_t *hits) {
+  size_t nbuckets = 1;
+  lru_hnode_t **buckets;
+  mynode_t *nodes = malloc((capacity + 1) * sizeof(mynode_t));
+  double best = 1e9;
+  int run;
+
+  while (nbuckets < capacity)
+    nbuckets *= 2;
+  buckets = malloc(nbuckets * sizeof(lru_hnode_t*));
+  for (run = 0; run < RUNS; run++) {
+    // Nodes are handed out from "nodes" until the cache is full, after
+    // that each insert evicts one, which is used for the next miss
+    mynode_t *spare = NULL;
+    size_t used = 0;
+    size_t i;
+    double start;
+    lru_mynode_t_init(&cache, buckets, nbuckets, capacity);
+    *hits = 0;
+    start = bench_now();
+    for (i = 0; i < ops; i++) {
+      mynode_t *n = lru_mynode_t_find(&cache, keys[i]);
+      if (n) {
+        (*hits)++;
+        continue;
+      }
+      n = spare ? spare : &nodes[used++];
+      n->key = keys[i];
+      n->data = keys[i];
+      spare = lru_mynode_t_insert(&cache, n);
+    }
+    start = bench_now() - start;
+    if (start < best)
+      best = start;
+    lru_mynode_t_check(&cache);
+    while (lru_mynode_t_evict(&cache))
+      ;
+    lru_mynode_t_destroy(&cache);
+  }
+  free(buckets);
+  free(nodes);
+  return best;
+}
+
+int main(int argc, char **argv) {
+  size_t ops = bench_arg(argc, argv, 1, 10000000);
+  int *keys = malloc(ops * sizeof(int));
+  size_t percents[3] = {1, 10, 50};
+  int zipf;
+  int x;
+
+  printf("%zu lookups over %d keys\n", ops, KEYS);
+  for (zipf = 0; zipf < 2; zipf++) {
+    make_keys(keys, ops, zipf);
+    for (x = 0; x < 3; x++) {
+      size_t capacity = KEYS / 100 * percents[x];
+      size_t hits;
+      double t = run_cache(keys, ops, capacity, &hits);
+      printf("  %-7s capacity %7zu (%2zu%%)  hit rate %5.1f%%  %6.2f ns/op\n",
+             zipf ? "zipf" : "uniform", capacity, percents[x],
+             100.0 * hits / ops, t * 1e9 / ops);
+    }
+  }
+  free(keys);
+  return 0;
+}
@@ -0,0 +1,143 @@
+// Unittest for lru (intrusive LRU cache)
+
+
+#include <stdio.h>
+#include "assert.h"
+#include "lru.h"
+
+#define CAPACITY 8
+#define NBUCKETS 8
+#define KEYS 32
+
+typedef struct {
+  int key;
+  int data;
+  dlist_node_t list_data;
+  lru_hnode_t hash_data;
+} mynode_t;
+
+// A poor hash, so buckets collide and chains get exercised
+#define int_hash(k) ((size_t) (k) / 3)
+#define int_eq(a, b) ((a) == (b))
+
+DEFINE_LRU(mynode_t, int, key, list_data, hash_data, int_hash, int_eq)
+
+lru_hnode_t *buckets[NBUCKETS];
+lru_mynode_t cache;
+
+mynode_t * new_node(int key) {
+  mynode_t *n = malloc(sizeof(mynode_t));
+  n->key = key;
+  n->data = key * 10;
+  return n;
+}
+
+// Asserts the cache holds exactly "expect", most recent first
+void expect_cache(lru_mynode_t *cache, const int *expect, size_t len) {
+  mynode_t *n;
+  size_t i = 0;
+  lru_mynode_t_check(cache);
+  LRU_FOREACH(mynode_t, cache, n) {
+    assert(i < len);
+    assert(n->key == expect[i]);
+    assert(n->data == expect[i] * 10);
+    i++;
+  }
+  assert(i == len);
+  assert(lru_mynode_t_size(cache) == len);
+}
+
+int main(unsigned int argc, char **argv) {
+  mynode_t *n;
+  int x;
+
+  printf("initializing cache\n");
+  lru_mynode_t_init(&cache, buckets, NBUCKETS, CAPACITY);
+  expect_cache(&cache, NULL, 0);
+  assert(!lru_mynode_t_find(&cache, 1));
+  assert(!lru_mynode_t_evict(&cache));
+
+  printf("fill to capacity\n");
+  for (x = 0; x < CAPACITY; x++)
+    assert(!lru_mynode_t_insert(&cache, new_node(x)));
+  {
+    const int expect[] = {7, 6, 5, 4, 3, 2, 1, 0};
+    expect_cache(&cache, expect, 8);
+  }
+
+  printf("find moves to front, peek doesn't\n");
+  n = lru_mynode_t_find(&cache, 2);
+  assert(n && n->key == 2);
+  n = lru_mynode_t_find(&cache, 0);
+  assert(n && n->key == 0);
+  n = lru_mynode_t_peek(&cache, 5);
+  assert(n && n->key == 5);
+  assert(!lru_mynode_t_find(&cache, 100));
+  {
+    const int expect[] = {0, 2, 7, 6, 5, 4, 3, 1};
+    expect_cache(&cache, expect, 8);
+  }
+
+  printf("insert evicts the least recently used\n");
+  n = lru_mynode_t_insert(&cache, new_node(8));
+  assert(n && n->key == 1);
+  free(n);
+  n = lru_mynode_t_insert(&cache, new_node(9));
+  assert(n && n->key == 3);
+  free(n);
+  assert(!lru_mynode_t_peek(&cache, 1));
+  assert(!lru_mynode_t_peek(&cache, 3));
+  {
+    const int expect[] = {9, 8, 0, 2, 7, 6, 5, 4};
+    expect_cache(&cache, expect, 8);
+  }
+
+  printf("remove\n");
+  n = lru_mynode_t_peek(&cache, 7);
+  lru_mynode_t_remove(&cache, n);
+  free(n);
+  n = lru_mynode_t_peek(&cache, 9);
+  lru_mynode_t_remove(&cache, n);
+  free(n);
+  n = lru_mynode_t_peek(&cache, 4);
+  lru_mynode_t_remove(&cache, n);
+  free(n);
+  {
+    const int expect[] = {8, 0, 2, 6, 5};
+    expect_cache(&cache, expect, 5);
+  }
+
+  printf("random churn\n");
+  srand(1);
+  for (x = 0; x < 10000; x++) {
+    int key = rand() % KEYS;
+    n = lru_mynode_t_find(&cache, key);
+    if (n) {
+      assert(n->key == key);
+      assert(lru_mynode_t_first(&cache) == n);
+      if (rand() % 4 == 0) {
+        lru_mynode_t_remove(&cache, n);
+        free(n);
+      }
+    } else {
+      n = lru_mynode_t_insert(&cache, new_node(key));
+      if (n) {
+        assert(n->key != key);
+        assert(!lru_mynode_t_peek(&cache, n->key));
+        free(n);
+      }
+      assert(lru_mynode_t_first(&cache)->key == key);
+    }
+    if (x % 17 == 0)
+      lru_mynode_t_check(&cache);
+  }
+  lru_mynode_t_check(&cache);
+
+  printf("evict everything\n");
+  while ((n = lru_mynode_t_evict(&cache)))
+    free(n);
+  expect_cache(&cache, NULL, 0);
+  lru_mynode_t_destroy(&cache);
+
+  printf("PASSED!\n");
+}
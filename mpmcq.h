@@ -0,0 +1,177 @@
+// Bounded lock-free multi-producer multi-consumer queue of pointers
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) call "DEFINE_MPMCQ" with the type they want to queue pointers to
+//   3) allocate a "mpmcq_t", and an array of "mpmcq_cell_t" whose length is
+//      a power of two, and call mpmcq_init() with them
+//   4) When done with the queue user must call "mpmcq_destroy" on it, after
+//      which they may free the cells
+//
+//   See mpmcq_unittest.c for example usage.
+//
+// Threadsafety:
+//   Any number of threads may push and pop concurrently.
+//   No locks are taken. Push and pop are lock-free, a thread that is
+//   descheduled mid-operation can delay (but never corrupt) operations on the
+//   same cell a full lap of the ring later.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   Requires C11 atomics.
+//   The queue is bounded, push returns 0 when it's full, and pop returns NULL
+//   when it's empty. Either can also fail spuriously while another thread is
+//   descheduled mid-operation on the cell they need, e.g. push fails with
+//   room to spare if a pop a lap behind hasn't finished, so callers should
+//   retry (or yield) rather than treat failure as final.
+//   Unlike dlist.h this is not intrusive, it stores pointers to the user's
+//   structs, so nothing needs to be embedded in them and an item may be in
+//   several queues at once.
+//
+// Design Decisions:
+//   * This is Dmitry Vyukov's bounded MPMC queue. Each cell carries a
+//     sequence number saying whose turn it is: a producer at position "pos"
+//     owns the cell when seq == pos, a consumer when seq == pos + 1. A thread
+//     claims a position with one CAS on the shared counter, then touches only
+//     its own cell.
+//   * The producer and consumer counters each sit on their own cache line
+//     (MPMCQ_CACHELINE), so producers and consumers don't false-share.
+//   * Capacity is a power of two so a position maps to a cell with a mask.
+//   * As with dlist.h, macros write a typesafe interface over shared backend
+//     functions.
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "panic.h"
+
+#ifndef MPMCQ_H
+#define MPMCQ_H
+
+#ifndef MPMCQ_CACHELINE
+#define MPMCQ_CACHELINE 64
+#endif
+
+// ******************* typedefs ****************
+
+// User should allocate an array of these as the queue's storage
+typedef struct {
+  _Atomic size_t seq;
+  void *data;
+} mpmcq_cell_t;
+
+// User should use this type to store the queue
+typedef struct {
+  _Alignas(MPMCQ_CACHELINE) mpmcq_cell_t *cells;
+  size_t mask;
+  _Alignas(MPMCQ_CACHELINE) _Atomic size_t enqueue_pos;
+  _Alignas(MPMCQ_CACHELINE) _Atomic size_t dequeue_pos;
+  char pad[MPMCQ_CACHELINE - sizeof(size_t)];
+} mpmcq_t;
+
+#define DEFINE_MPMCQ(type)  \
+  typedef struct {  \
+    mpmcq_t queue;  \
+  } mpmcq_##type;  \
+  void mpmcq_##type##_init(mpmcq_##type *root, mpmcq_cell_t *cells,  \
+                           size_t capacity) {  \
+    mpmcq_init(&root->queue, cells, capacity);  \
+  }  \
+  void mpmcq_##type##_destroy(mpmcq_##type *root) {  \
+    mpmcq_destroy(&root->queue);  \
+  }  \
+  size_t mpmcq_##type##_capacity(const mpmcq_##type *root) {  \
+    return mpmcq_capacity(&root->queue);  \
+  }  \
+  int mpmcq_##type##_push(mpmcq_##type *root, type *data) {  \
+    return mpmcq_push(&root->queue, data);  \
+  }  \
+  type * mpmcq_##type##_pop(mpmcq_##type *root) {  \
+    return (type*) mpmcq_pop(&root->queue);  \
+  }
+
+
+// ******************* private functions ****************
+
+// "capacity" is the length of "cells", and must be a power of two (>= 2)
+void mpmcq_init(mpmcq_t *root, mpmcq_cell_t *cells, size_t capacity) {
+  size_t i;
+  assert(capacity >= 2);
+  assert((capacity & (capacity - 1)) == 0);
+  root->cells = cells;
+  root->mask = capacity - 1;
+  for (i = 0; i < capacity; i++)
+    atomic_init(&cells[i].seq, i);
+  atomic_init(&root->enqueue_pos, 0);
+  atomic_init(&root->dequeue_pos, 0);
+}
+
+size_t mpmcq_capacity(const mpmcq_t *root) {
+  return root->mask + 1;
+}
+
+// Must not race with any push or pop
+void mpmcq_destroy(mpmcq_t *root) {
+  if (atomic_load(&root->enqueue_pos) != atomic_load(&root->dequeue_pos)) {
+    PANIC("mpmcq_destroy: queue is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->cells = (mpmcq_cell_t*) 0xdeadbeef;
+}
+
+// Returns 1 on success, 0 if the queue is full
+int mpmcq_push(mpmcq_t *root, void *data) {
+  mpmcq_cell_t *cell;
+  size_t pos = atomic_load_explicit(&root->enqueue_pos, memory_order_relaxed);
+  for (;;) {
+    cell = &root->cells[pos & root->mask];
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+    if (dif == 0) {
+      // Our turn, if nobody beats us to this position
+      if (atomic_compare_exchange_weak_explicit(&root->enqueue_pos, &pos,
+                                                pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed))
+        break;
+    } else if (dif < 0) {
+      // The cell still holds an item from the last lap, we're full
+      return 0;
+    } else {
+      // Someone else took this position, catch up
+      pos = atomic_load_explicit(&root->enqueue_pos, memory_order_relaxed);
+    }
+  }
+  cell->data = data;
+  atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+  return 1;
+}
+
+// Returns NULL if the queue is empty
+void * mpmcq_pop(mpmcq_t *root) {
+  mpmcq_cell_t *cell;
+  size_t pos = atomic_load_explicit(&root->dequeue_pos, memory_order_relaxed);
+  for (;;) {
+    cell = &root->cells[pos & root->mask];
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    intptr_t dif = (intptr_t) seq - (intptr_t) (pos + 1);
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&root->dequeue_pos, &pos,
+                                                pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed))
+        break;
+    } else if (dif < 0) {
+      // Nothing has been pushed here yet, we're empty
+      return NULL;
+    } else {
+      pos = atomic_load_explicit(&root->dequeue_pos, memory_order_relaxed);
+    }
+  }
+  void *data = cell->data;
+  // Hand the cell to the producer one lap ahead
+  atomic_store_explicit(&cell->seq, pos + root->mask + 1, memory_order_release);
+  return data;
+}
+
+#endif
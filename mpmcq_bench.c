@@ -0,0 +1,129 @@
+// Benchmark for mpmcq (bounded multi-producer multi-consumer queue)
+//
+// Usage:
+//   gcc -O2 -o mpmcq_bench mpmcq_bench.c -lpthread
+//   ./mpmcq_bench [ops]
+// "ops" defaults to 4000000, it's the total number of push+pop pairs per
+// run, split between the threads. Compares mpmcq with a dlist behind a
+// mutex, at 1, 2, 4, 8 and 16 threads.
+
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "dlist.h"
+#include "mpmcq.h"
+
+#define RUNS 5
+#define CAPACITY 1024
+#define MAX_THREADS 16
+
+typedef struct {
+  dlist_node_t list_data;
+  long data;
+} mynode_t;
+
+DEFINE_MPMCQ(mynode_t)
+DEFINE_DLIST(mynode_t, list_data)
+
+mpmcq_mynode_t queue;
+mpmcq_cell_t cells[CAPACITY];
+dlist_mynode_t list;
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+atomic_int go;
+
+mynode_t nodes[MAX_THREADS];
+size_t per_thread;
+int locked;
+
+// Each thread starts holding one node, and hands it on: it pushes what it
+// holds, then pops whatever's next, which may be another thread's
+void* worker(void *arg) {
+  mynode_t *held = &nodes[(long) arg];
+  size_t i;
+  while (!atomic_load(&go))
+    ;
+  for (i = 0; i < per_thread; i++) {
+    if (locked) {
+      pthread_mutex_lock(&lock);
+      dlist_mynode_t_pushback(&list, held);
+      held = dlist_mynode_t_first(&list);
+      dlist_mynode_t_remove(&list, held);
+      pthread_mutex_unlock(&lock);
+    } else {
+      // There's room for every node, but push still fails while a thread
+      // descheduled mid-pop holds the cell a lap ahead, see mpmcq.h
+      while (!mpmcq_mynode_t_push(&queue, held))
+        sched_yield();
+      // Another thread may be part way through with the only node left
+      while (!(held = mpmcq_mynode_t_pop(&queue)))
+        sched_yield();
+    }
+  }
+  // Park it back in the queue, so every node is accounted for
+  if (locked) {
+    pthread_mutex_lock(&lock);
+    dlist_mynode_t_pushback(&list, held);
+    pthread_mutex_unlock(&lock);
+  } else {
+    while (!mpmcq_mynode_t_push(&queue, held))
+      sched_yield();
+  }
+  return NULL;
+}
+
+double pump(int threads) {
+  pthread_t ids[MAX_THREADS];
+  double start;
+  int x;
+  atomic_store(&go, 0);
+  for (x = 0; x < threads; x++)
+    pthread_create(&ids[x], NULL, worker, (void*) (long) x);
+  start = bench_now();
+  atomic_store(&go, 1);
+  for (x = 0; x < threads; x++)
+    pthread_join(ids[x], NULL);
+  start = bench_now() - start;
+  // Empty whichever container the nodes ended up in
+  for (x = 0; x < threads; x++) {
+    if (locked) {
+      if (!dlist_mynode_t_first(&list))
+        abort();
+      dlist_mynode_t_remove(&list, dlist_mynode_t_first(&list));
+    } else if (!mpmcq_mynode_t_pop(&queue)) {
+      abort();
+    }
+  }
+  return start;
+}
+
+int main(int argc, char **argv) {
+  size_t count = bench_arg(argc, argv, 1, 4000000);
+  int threads;
+
+  mpmcq_mynode_t_init(&queue, cells, CAPACITY);
+  dlist_mynode_t_init(&list);
+  printf("%zu push+pop pairs (million ops/sec)\n", count);
+  for (threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    double best[2] = {1e9, 1e9};
+    int run;
+    per_thread = count / threads;
+    for (run = 0; run < RUNS; run++) {
+      double t;
+      for (locked = 0; locked < 2; locked++) {
+        if ((t = pump(threads)) < best[locked])
+          best[locked] = t;
+      }
+    }
+    // A push and a pop are two ops
+    printf("  %2d threads  mpmcq %7.2f   mutex+dlist %7.2f\n", threads,
+           2 * per_thread * threads / best[0] * 1e-6,
+           2 * per_thread * threads / best[1] * 1e-6);
+  }
+  mpmcq_mynode_t_destroy(&queue);
+  dlist_mynode_t_destroy(&list);
+  return 0;
+}
@@ -0,0 +1,116 @@
+// Unittest for mpmcq (bounded multi-producer multi-consumer queue)
+
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include "assert.h"
+#include "mpmcq.h"
+
+#define CAPACITY 64
+#define THREADS 4
+#define PER_PRODUCER 50000
+
+typedef struct {
+  int producer;
+  int data;
+  _Atomic int seen;
+} mynode_t;
+
+DEFINE_MPMCQ(mynode_t)
+
+mpmcq_mynode_t queue;
+mpmcq_cell_t cells[CAPACITY];
+
+mynode_t nodes[THREADS][PER_PRODUCER];
+_Atomic long consumed;
+
+void* producer(void *arg) {
+  int p = (int) (long) arg;
+  int x;
+  for (x = 0; x < PER_PRODUCER; x++) {
+    nodes[p][x].producer = p;
+    nodes[p][x].data = x;
+    while (!mpmcq_mynode_t_push(&queue, &nodes[p][x]))
+      sched_yield();
+  }
+  return NULL;
+}
+
+// Each consumer checks that what it sees from any one producer is in order
+void* consumer(void *arg) {
+  int last[THREADS];
+  int x;
+  mynode_t *n;
+  for (x = 0; x < THREADS; x++)
+    last[x] = -1;
+  while (atomic_load(&consumed) < (long) THREADS * PER_PRODUCER) {
+    n = mpmcq_mynode_t_pop(&queue);
+    if (!n) {
+      sched_yield();
+      continue;
+    }
+    assert(n->data > last[n->producer]);
+    last[n->producer] = n->data;
+    assert(atomic_fetch_add(&n->seen, 1) == 0);
+    atomic_fetch_add(&consumed, 1);
+  }
+  return NULL;
+}
+
+int main(unsigned int argc, char **argv) {
+  mynode_t *n;
+  int x;
+  int y;
+
+  printf("initializing queue\n");
+  mpmcq_mynode_t_init(&queue, cells, CAPACITY);
+  assert(mpmcq_mynode_t_capacity(&queue) == CAPACITY);
+  assert(!mpmcq_mynode_t_pop(&queue));
+
+  printf("fill and drain, several laps\n");
+  for (y = 0; y < 3; y++) {
+    for (x = 0; x < CAPACITY; x++) {
+      nodes[0][x].data = x;
+      assert(mpmcq_mynode_t_push(&queue, &nodes[0][x]));
+    }
+    printf("full push fails\n");
+    assert(!mpmcq_mynode_t_push(&queue, &nodes[1][0]));
+    for (x = 0; x < CAPACITY; x++) {
+      n = mpmcq_mynode_t_pop(&queue);
+      assert(n == &nodes[0][x]);
+    }
+    assert(!mpmcq_mynode_t_pop(&queue));
+  }
+
+  printf("interleaved\n");
+  for (x = 0; x < CAPACITY * 4; x++) {
+    assert(mpmcq_mynode_t_push(&queue, &nodes[0][x]));
+    assert(mpmcq_mynode_t_push(&queue, &nodes[1][x]));
+    assert(mpmcq_mynode_t_pop(&queue) == &nodes[0][x]);
+    assert(mpmcq_mynode_t_pop(&queue) == &nodes[1][x]);
+  }
+  assert(!mpmcq_mynode_t_pop(&queue));
+
+  // Every node must come out exactly once
+  printf("%d producers, %d consumers, %d nodes each\n", THREADS, THREADS,
+         PER_PRODUCER);
+  pthread_t producers[THREADS];
+  pthread_t consumers[THREADS];
+  for (x = 0; x < THREADS; x++) {
+    pthread_create(&producers[x], NULL, producer, (void*) (long) x);
+    pthread_create(&consumers[x], NULL, consumer, NULL);
+  }
+  for (x = 0; x < THREADS; x++) {
+    pthread_join(producers[x], NULL);
+    pthread_join(consumers[x], NULL);
+  }
+  assert(atomic_load(&consumed) == (long) THREADS * PER_PRODUCER);
+  for (x = 0; x < THREADS; x++)
+    for (y = 0; y < PER_PRODUCER; y++)
+      assert(atomic_load(&nodes[x][y].seen) == 1);
+  assert(!mpmcq_mynode_t_pop(&queue));
+
+  mpmcq_mynode_t_destroy(&queue);
+  printf("PASSED!\n");
+}
@@ -0,0 +1,157 @@
+// Lock-free multi-producer single-consumer intrusive queue
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) declare a "node" type, with a "mpscq_node_t" as a member
+//   3) call "DEFINE_MPSCQ" with their node-type, and the member name
+//   4) The user must allocate a "mpscq_t", to store the queue, and call
+//      mpscq_init() on it.
+//   5) The user must allocate all nodes before passing them in
+//   6) When done with the queue user must call "mpscq_destroy" on it
+//
+//   See mpscq_unittest.c for example usage.
+//
+// Threadsafety:
+//   Any number of threads may call push concurrently.
+//   Only one thread at a time may call pop (or head/empty/destroy), this is
+//   not checked.
+//   Neither push nor pop ever blocks, or takes any lock. Push is wait-free,
+//   a single atomic exchange.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   Requires C11 atomics.
+//   The queue contains a stub node that the queue points back into, so a
+//   "mpscq_t" must not be copied or moved once it's initialized.
+//   pop() may return NULL while the queue is not empty: a producer that has
+//   done its exchange but not yet linked its node hides itself and everything
+//   pushed after it until it finishes (a few instructions). Consumers should
+//   treat NULL as "nothing available right now", not "empty forever".
+//
+// Design Decisions:
+//   * This is Dmitry Vyukov's intrusive MPSC queue. Producers swap themselves
+//     in as the new tail with one atomic exchange, then link the old tail to
+//     themselves. The consumer walks from the other end single-threaded.
+//   * A stub node lives in the queue head so the queue is never truly empty,
+//     this removes the empty-queue special cases from push entirely.
+//   * FIFO order, the first pushed is the first popped (per producer, and
+//     globally in exchange order).
+//   * As with dlist.h, macros write a typesafe interface over shared backend
+//     functions, and GET_CONTAINER recovers the user's struct.
+
+#include <assert.h>
+#include <stdatomic.h>
+#include "offset.h"
+#include "panic.h"
+
+#ifndef MPSCQ_H
+#define MPSCQ_H
+
+// ******************* typedefs ****************
+
+// User should include this as a field in their node struct
+typedef struct mpscq_node_struct {
+  struct mpscq_node_struct *_Atomic next;
+} mpscq_node_t;
+
+// User should use this type to store the queue
+typedef struct {
+  // Last node pushed, producers exchange themselves in here
+  mpscq_node_t *_Atomic head;
+  // Next node to pop, only touched by the consumer
+  mpscq_node_t *tail;
+  mpscq_node_t stub;
+} mpscq_t;
+
+#define DEFINE_MPSCQ(type, metaname)  \
+  typedef struct {  \
+    mpscq_t queue;  \
+  } mpscq_##type;  \
+  void mpscq_##type##_init(mpscq_##type *root) {  \
+    mpscq_init(&root->queue);  \
+  }  \
+  void mpscq_##type##_destroy(mpscq_##type *root) {  \
+    mpscq_destroy(&root->queue);  \
+  }  \
+  int mpscq_##type##_empty(mpscq_##type *root) {  \
+    return mpscq_empty(&root->queue);  \
+  }  \
+  void mpscq_##type##_push(mpscq_##type *root, type *data) {  \
+    mpscq_push(&root->queue, &(data->metaname));  \
+  }  \
+  type * mpscq_##type##_pop(mpscq_##type *root) {  \
+    mpscq_node_t *ptr = mpscq_pop(&root->queue);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }
+
+
+// ******************* private functions ****************
+
+void mpscq_init(mpscq_t *root) {
+  atomic_init(&root->stub.next, NULL);
+  atomic_init(&root->head, &root->stub);
+  root->tail = &root->stub;
+}
+
+// Consumer only. True if no node has been pushed that hasn't been popped.
+int mpscq_empty(mpscq_t *root) {
+  return root->tail == &root->stub &&
+         atomic_load_explicit(&root->stub.next, memory_order_acquire) == NULL &&
+         atomic_load_explicit(&root->head, memory_order_acquire) == &root->stub;
+}
+
+void mpscq_destroy(mpscq_t *root) {
+  if (!mpscq_empty(root)) {
+    PANIC("mpscq_destroy: queue is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->tail = (mpscq_node_t*) 0xdeadbeef;
+}
+
+// Any thread. Wait-free.
+void mpscq_push(mpscq_t *root, mpscq_node_t *data) {
+  atomic_store_explicit(&data->next, NULL, memory_order_relaxed);
+  mpscq_node_t *prev =
+      atomic_exchange_explicit(&root->head, data, memory_order_acq_rel);
+  // Between the exchange and this store the queue is briefly disconnected,
+  // the consumer sees that as the queue ending at "prev"
+  atomic_store_explicit(&prev->next, data, memory_order_release);
+}
+
+// Consumer only. Returns NULL if nothing is available.
+mpscq_node_t * mpscq_pop(mpscq_t *root) {
+  mpscq_node_t *tail = root->tail;
+  mpscq_node_t *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+  // Skip over the stub
+  if (tail == &root->stub) {
+    if (!next)
+      return NULL;
+    root->tail = next;
+    tail = next;
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  }
+
+  if (next) {
+    root->tail = next;
+    return tail;
+  }
+
+  // "tail" is the last linked node. If it's not the last pushed, a producer
+  // is mid-push, and we can't remove "tail" without losing its link.
+  mpscq_node_t *head = atomic_load_explicit(&root->head, memory_order_acquire);
+  if (tail != head)
+    return NULL;
+
+  // "tail" is the only node, put the stub back behind it so we can take it
+  mpscq_push(root, &root->stub);
+  next = atomic_load_explicit(&tail->next, memory_order_acquire);
+  if (next) {
+    root->tail = next;
+    return tail;
+  }
+  return NULL;
+}
+
+#endif
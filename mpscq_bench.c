@@ -0,0 +1,114 @@
+// Benchmark for mpscq (lock-free multi-producer single-consumer queue)
+//
+// Usage:
+//   gcc -O2 -o mpscq_bench mpscq_bench.c -lpthread
+//   ./mpscq_bench [nodes]
+// "nodes" defaults to 4000000, it's the total number pushed per run, split
+// between the producers. Compares mpscq with a dlist behind a mutex, which
+// is what the queue replaces, at 1, 2, 4, 8 and 16 producers.
+
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "dlist.h"
+#include "mpscq.h"
+
+#define RUNS 5
+
+typedef struct {
+  mpscq_node_t queue_data;
+  dlist_node_t list_data;
+} mynode_t;
+
+DEFINE_MPSCQ(mynode_t, queue_data)
+DEFINE_DLIST(mynode_t, list_data)
+
+mpscq_mynode_t queue;
+dlist_mynode_t list;
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+atomic_int go;
+
+mynode_t *nodes;
+size_t per_producer;
+int locked;
+
+void* producer(void *arg) {
+  mynode_t *mine = &nodes[(long) arg * per_producer];
+  size_t i;
+  while (!atomic_load(&go))
+    ;
+  for (i = 0; i < per_producer; i++) {
+    if (locked) {
+      pthread_mutex_lock(&lock);
+      dlist_mynode_t_pushback(&list, &mine[i]);
+      pthread_mutex_unlock(&lock);
+    } else {
+      mpscq_mynode_t_push(&queue, &mine[i]);
+    }
+  }
+  return NULL;
+}
+
+// The consumer is the calling thread, it pops until every node is through
+double pump(int producers) {
+  pthread_t threads[16];
+  size_t total = per_producer * producers;
+  size_t popped = 0;
+  double start;
+  int x;
+  atomic_store(&go, 0);
+  for (x = 0; x < producers; x++)
+    pthread_create(&threads[x], NULL, producer, (void*) (long) x);
+  start = bench_now();
+  atomic_store(&go, 1);
+  while (popped < total) {
+    mynode_t *n;
+    if (locked) {
+      pthread_mutex_lock(&lock);
+      n = dlist_mynode_t_first(&list);
+      if (n)
+        dlist_mynode_t_remove(&list, n);
+      pthread_mutex_unlock(&lock);
+    } else {
+      n = mpscq_mynode_t_pop(&queue);
+    }
+    if (n)
+      popped++;
+  }
+  start = bench_now() - start;
+  for (x = 0; x < producers; x++)
+    pthread_join(threads[x], NULL);
+  return start;
+}
+
+int main(int argc, char **argv) {
+  size_t count = bench_arg(argc, argv, 1, 4000000);
+  int producers;
+
+  nodes = malloc(count * sizeof(mynode_t));
+  mpscq_mynode_t_init(&queue);
+  dlist_mynode_t_init(&list);
+  printf("push %zu nodes through one consumer (million nodes/sec)\n", count);
+  for (producers = 1; producers <= 16; producers *= 2) {
+    double best[2] = {1e9, 1e9};
+    int run;
+    per_producer = count / producers;
+    for (run = 0; run < RUNS; run++) {
+      double t;
+      for (locked = 0; locked < 2; locked++) {
+        if ((t = pump(producers)) < best[locked])
+          best[locked] = t;
+      }
+    }
+    printf("  %2d producers  mpscq %7.2f   mutex+dlist %7.2f\n", producers,
+           per_producer * producers / best[0] * 1e-6,
+           per_producer * producers / best[1] * 1e-6);
+  }
+  mpscq_mynode_t_destroy(&queue);
+  dlist_mynode_t_destroy(&list);
+  free(nodes);
+  return 0;
+}
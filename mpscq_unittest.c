@@ -0,0 +1,105 @@
+// Unittest for mpscq (multi-producer single-consumer queue)
+
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include "assert.h"
+#include "mpscq.h"
+
+#define PRODUCERS 8
+#define PER_PRODUCER 50000
+
+typedef struct {
+  int producer;
+  int data;
+  mpscq_node_t queue_data;
+} mynode_t;
+
+DEFINE_MPSCQ(mynode_t, queue_data)
+
+mpscq_mynode_t queue;
+
+mynode_t nodes[PRODUCERS][PER_PRODUCER];
+
+void* producer(void *arg) {
+  int p = (int) (long) arg;
+  int x;
+  for (x = 0; x < PER_PRODUCER; x++) {
+    nodes[p][x].producer = p;
+    nodes[p][x].data = x;
+    mpscq_mynode_t_push(&queue, &nodes[p][x]);
+  }
+  return NULL;
+}
+
+int main(unsigned int argc, char **argv) {
+  mynode_t *n;
+  int x;
+
+  printf("initializing queue\n");
+  mpscq_mynode_t_init(&queue);
+  assert(mpscq_mynode_t_empty(&queue));
+  assert(!mpscq_mynode_t_pop(&queue));
+
+  printf("test base cases\n");
+  mpscq_mynode_t_push(&queue, &nodes[0][0]);
+  assert(!mpscq_mynode_t_empty(&queue));
+  n = mpscq_mynode_t_pop(&queue);
+  assert(n == &nodes[0][0]);
+  assert(mpscq_mynode_t_empty(&queue));
+  assert(!mpscq_mynode_t_pop(&queue));
+  // and again, now the stub has been recycled
+  mpscq_mynode_t_push(&queue, &nodes[0][1]);
+  n = mpscq_mynode_t_pop(&queue);
+  assert(n == &nodes[0][1]);
+  assert(!mpscq_mynode_t_pop(&queue));
+
+  printf("fifo order\n");
+  for (x = 0; x < 100; x++) {
+    nodes[0][x].data = x;
+    mpscq_mynode_t_push(&queue, &nodes[0][x]);
+  }
+  for (x = 0; x < 50; x++) {
+    n = mpscq_mynode_t_pop(&queue);
+    assert(n->data == x);
+  }
+  for (x = 100; x < 150; x++) {
+    nodes[0][x].data = x;
+    mpscq_mynode_t_push(&queue, &nodes[0][x]);
+  }
+  for (x = 50; x < 150; x++) {
+    n = mpscq_mynode_t_pop(&queue);
+    assert(n->data == x);
+  }
+  assert(!mpscq_mynode_t_pop(&queue));
+  assert(mpscq_mynode_t_empty(&queue));
+
+  // Every node must come out exactly once, and each producer's nodes must
+  // come out in the order it pushed them.
+  printf("%d producers, %d nodes each\n", PRODUCERS, PER_PRODUCER);
+  pthread_t threads[PRODUCERS];
+  int next[PRODUCERS] = {0};
+  long received = 0;
+  for (x = 0; x < PRODUCERS; x++)
+    pthread_create(&threads[x], NULL, producer, (void*) (long) x);
+  while (received < (long) PRODUCERS * PER_PRODUCER) {
+    n = mpscq_mynode_t_pop(&queue);
+    if (!n) {
+      sched_yield();
+      continue;
+    }
+    assert(n->data == next[n->producer]);
+    next[n->producer]++;
+    received++;
+  }
+  for (x = 0; x < PRODUCERS; x++) {
+    pthread_join(threads[x], NULL);
+    assert(next[x] == PER_PRODUCER);
+  }
+  assert(!mpscq_mynode_t_pop(&queue));
+  assert(mpscq_mynode_t_empty(&queue));
+
+  mpscq_mynode_t_destroy(&queue);
+  printf("PASSED!\n");
+}
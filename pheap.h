@@ -0,0 +1,264 @@
+// Generic intrusive pairing heap (meldable priority queue)
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) declare a "node" type, with a "pheap_node_t" as a member
+//   3) call "DEFINE_PHEAP" with their node-type, the member name, and a
+//      comparison function
+//   4) The user must allocate a "pheap_##type", to store the heap, and call
+//      pheap_##type##_init() on it.
+//   5) The user must allocate all nodes before passing them in
+//   6) When done with the heap user must call "pheap_##type##_destroy" on it
+//
+//   See pheap_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   It's a min-heap, pop returns the node "cmp" orders first. Reverse "cmp"
+//   for a max-heap.
+//   meld moves every node of one heap into another in O(1), leaving the
+//   source empty.
+//   To make a node in the heap order earlier, change its fields and call
+//   pheap_##type##_decrease(). For any other change call
+//   pheap_##type##_update().
+//   A node may be in a heap and a dlist at once, with a member for each.
+//
+// Design Decisions:
+//   * Push, meld, peek and decrease are O(1), pop and remove are O(log n)
+//     amortized. Unlike heap.h there's no array, so there's no capacity,
+//     and melding two heaps doesn't copy anything.
+//   * Each node points at its first child and next sibling, and "prev"
+//     points at its previous sibling, or its parent if it's a first child.
+//     That's enough to cut a node out in O(1) for decrease and remove.
+//   * Pop uses the standard two pass pairing (left to right in pairs, then
+//     right to left), which is what gives the O(log n) bound. Both passes
+//     are loops, so a long list of children doesn't recurse.
+//   * Melding is written by the typed macros, so "cmp" is called directly
+//     and can be inlined. Unlinking and walking the tree don't compare, so
+//     they're shared backend functions, as in dlist.h.
+
+#include <assert.h>
+#include <stddef.h>
+#include "offset.h"
+#include "panic.h"
+
+#ifndef PHEAP_H
+#define PHEAP_H
+
+// ******************* typedefs ****************
+
+// User should include this as a field in their node struct
+typedef struct pheap_node_struct {
+  struct pheap_node_struct *child;
+  struct pheap_node_struct *next;
+  struct pheap_node_struct *prev;
+} pheap_node_t;
+
+// The backend heap, the typed heap wraps this
+typedef struct {
+  pheap_node_t *root;
+  size_t size;
+} pheap_t;
+
+// Defines the typed heap.
+//   cmp - a function or macro taking two "const type *", returning <0, 0, or
+//         >0 like strcmp
+// peek and pop return NULL if the heap is empty.
+// link melds two trees (either may be NULL) and pair does the two pass
+// pairing of a sibling list, both return the new root.
+#define DEFINE_PHEAP(type, metaname, cmp)  \
+  typedef struct {  \
+    pheap_t heap;  \
+  } pheap_##type;  \
+  void pheap_##type##_init(pheap_##type *root) {  \
+    pheap_init(&root->heap);  \
+  }  \
+  void pheap_##type##_destroy(pheap_##type *root) {  \
+    pheap_destroy(&root->heap);  \
+  }  \
+  int pheap_##type##_empty(const pheap_##type *root) {  \
+    return !root->heap.root;  \
+  }  \
+  size_t pheap_##type##_size(const pheap_##type *root) {  \
+    return root->heap.size;  \
+  }  \
+  pheap_node_t * pheap_##type##_link(pheap_node_t *a, pheap_node_t *b) {  \
+    pheap_node_t *tmp;  \
+    if (!a)  \
+      return b;  \
+    if (!b)  \
+      return a;  \
+    if (cmp(GET_CONTAINER(b, type, metaname),  \
+            GET_CONTAINER(a, type, metaname)) < 0) {  \
+      tmp = a;  \
+      a = b;  \
+      b = tmp;  \
+    }  \
+    pheap_add_child(a, b);  \
+    return a;  \
+  }  \
+  pheap_node_t * pheap_##type##_pair(pheap_node_t *first) {  \
+    pheap_node_t *pairs = NULL;  \
+    pheap_node_t *result = NULL;  \
+    while (first) {  \
+      pheap_node_t *a = first;  \
+      pheap_node_t *b = a->next;  \
+      first = b ? b->next : NULL;  \
+      a->next = a->prev = NULL;  \
+      if (b)  \
+        b->next = b->prev = NULL;  \
+      a = pheap_##type##_link(a, b);  \
+      a->next = pairs;  \
+      pairs = a;  \
+    }  \
+    while (pairs) {  \
+      pheap_node_t *a = pairs;  \
+      pairs = a->next;  \
+      a->next = NULL;  \
+      result = pheap_##type##_link(result, a);  \
+    }  \
+    return result;  \
+  }  \
+  void pheap_##type##_push(pheap_##type *root, type *data) {  \
+    pheap_node_t *node = &(data->metaname);  \
+    node->child = node->next = node->prev = NULL;  \
+    root->heap.root = pheap_##type##_link(root->heap.root, node);  \
+    root->heap.size++;  \
+  }  \
+  void pheap_##type##_meld(pheap_##type *root, pheap_##type *src) {  \
+    root->heap.root = pheap_##type##_link(root->heap.root, src->heap.root);  \
+    root->heap.size += src->heap.size;  \
+    src->heap.root = NULL;  \
+    src->heap.size = 0;  \
+  }  \
+  type * pheap_##type##_peek(const pheap_##type *root) {  \
+    if (!root->heap.root)  \
+      return NULL;  \
+    return GET_CONTAINER(root->heap.root, type, metaname);  \
+  }  \
+  type * pheap_##type##_pop(pheap_##type *root) {  \
+    pheap_node_t *top = root->heap.root;  \
+    if (!top)  \
+      return NULL;  \
+    root->heap.root = pheap_##type##_pair(top->child);  \
+    root->heap.size--;  \
+    top->child = NULL;  \
+    return GET_CONTAINER(top, type, metaname);  \
+  }  \
+  void pheap_##type##_remove(pheap_##type *root, type *data) {  \
+    pheap_node_t *node = &(data->metaname);  \
+    if (node == root->heap.root) {  \
+      pheap_##type##_pop(root);  \
+      return;  \
+    }  \
+    pheap_cut(node);  \
+    root->heap.root = pheap_##type##_link(root->heap.root,  \
+                                          pheap_##type##_pair(node->child));  \
+    root->heap.size--;  \
+    node->child = NULL;  \
+  }  \
+  void pheap_##type##_decrease(pheap_##type *root, type *data) {  \
+    pheap_node_t *node = &(data->metaname);  \
+    if (node == root->heap.root)  \
+      return;  \
+    pheap_cut(node);  \
+    root->heap.root = pheap_##type##_link(root->heap.root, node);  \
+  }  \
+  void pheap_##type##_update(pheap_##type *root, type *data) {  \
+    pheap_##type##_remove(root, data);  \
+    pheap_##type##_push(root, data);  \
+  }  \
+  void pheap_##type##_check(const pheap_##type *root) {  \
+    pheap_node_t *node;  \
+    pheap_node_t *child;  \
+    pheap_check(&root->heap);  \
+    for (node = root->heap.root; node;  \
+         node = pheap_next_preorder(&root->heap, node)) {  \
+      for (child = node->child; child; child = child->next) {  \
+        assert(cmp(GET_CONTAINER(node, type, metaname),  \
+                   GET_CONTAINER(child, type, metaname)) <= 0);  \
+      }  \
+    }  \
+  }
+
+
+// ******************* private functions ****************
+
+void pheap_init(pheap_t *root) {
+  root->root = NULL;
+  root->size = 0;
+}
+
+void pheap_destroy(pheap_t *root) {
+  if (root->root) {
+    PANIC("pheap_destroy: heap is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->root = (pheap_node_t*) 0xdeadbeef;
+}
+
+// Makes root "child" the first child of "parent"
+void pheap_add_child(pheap_node_t *parent, pheap_node_t *child) {
+  child->prev = parent;
+  child->next = parent->child;
+  if (parent->child)
+    parent->child->prev = child;
+  parent->child = child;
+}
+
+// Unlinks non-root "node" (and its subtree) from its parent and siblings
+void pheap_cut(pheap_node_t *node) {
+  if (node->prev->child == node)
+    node->prev->child = node->next;
+  else
+    node->prev->next = node->next;
+  if (node->next)
+    node->next->prev = node->prev;
+  node->next = node->prev = NULL;
+}
+
+pheap_node_t * pheap_parent(const pheap_node_t *node) {
+  while (node->prev->child != node)
+    node = node->prev;
+  return node->prev;
+}
+
+// Walks every node of the heap, in no useful order
+pheap_node_t * pheap_next_preorder(const pheap_t *root,
+                                   const pheap_node_t *node) {
+  if (node->child)
+    return node->child;
+  while (node != root->root && !node->next)
+    node = pheap_parent(node);
+  return node == root->root ? NULL : node->next;
+}
+
+// Checks the links and the size. The typed check also checks the order.
+void pheap_check(const pheap_t *root) {
+  const pheap_node_t *node;
+  const pheap_node_t *child;
+  const pheap_node_t *prev;
+  size_t count = 0;
+  if (root->root) {
+    assert(!root->root->prev);
+    assert(!root->root->next);
+  }
+  for (node = root->root; node; node = pheap_next_preorder(root, node)) {
+    count++;
+    prev = node;
+    for (child = node->child; child; child = child->next) {
+      assert(child->prev == prev);
+      prev = child;
+    }
+  }
+  assert(count == root->size);
+}
+
+#endif
@@ -0,0 +1,132 @@
+// Benchmark for pheap (intrusive pairing heap) against heap
+//
+// Usage:
+//   gcc -O2 -o pheap_bench pheap_bench.c
+//   ./pheap_bench [tasks]
+// "tasks" defaults to 10000, spread over CORES per-core run queues. Each
+// op picks a random core. Most of the time it pops that core's best task
+// and pushes it back, with a later priority, onto a random core. The rest
+// of the time the core goes idle, and its whole queue is melded into the
+// next core's. heap.h has no meld, so there that's popping everything
+// across. Run at a few rates of melding.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "heap.h"
+#include "pheap.h"
+
+#define RUNS 5
+#define CORES 16
+#define OPS 2000000
+
+typedef struct {
+  unsigned long priority;
+  pheap_node_t pheap_data;
+  heap_node_t heap_data;
+} mytask_t;
+
+int mytask_cmp(const mytask_t *a, const mytask_t *b) {
+  return a->priority < b->priority ? -1 : a->priority > b->priority;
+}
+
+DEFINE_PHEAP(mytask_t, pheap_data, mytask_cmp)
+DEFINE_HEAP(mytask_t, heap_data, mytask_cmp)
+
+pheap_mytask_t pheaps[CORES];
+heap_mytask_t heaps[CORES];
+heap_node_t **arrays[CORES];
+
+// Runs OPS ops, melding with probability 1 in "meld_every", on the pairing
+// heaps if "paired" is set, otherwise on heap.h. Both see the same
+// sequence, from the same seed.
+double run_ops(mytask_t *tasks, size_t count, size_t meld_every,
+               int paired) {
+  uint64_t seed = 1;
+  size_t i;
+  double start;
+  for (i = 0; i < count; i++) {
+    int core = i % CORES;
+    tasks[i].priority = bench_rand(&seed) % 1000000;
+    if (paired)
+      pheap_mytask_t_push(&pheaps[core], &tasks[i]);
+    else
+      heap_mytask_t_push(&heaps[core], &tasks[i]);
+  }
+  start = bench_now();
+  for (i = 0; i < OPS; i++) {
+    uint64_t r = bench_rand(&seed);
+    int core = r % CORES;
+    int next = (core + 1) % CORES;
+    int to = (r >> 8) % CORES;
+    mytask_t *t;
+    if ((r >> 16) % meld_every == 0) {
+      if (paired) {
+        pheap_mytask_t_meld(&pheaps[next], &pheaps[core]);
+      } else {
+        while ((t = heap_mytask_t_pop(&heaps[core])))
+          heap_mytask_t_push(&heaps[next], t);
+      }
+      continue;
+    }
+    t = paired ? pheap_mytask_t_pop(&pheaps[core])
+               : heap_mytask_t_pop(&heaps[core]);
+    if (!t)
+      continue;
+    t->priority += (r >> 32) % 1000000;
+    if (paired)
+      pheap_mytask_t_push(&pheaps[to], t);
+    else
+      heap_mytask_t_push(&heaps[to], t);
+  }
+  start = bench_now() - start;
+  for (i = 0; i < CORES; i++) {
+    if (paired) {
+      pheap_mytask_t_check(&pheaps[i]);
+      while (pheap_mytask_t_pop(&pheaps[i]))
+        ;
+    } else {
+      heap_mytask_t_check(&heaps[i]);
+      while (heap_mytask_t_pop(&heaps[i]))
+        ;
+    }
+  }
+  return start;
+}
+
+int main(int argc, char **argv) {
+  size_t count = bench_arg(argc, argv, 1, 10000);
+  mytask_t *tasks = malloc(count * sizeof(mytask_t));
+  size_t meld_every[3] = {10000, 1000, 100};
+  int x;
+
+  for (x = 0; x < CORES; x++) {
+    pheap_mytask_t_init(&pheaps[x]);
+    // Any one core may end up with every task
+    arrays[x] = malloc(count * sizeof(heap_node_t*));
+    heap_mytask_t_init(&heaps[x], arrays[x], count);
+  }
+  printf("%d ops over %zu tasks on %d cores (ns/op)\n", OPS, count, CORES);
+  for (x = 0; x < 3; x++) {
+    double best[2] = {1e9, 1e9};
+    int run;
+    int paired;
+    for (run = 0; run < RUNS; run++) {
+      for (paired = 0; paired < 2; paired++) {
+        double t = run_ops(tasks, count, meld_every[x], paired);
+        if (t < best[paired])
+          best[paired] = t;
+      }
+    }
+    printf("  meld 1 op in %5zu  pheap %8.1f   heap %8.1f\n", meld_every[x],
+           best[1] * 1e9 / OPS, best[0] * 1e9 / OPS);
+  }
+  for (x = 0; x < CORES; x++) {
+    pheap_mytask_t_destroy(&pheaps[x]);
+    heap_mytask_t_destroy(&heaps[x]);
+    free(arrays[x]);
+  }
+  free(tasks);
+  return 0;
+}
@@ -0,0 +1,193 @@
+// Unittest for pheap (intrusive pairing heap)
+
+
+#include <stdio.h>
+#include "assert.h"
+#include "pheap.h"
+
+#define TASKS 1000
+#define HEAPS 8
+
+typedef struct {
+  unsigned int priority;
+  // Which of "heaps" the task is in, -1 for none
+  int heap;
+  pheap_node_t heap_data;
+} mytask_t;
+
+int mytask_cmp(const mytask_t *a, const mytask_t *b) {
+  return a->priority < b->priority ? -1 : a->priority > b->priority;
+}
+
+DEFINE_PHEAP(mytask_t, heap_data, mytask_cmp)
+
+pheap_mytask_t heaps[HEAPS];
+mytask_t tasks[TASKS];
+
+// Asserts exactly the tasks marked as in "heap" are in it, and the best is on
+// top
+void expect_heap(int heap) {
+  mytask_t *first = NULL;
+  size_t count = 0;
+  int x;
+  pheap_mytask_t_check(&heaps[heap]);
+  for (x = 0; x < TASKS; x++) {
+    if (tasks[x].heap != heap)
+      continue;
+    count++;
+    if (!first || tasks[x].priority < first->priority)
+      first = &tasks[x];
+  }
+  assert(count == pheap_mytask_t_size(&heaps[heap]));
+  if (first)
+    assert(pheap_mytask_t_peek(&heaps[heap])->priority == first->priority);
+  else
+    assert(!pheap_mytask_t_peek(&heaps[heap]));
+}
+
+// Pops everything, checking it comes out in order
+void drain(int heap) {
+  mytask_t *t;
+  unsigned int last = 0;
+  while ((t = pheap_mytask_t_pop(&heaps[heap]))) {
+    assert(t->heap == heap);
+    assert(t->priority >= last);
+    last = t->priority;
+    t->heap = -1;
+  }
+  expect_heap(heap);
+}
+
+void push(int heap, int x, unsigned int priority) {
+  tasks[x].priority = priority;
+  tasks[x].heap = heap;
+  pheap_mytask_t_push(&heaps[heap], &tasks[x]);
+}
+
+int main(unsigned int argc, char **argv) {
+  int x;
+
+  for (x = 0; x < TASKS; x++)
+    tasks[x].heap = -1;
+
+  printf("initializing heaps\n");
+  for (x = 0; x < HEAPS; x++) {
+    pheap_mytask_t_init(&heaps[x]);
+    expect_heap(x);
+  }
+  assert(pheap_mytask_t_empty(&heaps[0]));
+  assert(!pheap_mytask_t_pop(&heaps[0]));
+
+  printf("ascending and descending pushes\n");
+  for (x = 0; x < 100; x++) {
+    push(0, x, x);
+    expect_heap(0);
+  }
+  for (x = 100; x < 200; x++) {
+    push(0, x, 300 - x);
+    expect_heap(0);
+  }
+  drain(0);
+
+  printf("decrease, update and remove\n");
+  for (x = 0; x < 100; x++)
+    push(0, x, 1000 + x);
+  // Pop once, so the heap isn't just the root and its children
+  assert(pheap_mytask_t_pop(&heaps[0]) == &tasks[0]);
+  tasks[0].heap = -1;
+  expect_heap(0);
+  tasks[50].priority = 5;
+  pheap_mytask_t_decrease(&heaps[0], &tasks[50]);
+  expect_heap(0);
+  assert(pheap_mytask_t_peek(&heaps[0]) == &tasks[50]);
+  tasks[50].priority = 2000;
+  pheap_mytask_t_update(&heaps[0], &tasks[50]);
+  expect_heap(0);
+  assert(pheap_mytask_t_peek(&heaps[0]) == &tasks[1]);
+  pheap_mytask_t_remove(&heaps[0], &tasks[1]);
+  tasks[1].heap = -1;
+  expect_heap(0);
+  pheap_mytask_t_remove(&heaps[0], &tasks[70]);
+  tasks[70].heap = -1;
+  expect_heap(0);
+  assert(pheap_mytask_t_peek(&heaps[0]) == &tasks[2]);
+
+  printf("meld\n");
+  for (x = 100; x < 200; x++)
+    push(1, x, x * 7 % 1000);
+  pheap_mytask_t_meld(&heaps[0], &heaps[1]);
+  for (x = 100; x < 200; x++)
+    tasks[x].heap = 0;
+  expect_heap(0);
+  expect_heap(1);
+  assert(pheap_mytask_t_empty(&heaps[1]));
+  pheap_mytask_t_meld(&heaps[0], &heaps[1]);
+  expect_heap(0);
+  pheap_mytask_t_meld(&heaps[1], &heaps[0]);
+  for (x = 0; x < TASKS; x++) {
+    if (tasks[x].heap == 0)
+      tasks[x].heap = 1;
+  }
+  expect_heap(0);
+  expect_heap(1);
+  drain(1);
+
+  printf("random churn with melds\n");
+  srand(1);
+  for (x = 0; x < 100000; x++) {
+    int i = rand() % TASKS;
+    int heap = rand() % HEAPS;
+    int y;
+    mytask_t *t;
+    switch (rand() % 8) {
+      case 0:
+        if ((t = pheap_mytask_t_pop(&heaps[heap])))
+          t->heap = -1;
+        break;
+      case 1:
+        // Move everything from one heap into another
+        y = rand() % HEAPS;
+        if (y == heap)
+          break;
+        pheap_mytask_t_meld(&heaps[heap], &heaps[y]);
+        for (i = 0; i < TASKS; i++) {
+          if (tasks[i].heap == y)
+            tasks[i].heap = heap;
+        }
+        break;
+      case 2:
+        if (tasks[i].heap >= 0) {
+          pheap_mytask_t_remove(&heaps[tasks[i].heap], &tasks[i]);
+          tasks[i].heap = -1;
+        }
+        break;
+      case 3:
+        if (tasks[i].heap >= 0 && tasks[i].priority) {
+          tasks[i].priority -= rand() % tasks[i].priority + 1;
+          pheap_mytask_t_decrease(&heaps[tasks[i].heap], &tasks[i]);
+        }
+        break;
+      case 4:
+        if (tasks[i].heap >= 0) {
+          tasks[i].priority = rand() % 5000;
+          pheap_mytask_t_update(&heaps[tasks[i].heap], &tasks[i]);
+        }
+        break;
+      default:
+        if (tasks[i].heap < 0)
+          push(heap, i, rand() % 5000);
+        break;
+    }
+    if (x % 997 == 0) {
+      for (y = 0; y < HEAPS; y++)
+        expect_heap(y);
+    }
+  }
+  for (x = 0; x < HEAPS; x++) {
+    expect_heap(x);
+    drain(x);
+    pheap_mytask_t_destroy(&heaps[x]);
+  }
+
+  printf("PASSED!\n");
+}
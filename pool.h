@@ -0,0 +1,159 @@
+// Fixed-size object pool
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) call "DEFINE_POOL" with the type they want to allocate
+//   3) allocate a "pool_##type" and an array of "type" to back it, and call
+//      pool_##type##_init() with them
+//   4) When done with the pool, free every object, then call
+//      "pool_##type##_destroy". The backing array may then be reused.
+//
+//   See pool_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired. pool_cache.h puts per-thread caches
+//   in front of a locked pool, for use from many threads.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   Combined with dlist.h (or any of the intrusive structures here) this
+//   lets a program keep the "never calls malloc" guarantee end to end, all
+//   memory is handed in up front.
+//   pool_alloc returns NULL when the pool is exhausted.
+//   Objects must be at least sizeof(void*) bytes.
+//
+// Design Decisions:
+//   * Free objects hold the free-list link in their own first bytes, so the
+//     pool needs no memory beyond the objects themselves, and alloc/free are
+//     a couple of loads and stores.
+//   * The free list is LIFO, so the most recently freed (likely still cached)
+//     object is handed out next.
+//   * Links are read and written with memcpy, so "type" needn't be aligned
+//     for a pointer. The compiler turns this into a plain load/store.
+//   * We keep a count of free objects, so destroy can catch leaks, the same
+//     way dlist_destroy catches a non-empty list.
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include "panic.h"
+
+#ifndef POOL_H
+#define POOL_H
+
+// ******************* typedefs ****************
+
+// User should use this type to store the pool
+typedef struct {
+  void *free;
+  size_t nfree;
+  char *base;
+  size_t objsize;
+  size_t count;
+} pool_t;
+
+// Typesafe wrapper, calls straight through to the backend
+#define DEFINE_POOL(type)  \
+  typedef struct {  \
+    pool_t pool;  \
+  } pool_##type;  \
+  void pool_##type##_init(pool_##type *root, type *buffer, size_t count) {  \
+    pool_init(&root->pool, buffer, sizeof(type), count);  \
+  }  \
+  void pool_##type##_destroy(pool_##type *root) {  \
+    pool_destroy(&root->pool);  \
+  }  \
+  void pool_##type##_check(const pool_##type *root) {  \
+    pool_check(&root->pool);  \
+  }  \
+  type * pool_##type##_alloc(pool_##type *root) {  \
+    return (type*) pool_alloc(&root->pool);  \
+  }  \
+  void pool_##type##_free(pool_##type *root, type *data) {  \
+    pool_free(&root->pool, data);  \
+  }  \
+  size_t pool_##type##_available(const pool_##type *root) {  \
+    return pool_available(&root->pool);  \
+  }
+
+
+// ******************* private functions ****************
+
+void * pool_next_free(const void *obj) {
+  void *next;
+  memcpy(&next, obj, sizeof(next));
+  return next;
+}
+
+void pool_set_next_free(void *obj, void *next) {
+  memcpy(obj, &next, sizeof(next));
+}
+
+// Carves "buffer" into "count" objects of "objsize" bytes, all free
+void pool_init(pool_t *root, void *buffer, size_t objsize, size_t count) {
+  size_t i;
+  assert(objsize >= sizeof(void*));
+  root->base = (char*) buffer;
+  root->objsize = objsize;
+  root->count = count;
+  root->nfree = count;
+  root->free = count ? buffer : NULL;
+  // Link in address order, so a fresh pool hands out objects sequentially
+  for (i = 0; i < count; i++) {
+    void *next = i + 1 < count ? root->base + (i + 1) * objsize : NULL;
+    pool_set_next_free(root->base + i * objsize, next);
+  }
+}
+
+void pool_destroy(pool_t *root) {
+  if (root->nfree != root->count) {
+    PANIC("pool_destroy: objects still allocated");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->free = (void*) 0xdeadbeef;
+  root->nfree = 0;
+}
+
+// Returns NULL if the pool is exhausted
+void * pool_alloc(pool_t *root) {
+  void *obj = root->free;
+  if (!obj)
+    return NULL;
+  root->free = pool_next_free(obj);
+  root->nfree--;
+  return obj;
+}
+
+void pool_free(pool_t *root, void *obj) {
+  assert((char*) obj >= root->base);
+  assert((char*) obj < root->base + root->count * root->objsize);
+  assert(((char*) obj - root->base) % root->objsize == 0);
+  pool_set_next_free(obj, root->free);
+  root->free = obj;
+  root->nfree++;
+}
+
+size_t pool_available(const pool_t *root) {
+  return root->nfree;
+}
+
+// Walks the free list, making sure every entry is a distinct object from
+// our buffer, and that the count is right
+void pool_check(const pool_t *root) {
+  size_t n = 0;
+  void *ptr;
+  for (ptr = root->free; ptr; ptr = pool_next_free(ptr)) {
+    assert((char*) ptr >= root->base);
+    assert((char*) ptr < root->base + root->count * root->objsize);
+    assert(((char*) ptr - root->base) % root->objsize == 0);
+    n++;
+    // A cycle would walk forever, stop once we've seen too many
+    assert(n <= root->count);
+  }
+  assert(n == root->nfree);
+}
+
+#endif
@@ -0,0 +1,122 @@
+// Benchmark for pool (fixed-size object pool) against malloc
+//
+// Usage:
+//   gcc -O2 -o pool_bench pool_bench.c
+//   ./pool_bench [rounds]
+// "rounds" defaults to 2000. Each round replays the node churn from
+// dlist_unittest.c: allocate and pushback a list of nodes, remove and free
+// the odd ones while iterating, then remove and free the rest.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "dlist.h"
+#include "pool.h"
+
+#define RUNS 5
+
+typedef struct {
+  dlist_node_t list_data;
+  int data;
+} mynode_t;
+
+DEFINE_DLIST(mynode_t, list_data)
+DEFINE_POOL(mynode_t)
+
+dlist_mynode_t list;
+pool_mynode_t pool;
+
+// Allocates with malloc if "pooled" is 0, otherwise from "pool"
+mynode_t * alloc_node(int pooled) {
+  return pooled ? pool_mynode_t_alloc(&pool) : malloc(sizeof(mynode_t));
+}
+
+void free_node(int pooled, mynode_t *n) {
+  if (pooled)
+    pool_mynode_t_free(&pool, n);
+  else
+    free(n);
+}
+
+// One round of the churn over "count" nodes. If "lat" isn't NULL each
+// allocation is timed on its own, and its latency stored there.
+void churn(int pooled, int count, double *lat) {
+  mynode_t *n;
+  mynode_t *tmp;
+  int x;
+  for (x = 0; x < count; x++) {
+    if (lat) {
+      double start = bench_now();
+      n = alloc_node(pooled);
+      lat[x] = bench_now() - start;
+    } else {
+      n = alloc_node(pooled);
+    }
+    n->data = x;
+    dlist_mynode_t_pushback(&list, n);
+  }
+  DLIST_FOREACH_SAFE(mynode_t, &list, n, tmp) {
+    if (n->data % 2) {
+      dlist_mynode_t_remove(&list, n);
+      free_node(pooled, n);
+    }
+  }
+  DLIST_FOREACH_SAFE(mynode_t, &list, n, tmp) {
+    dlist_mynode_t_remove(&list, n);
+    free_node(pooled, n);
+  }
+}
+
+int cmp_double(const void *a, const void *b) {
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+void bench(int count, size_t rounds) {
+  mynode_t *buffer = malloc(count * sizeof(mynode_t));
+  double *lat = malloc(rounds * count * sizeof(double));
+  double best[2] = {1e9, 1e9};
+  size_t total = rounds * count;
+  int pooled;
+  int run;
+  size_t i;
+
+  pool_mynode_t_init(&pool, buffer, count);
+  for (run = 0; run < RUNS; run++) {
+    for (pooled = 0; pooled < 2; pooled++) {
+      double start = bench_now();
+      for (i = 0; i < rounds; i++)
+        churn(pooled, count, NULL);
+      start = bench_now() - start;
+      if (start < best[pooled])
+        best[pooled] = start;
+    }
+  }
+  printf("  %7d nodes  malloc %6.2f   pool %6.2f  ns/node\n", count,
+         best[0] * 1e9 / total, best[1] * 1e9 / total);
+  for (pooled = 0; pooled < 2; pooled++) {
+    for (i = 0; i < rounds; i++)
+      churn(pooled, count, &lat[i * count]);
+    qsort(lat, total, sizeof(double), cmp_double);
+    printf("  %7d nodes  %-6s alloc p50 %5.0f  p99.9 %6.0f  max %8.0f  ns\n",
+           count, pooled ? "pool" : "malloc", lat[total / 2] * 1e9,
+           lat[total - total / 1000 - 1] * 1e9, lat[total - 1] * 1e9);
+  }
+  pool_mynode_t_check(&pool);
+  pool_mynode_t_destroy(&pool);
+  free(lat);
+  free(buffer);
+}
+
+int main(int argc, char **argv) {
+  size_t rounds = bench_arg(argc, argv, 1, 2000);
+
+  dlist_mynode_t_init(&list);
+  printf("%zu rounds of dlist_unittest's node churn\n", rounds);
+  bench(1000, rounds);
+  bench(100000, rounds / 100 ? rounds / 100 : 1);
+  dlist_mynode_t_destroy(&list);
+  return 0;
+}
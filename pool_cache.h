@@ -0,0 +1,180 @@
+// Per-thread caches in front of a shared fixed-size object pool
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) call "DEFINE_POOL_CACHE" with the type they want to allocate
+//   3) allocate a "pool_depot_##type" and an array of "type" to back it, and
+//      call pool_depot_##type##_init() with them. This is the shared pool.
+//   4) give each thread its own "pool_cache_##type" (e.g. a _Thread_local, or
+//      a field in a per-thread struct), and call pool_cache_##type##_init()
+//      on it with the depot
+//   5) threads then alloc and free through their own cache
+//   6) When a thread is done it must call "pool_cache_##type##_destroy",
+//      which returns its cached objects to the depot. Once every cache is
+//      destroyed and every object freed, call "pool_depot_##type##_destroy".
+//
+//   See pool_cache_unittest.c for example usage.
+//
+// Threadsafety:
+//   The depot is threadsafe. Each cache must only be used by one thread at
+//   a time, but an object allocated through one cache may be freed through
+//   any other.
+//
+// Usage Notes:
+//   This datastructure never calls malloc, the depot is a pool.h pool over
+//   the user's buffer.
+//   Alloc returns NULL when the depot is exhausted. Objects sitting in other
+//   threads' caches aren't visible, so this can happen with up to
+//   POOL_CACHE_SIZE objects per other thread still free.
+//   Most allocs and frees touch only the thread's cache, and take no lock.
+//   The depot's mutex is taken once per POOL_CACHE_SIZE / 2 operations.
+//
+// Design Decisions:
+//   * This is the "magazine" design: each thread keeps a small bounded stack
+//     of free objects. When it runs dry it refills half of it from the depot
+//     in one locked batch, when it fills it flushes half back. Moving half
+//     (not all) means a thread alternating alloc and free at the boundary
+//     doesn't hit the depot every time.
+//   * The cache is an array of pointers rather than a linked list, so alloc
+//     and free never touch the object's memory, which may be cold.
+//   * POOL_CACHE_SIZE bounds the memory a thread can strand, it may be
+//     overridden before including this header.
+
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include "panic.h"
+#include "pool.h"
+
+#ifndef POOL_CACHE_H
+#define POOL_CACHE_H
+
+#ifndef POOL_CACHE_SIZE
+#define POOL_CACHE_SIZE 64
+#endif
+#if POOL_CACHE_SIZE < 2
+#error "POOL_CACHE_SIZE must be at least 2"
+#endif
+
+// ******************* typedefs ****************
+
+// The shared pool
+typedef struct {
+  pool_t pool;
+  pthread_mutex_t lock;
+} pool_depot_t;
+
+// One per thread
+typedef struct {
+  pool_depot_t *depot;
+  size_t count;
+  void *objs[POOL_CACHE_SIZE];
+} pool_cache_t;
+
+#define DEFINE_POOL_CACHE(type)  \
+  typedef struct {  \
+    pool_depot_t depot;  \
+  } pool_depot_##type;  \
+  typedef struct {  \
+    pool_cache_t cache;  \
+  } pool_cache_##type;  \
+  void pool_depot_##type##_init(pool_depot_##type *root, type *buffer,  \
+                                size_t count) {  \
+    pool_depot_init(&root->depot, buffer, sizeof(type), count);  \
+  }  \
+  void pool_depot_##type##_destroy(pool_depot_##type *root) {  \
+    pool_depot_destroy(&root->depot);  \
+  }  \
+  void pool_depot_##type##_check(pool_depot_##type *root) {  \
+    pool_depot_check(&root->depot);  \
+  }  \
+  void pool_cache_##type##_init(pool_cache_##type *cache,  \
+                                pool_depot_##type *root) {  \
+    pool_cache_init(&cache->cache, &root->depot);  \
+  }  \
+  void pool_cache_##type##_destroy(pool_cache_##type *cache) {  \
+    pool_cache_destroy(&cache->cache);  \
+  }  \
+  type * pool_cache_##type##_alloc(pool_cache_##type *cache) {  \
+    return (type*) pool_cache_alloc(&cache->cache);  \
+  }  \
+  void pool_cache_##type##_free(pool_cache_##type *cache, type *data) {  \
+    pool_cache_free(&cache->cache, data);  \
+  }
+
+
+// ******************* private functions ****************
+
+void pool_depot_init(pool_depot_t *root, void *buffer, size_t objsize,
+                     size_t count) {
+  pool_init(&root->pool, buffer, objsize, count);
+  if (pthread_mutex_init(&root->lock, NULL)) {
+    PANIC("pool_depot_init: pthread_mutex_init failed");
+  }
+}
+
+void pool_depot_destroy(pool_depot_t *root) {
+  pool_destroy(&root->pool);
+  pthread_mutex_destroy(&root->lock);
+}
+
+void pool_depot_check(pool_depot_t *root) {
+  pthread_mutex_lock(&root->lock);
+  pool_check(&root->pool);
+  pthread_mutex_unlock(&root->lock);
+}
+
+void pool_cache_init(pool_cache_t *cache, pool_depot_t *root) {
+  cache->depot = root;
+  cache->count = 0;
+}
+
+// Moves up to "n" objects from the depot into the cache, in one lock
+void pool_cache_refill(pool_cache_t *cache, size_t n) {
+  pool_depot_t *root = cache->depot;
+  assert(cache->count + n <= POOL_CACHE_SIZE);
+  pthread_mutex_lock(&root->lock);
+  while (n--) {
+    void *obj = pool_alloc(&root->pool);
+    if (!obj)
+      break;
+    cache->objs[cache->count++] = obj;
+  }
+  pthread_mutex_unlock(&root->lock);
+}
+
+// Moves "n" objects from the cache back to the depot, in one lock
+void pool_cache_flush(pool_cache_t *cache, size_t n) {
+  pool_depot_t *root = cache->depot;
+  assert(n <= cache->count);
+  pthread_mutex_lock(&root->lock);
+  while (n--)
+    pool_free(&root->pool, cache->objs[--cache->count]);
+  pthread_mutex_unlock(&root->lock);
+}
+
+// Returns every cached object to the depot
+void pool_cache_destroy(pool_cache_t *cache) {
+  pool_cache_flush(cache, cache->count);
+  // Drop some magic, so we notice if it gets used again without initialization
+  cache->depot = (pool_depot_t*) 0xdeadbeef;
+}
+
+// Returns NULL if the depot is exhausted
+void * pool_cache_alloc(pool_cache_t *cache) {
+  if (!cache->count) {
+    pool_cache_refill(cache, POOL_CACHE_SIZE / 2);
+    if (!cache->count)
+      return NULL;
+  }
+  return cache->objs[--cache->count];
+}
+
+void pool_cache_free(pool_cache_t *cache, void *obj) {
+  if (cache->count == POOL_CACHE_SIZE)
+    pool_cache_flush(cache, POOL_CACHE_SIZE / 2);
+  cache->objs[cache->count++] = obj;
+}
+
+#endif
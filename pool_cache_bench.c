@@ -0,0 +1,129 @@
+// Benchmark for pool_cache (per-thread caches over a shared pool)
+//
+// Usage:
+//   gcc -O2 -o pool_cache_bench pool_cache_bench.c -lpthread
+//   ./pool_cache_bench [allocs]
+// "allocs" defaults to 16000000, it's the total per run, split between the
+// threads. Each thread allocates HELD objects, frees them, and repeats.
+// Compares pool_cache with a pool.h pool behind a mutex, and with malloc,
+// at 1 to 32 threads.
+
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "pool.h"
+#include "pool_cache.h"
+
+#define RUNS 5
+#define HELD 100
+#define MAX_THREADS 32
+
+typedef struct {
+  long data[4];
+} mynode_t;
+
+DEFINE_POOL(mynode_t)
+DEFINE_POOL_CACHE(mynode_t)
+
+// Enough that no thread runs dry, even with every other cache full
+#define POOL_OBJS (MAX_THREADS * (HELD + POOL_CACHE_SIZE))
+
+mynode_t depot_buffer[POOL_OBJS];
+mynode_t pool_buffer[POOL_OBJS];
+pool_depot_mynode_t depot;
+pool_mynode_t pool;
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+atomic_int go;
+
+size_t per_thread;
+// 0 for pool_cache, 1 for the mutexed pool, 2 for malloc
+int way;
+
+void* worker(void *arg) {
+  pool_cache_mynode_t cache;
+  mynode_t *held[HELD];
+  size_t rounds = per_thread / HELD;
+  size_t round;
+  int x;
+  (void) arg;
+  pool_cache_mynode_t_init(&cache, &depot);
+  while (!atomic_load(&go))
+    ;
+  for (round = 0; round < rounds; round++) {
+    for (x = 0; x < HELD; x++) {
+      if (way == 0) {
+        held[x] = pool_cache_mynode_t_alloc(&cache);
+      } else if (way == 1) {
+        pthread_mutex_lock(&lock);
+        held[x] = pool_mynode_t_alloc(&pool);
+        pthread_mutex_unlock(&lock);
+      } else {
+        held[x] = malloc(sizeof(mynode_t));
+      }
+      if (!held[x])
+        abort();
+      held[x]->data[0] = x;
+    }
+    for (x = 0; x < HELD; x++) {
+      if (way == 0) {
+        pool_cache_mynode_t_free(&cache, held[x]);
+      } else if (way == 1) {
+        pthread_mutex_lock(&lock);
+        pool_mynode_t_free(&pool, held[x]);
+        pthread_mutex_unlock(&lock);
+      } else {
+        free(held[x]);
+      }
+    }
+  }
+  pool_cache_mynode_t_destroy(&cache);
+  return NULL;
+}
+
+double pump(int threads) {
+  pthread_t ids[MAX_THREADS];
+  double start;
+  int x;
+  atomic_store(&go, 0);
+  for (x = 0; x < threads; x++)
+    pthread_create(&ids[x], NULL, worker, NULL);
+  start = bench_now();
+  atomic_store(&go, 1);
+  for (x = 0; x < threads; x++)
+    pthread_join(ids[x], NULL);
+  return bench_now() - start;
+}
+
+int main(int argc, char **argv) {
+  size_t count = bench_arg(argc, argv, 1, 16000000);
+  int threads;
+
+  printf("%zu allocs, %d held at a time per thread (million allocs/sec)\n",
+         count, HELD);
+  for (threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    double best[3] = {1e9, 1e9, 1e9};
+    size_t done;
+    int run;
+    per_thread = count / threads;
+    done = per_thread / HELD * HELD * threads;
+    for (run = 0; run < RUNS; run++) {
+      for (way = 0; way < 3; way++) {
+        double t;
+        pool_depot_mynode_t_init(&depot, depot_buffer, POOL_OBJS);
+        pool_mynode_t_init(&pool, pool_buffer, POOL_OBJS);
+        if ((t = pump(threads)) < best[way])
+          best[way] = t;
+        pool_mynode_t_destroy(&pool);
+        pool_depot_mynode_t_check(&depot);
+        pool_depot_mynode_t_destroy(&depot);
+      }
+    }
+    printf("  %2d threads  pool_cache %7.2f   mutex+pool %7.2f   malloc %7.2f\n",
+           threads, done / best[0] * 1e-6, done / best[1] * 1e-6,
+           done / best[2] * 1e-6);
+  }
+  return 0;
+}
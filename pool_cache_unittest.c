@@ -0,0 +1,112 @@
+// Unittest for pool_cache (per-thread caches over a shared pool)
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include "assert.h"
+#include "pool_cache.h"
+
+#define THREADS 8
+#define POOL_SIZE (THREADS * POOL_CACHE_SIZE * 4)
+#define ROUNDS 2000
+
+typedef struct {
+  // The depot keeps its free-list link here while the object is free
+  void *link;
+  int owner;
+  int data;
+} mynode_t;
+
+DEFINE_POOL_CACHE(mynode_t)
+
+mynode_t buffer[POOL_SIZE];
+pool_depot_mynode_t depot;
+
+// Each thread repeatedly allocates a batch, checks nobody else owns what it
+// got, and frees it. Every other round it frees through a different cache
+// than it allocated from.
+void* churn(void *arg) {
+  int id = (int) (long) arg;
+  pool_cache_mynode_t cache;
+  pool_cache_mynode_t other;
+  mynode_t *held[POOL_CACHE_SIZE * 2];
+  int round;
+  int x;
+  int n;
+
+  pool_cache_mynode_t_init(&cache, &depot);
+  pool_cache_mynode_t_init(&other, &depot);
+  for (round = 0; round < ROUNDS; round++) {
+    n = (round * 7 + id) % (POOL_CACHE_SIZE * 2);
+    for (x = 0; x < n; x++) {
+      held[x] = pool_cache_mynode_t_alloc(&cache);
+      assert(held[x]);
+      assert(held[x]->owner == -1);
+      held[x]->owner = id;
+      held[x]->data = round;
+    }
+    for (x = 0; x < n; x++) {
+      assert(held[x]->owner == id);
+      assert(held[x]->data == round);
+      held[x]->owner = -1;
+      pool_cache_mynode_t_free(round % 2 ? &other : &cache, held[x]);
+    }
+  }
+  pool_cache_mynode_t_destroy(&cache);
+  pool_cache_mynode_t_destroy(&other);
+  return NULL;
+}
+
+int main(unsigned int argc, char **argv) {
+  pool_cache_mynode_t cache;
+  mynode_t *n;
+  int x;
+
+  for (x = 0; x < POOL_SIZE; x++)
+    buffer[x].owner = -1;
+
+  printf("initializing depot\n");
+  pool_depot_mynode_t_init(&depot, buffer, POOL_SIZE);
+  pool_depot_mynode_t_check(&depot);
+
+  printf("single cache\n");
+  pool_cache_mynode_t_init(&cache, &depot);
+  n = pool_cache_mynode_t_alloc(&cache);
+  assert(n);
+  // The first alloc pulls half a cache's worth out of the depot
+  assert(pool_available(&depot.depot.pool) == POOL_SIZE - POOL_CACHE_SIZE / 2);
+  pool_cache_mynode_t_free(&cache, n);
+  assert(pool_cache_mynode_t_alloc(&cache) == n);
+  pool_cache_mynode_t_free(&cache, n);
+  pool_cache_mynode_t_destroy(&cache);
+  pool_depot_mynode_t_check(&depot);
+  assert(pool_available(&depot.depot.pool) == POOL_SIZE);
+
+  printf("exhaust the depot\n");
+  {
+    static mynode_t *held[POOL_SIZE];
+    pool_cache_mynode_t_init(&cache, &depot);
+    for (x = 0; x < POOL_SIZE; x++) {
+      held[x] = pool_cache_mynode_t_alloc(&cache);
+      assert(held[x]);
+    }
+    assert(!pool_cache_mynode_t_alloc(&cache));
+    for (x = 0; x < POOL_SIZE; x++)
+      pool_cache_mynode_t_free(&cache, held[x]);
+    pool_cache_mynode_t_destroy(&cache);
+    pool_depot_mynode_t_check(&depot);
+    assert(pool_available(&depot.depot.pool) == POOL_SIZE);
+  }
+
+  printf("%d threads churning\n", THREADS);
+  pthread_t threads[THREADS];
+  for (x = 0; x < THREADS; x++)
+    pthread_create(&threads[x], NULL, churn, (void*) (long) x);
+  for (x = 0; x < THREADS; x++)
+    pthread_join(threads[x], NULL);
+  pool_depot_mynode_t_check(&depot);
+  assert(pool_available(&depot.depot.pool) == POOL_SIZE);
+
+  pool_depot_mynode_t_destroy(&depot);
+  printf("PASSED!\n");
+}
@@ -0,0 +1,114 @@
+// Unittest for pool (fixed-size object pool)
+
+
+#include <stdio.h>
+#include "assert.h"
+#include "dlist.h"
+#include "pool.h"
+
+#define POOL_SIZE 100
+
+typedef struct {
+  dlist_node_t list_data;
+  int data;
+} mynode_t;
+
+DEFINE_DLIST(mynode_t, list_data)
+DEFINE_POOL(mynode_t)
+
+// An object smaller than a pointer's alignment, to check links are unaligned
+// safe
+typedef struct {
+  char data[sizeof(void*) + 1];
+} oddnode_t;
+
+DEFINE_POOL(oddnode_t)
+
+mynode_t buffer[POOL_SIZE];
+pool_mynode_t pool;
+dlist_mynode_t list;
+
+oddnode_t odd_buffer[3];
+pool_oddnode_t odd_pool;
+
+int main(unsigned int argc, char **argv) {
+  mynode_t *n;
+  mynode_t *nodes[POOL_SIZE];
+  int x;
+  int round;
+
+  printf("initializing pool\n");
+  pool_mynode_t_init(&pool, buffer, POOL_SIZE);
+  pool_mynode_t_check(&pool);
+  assert(pool_mynode_t_available(&pool) == POOL_SIZE);
+
+  printf("allocate everything\n");
+  for (x = 0; x < POOL_SIZE; x++) {
+    nodes[x] = pool_mynode_t_alloc(&pool);
+    assert(nodes[x] == &buffer[x]);
+    nodes[x]->data = x;
+  }
+  assert(pool_mynode_t_available(&pool) == 0);
+  assert(!pool_mynode_t_alloc(&pool));
+  pool_mynode_t_check(&pool);
+
+  printf("free is LIFO\n");
+  pool_mynode_t_free(&pool, nodes[10]);
+  pool_mynode_t_free(&pool, nodes[20]);
+  pool_mynode_t_check(&pool);
+  assert(pool_mynode_t_alloc(&pool) == nodes[20]);
+  assert(pool_mynode_t_alloc(&pool) == nodes[10]);
+  for (x = 0; x < POOL_SIZE; x++)
+    pool_mynode_t_free(&pool, nodes[x]);
+  pool_mynode_t_check(&pool);
+  assert(pool_mynode_t_available(&pool) == POOL_SIZE);
+
+  // The node churn from dlist_unittest, without calling malloc
+  printf("dlist churn\n");
+  dlist_mynode_t_init(&list);
+  for (round = 0; round < 1000; round++) {
+    while ((n = pool_mynode_t_alloc(&pool))) {
+      n->data = round;
+      if (round % 2)
+        dlist_mynode_t_enqueue(&list, n);
+      else
+        dlist_mynode_t_pushback(&list, n);
+    }
+    dlist_mynode_t_check(&list);
+    for (x = 0; x < POOL_SIZE / 2 + round % 7; x++) {
+      n = round % 3 ? dlist_mynode_t_pop(&list) : dlist_mynode_t_dequeue(&list);
+      pool_mynode_t_free(&pool, n);
+    }
+    pool_mynode_t_check(&pool);
+    assert(pool_mynode_t_available(&pool) ==
+           (size_t) (POOL_SIZE / 2 + round % 7));
+  }
+  while ((n = dlist_mynode_t_first(&list))) {
+    dlist_mynode_t_remove(&list, n);
+    pool_mynode_t_free(&pool, n);
+  }
+  dlist_mynode_t_destroy(&list);
+  pool_mynode_t_check(&pool);
+  pool_mynode_t_destroy(&pool);
+
+  printf("odd sized objects\n");
+  pool_oddnode_t_init(&odd_pool, odd_buffer, 3);
+  oddnode_t *a = pool_oddnode_t_alloc(&odd_pool);
+  oddnode_t *b = pool_oddnode_t_alloc(&odd_pool);
+  assert(a == &odd_buffer[0]);
+  assert(b == &odd_buffer[1]);
+  pool_oddnode_t_free(&odd_pool, a);
+  pool_oddnode_t_check(&odd_pool);
+  pool_oddnode_t_free(&odd_pool, b);
+  pool_oddnode_t_check(&odd_pool);
+  assert(pool_oddnode_t_available(&odd_pool) == 3);
+  pool_oddnode_t_destroy(&odd_pool);
+
+  printf("empty pool\n");
+  pool_mynode_t_init(&pool, buffer, 0);
+  assert(!pool_mynode_t_alloc(&pool));
+  pool_mynode_t_check(&pool);
+  pool_mynode_t_destroy(&pool);
+
+  printf("PASSED!\n");
+}
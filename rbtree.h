@@ -0,0 +1,466 @@
+// Generic intrusive red-black tree
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) declare a "node" type, with a "rbtree_node_t" as a member
+//   3) call "DEFINE_RBTREE" with their node-type, the member name, and a
+//      comparison function
+//   4) The user must allocate a "rbtree_##type", to store the tree, and call
+//      rbtree_##type##_init() on it.
+//   5) The user must allocate all nodes before passing them in
+//   6) When done with the tree user must call "rbtree_##type##_destroy" on it
+//
+//   See rbtree_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   Equal nodes are allowed, they're kept in insertion order.
+//   Lookups take a "probe", a node with just the fields "cmp" looks at
+//   filled in, often a local variable.
+//   A node may be in a tree and a dlist at once, with a member for each.
+//
+// Design Decisions:
+//   * Insert, erase, find and the bounds are O(log n). first/last and
+//     next/prev are O(log n) worst case, O(1) amortized over a walk.
+//   * The search is written by the typed macros, so "cmp" is called
+//     directly and can be inlined. Linking the new node in, rebalancing and
+//     erase don't compare, so they're shared backend functions, as in
+//     dlist.h.
+//   * Nodes keep a parent pointer, so erase and next/prev need no stack.
+//   * The color is a plain field rather than packed into the parent
+//     pointer, it costs a word per node but keeps the code straightforward.
+
+#include <assert.h>
+#include <stddef.h>
+#include "offset.h"
+#include "panic.h"
+
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#define RBTREE_RED 0
+#define RBTREE_BLACK 1
+
+// ******************* typedefs ****************
+
+// User should include this as a field in their node struct
+typedef struct rbtree_node_struct {
+  struct rbtree_node_struct *parent;
+  struct rbtree_node_struct *left;
+  struct rbtree_node_struct *right;
+  int color;
+} rbtree_node_t;
+
+// The backend tree, the typed tree wraps this
+typedef struct {
+  rbtree_node_t *root;
+  size_t size;
+} rbtree_t;
+
+// Defines the typed tree.
+//   cmp - a function or macro taking two "const type *", returning <0, 0, or
+//         >0 like strcmp
+// find returns a node equal to "probe" (the first, if there are several),
+// lower_bound the first node >= "probe", upper_bound the first node >
+// "probe", all NULL if there isn't one.
+// before returns whether "data" sorts before "probe".
+#define DEFINE_RBTREE(type, metaname, cmp)  \
+  typedef struct {  \
+    rbtree_t tree;  \
+  } rbtree_##type;  \
+  void rbtree_##type##_init(rbtree_##type *root) {  \
+    rbtree_init(&root->tree);  \
+  }  \
+  void rbtree_##type##_destroy(rbtree_##type *root) {  \
+    rbtree_destroy(&root->tree);  \
+  }  \
+  int rbtree_##type##_empty(const rbtree_##type *root) {  \
+    return !root->tree.root;  \
+  }  \
+  size_t rbtree_##type##_size(const rbtree_##type *root) {  \
+    return root->tree.size;  \
+  }  \
+  type * rbtree_##type##_container(const rbtree_node_t *node) {  \
+    return node ? GET_CONTAINER(node, type, metaname) : NULL;  \
+  }  \
+  void rbtree_##type##_insert(rbtree_##type *root, type *data) {  \
+    rbtree_node_t **link = &root->tree.root;  \
+    rbtree_node_t *parent = NULL;  \
+    while (*link) {  \
+      parent = *link;  \
+      if (cmp(data, GET_CONTAINER(parent, type, metaname)) < 0)  \
+        link = &parent->left;  \
+      else  \
+        link = &parent->right;  \
+    }  \
+    rbtree_link(&root->tree, &(data->metaname), parent, link);  \
+  }  \
+  void rbtree_##type##_erase(rbtree_##type *root, type *data) {  \
+    rbtree_erase(&root->tree, &(data->metaname));  \
+  }  \
+  type * rbtree_##type##_lower_bound(const rbtree_##type *root,  \
+                                     const type *probe) {  \
+    rbtree_node_t *ptr = root->tree.root;  \
+    rbtree_node_t *result = NULL;  \
+    while (ptr) {  \
+      if (cmp(GET_CONTAINER(ptr, type, metaname), probe) < 0) {  \
+        ptr = ptr->right;  \
+      } else {  \
+        result = ptr;  \
+        ptr = ptr->left;  \
+      }  \
+    }  \
+    return rbtree_##type##_container(result);  \
+  }  \
+  type * rbtree_##type##_upper_bound(const rbtree_##type *root,  \
+                                     const type *probe) {  \
+    rbtree_node_t *ptr = root->tree.root;  \
+    rbtree_node_t *result = NULL;  \
+    while (ptr) {  \
+      if (cmp(GET_CONTAINER(ptr, type, metaname), probe) <= 0) {  \
+        ptr = ptr->right;  \
+      } else {  \
+        result = ptr;  \
+        ptr = ptr->left;  \
+      }  \
+    }  \
+    return rbtree_##type##_container(result);  \
+  }  \
+  type * rbtree_##type##_find(const rbtree_##type *root,  \
+                              const type *probe) {  \
+    type *data = rbtree_##type##_lower_bound(root, probe);  \
+    return data && cmp(data, probe) == 0 ? data : NULL;  \
+  }  \
+  int rbtree_##type##_before(const type *data, const type *probe) {  \
+    return cmp(data, probe) < 0;  \
+  }  \
+  type * rbtree_##type##_first(const rbtree_##type *root) {  \
+    return rbtree_##type##_container(rbtree_first(&root->tree));  \
+  }  \
+  type * rbtree_##type##_last(const rbtree_##type *root) {  \
+    return rbtree_##type##_container(rbtree_last(&root->tree));  \
+  }  \
+  type * rbtree_##type##_next(const type *data) {  \
+    return rbtree_##type##_container(rbtree_next(&(data->metaname)));  \
+  }  \
+  type * rbtree_##type##_prev(const type *data) {  \
+    return rbtree_##type##_container(rbtree_prev(&(data->metaname)));  \
+  }  \
+  void rbtree_##type##_check(const rbtree_##type *root) {  \
+    type *data;  \
+    type *last = NULL;  \
+    rbtree_check(&root->tree);  \
+    for (data = rbtree_##type##_first(root); data;  \
+         data = rbtree_##type##_next(data)) {  \
+      if (last)  \
+        assert(cmp(last, data) <= 0);  \
+      last = data;  \
+    }  \
+  }
+
+// Inline iteration, in order, as DLIST_FOREACH in dlist.h
+// The body must not insert or erase, use RBTREE_FOREACH_SAFE to erase.
+#define RBTREE_FOREACH(type, root, var)  \
+  for ((var) = rbtree_##type##_first(root);  \
+       (var);  \
+       (var) = rbtree_##type##_next(var))
+
+// As RBTREE_FOREACH, but in reverse order
+#define RBTREE_FOREACH_REVERSE(type, root, var)  \
+  for ((var) = rbtree_##type##_last(root);  \
+       (var);  \
+       (var) = rbtree_##type##_prev(var))
+
+// As RBTREE_FOREACH, but "var" may be erased by the body.
+#define RBTREE_FOREACH_SAFE(type, root, var, tmp)  \
+  for ((var) = rbtree_##type##_first(root);  \
+       (var) && (((tmp) = rbtree_##type##_next(var)), 1);  \
+       (var) = (tmp))
+
+// Iterates over the nodes "from" <= node < "to", in order.
+//   from, to - "const type *" probes, as for lower_bound
+#define RBTREE_FOREACH_RANGE(type, root, var, from, to)  \
+  for ((var) = rbtree_##type##_lower_bound((root), (from));  \
+       (var) && rbtree_##type##_before((var), (to));  \
+       (var) = rbtree_##type##_next(var))
+
+
+// ******************* private functions ****************
+
+void rbtree_init(rbtree_t *root) {
+  root->root = NULL;
+  root->size = 0;
+}
+
+void rbtree_destroy(rbtree_t *root) {
+  if (root->root) {
+    PANIC("rbtree_destroy: tree is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->root = (rbtree_node_t*) 0xdeadbeef;
+}
+
+int rbtree_is_black(const rbtree_node_t *node) {
+  return !node || node->color == RBTREE_BLACK;
+}
+
+// Puts "v" where "u" was under u's parent (v may be NULL)
+void rbtree_replace(rbtree_t *root, rbtree_node_t *u, rbtree_node_t *v) {
+  if (!u->parent)
+    root->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v)
+    v->parent = u->parent;
+}
+
+void rbtree_rotate_left(rbtree_t *root, rbtree_node_t *node) {
+  rbtree_node_t *pivot = node->right;
+  node->right = pivot->left;
+  if (pivot->left)
+    pivot->left->parent = node;
+  rbtree_replace(root, node, pivot);
+  pivot->left = node;
+  node->parent = pivot;
+}
+
+void rbtree_rotate_right(rbtree_t *root, rbtree_node_t *node) {
+  rbtree_node_t *pivot = node->left;
+  node->left = pivot->right;
+  if (pivot->right)
+    pivot->right->parent = node;
+  rbtree_replace(root, node, pivot);
+  pivot->right = node;
+  node->parent = pivot;
+}
+
+// Links "node" in as a leaf at "*link", a child pointer of "parent" (or the
+// root pointer if "parent" is NULL) found by the typed search, and
+// rebalances.
+void rbtree_link(rbtree_t *root, rbtree_node_t *node, rbtree_node_t *parent,
+                 rbtree_node_t **link) {
+  node->parent = parent;
+  node->left = NULL;
+  node->right = NULL;
+  node->color = RBTREE_RED;
+  *link = node;
+  root->size++;
+
+  while ((parent = node->parent) && parent->color == RBTREE_RED) {
+    // A red parent is never the root, so there's a grandparent
+    rbtree_node_t *grand = parent->parent;
+    if (parent == grand->left) {
+      rbtree_node_t *uncle = grand->right;
+      if (!rbtree_is_black(uncle)) {
+        parent->color = RBTREE_BLACK;
+        uncle->color = RBTREE_BLACK;
+        grand->color = RBTREE_RED;
+        node = grand;
+        continue;
+      }
+      if (node == parent->right) {
+        rbtree_rotate_left(root, parent);
+        node = parent;
+        parent = node->parent;
+      }
+      parent->color = RBTREE_BLACK;
+      grand->color = RBTREE_RED;
+      rbtree_rotate_right(root, grand);
+    } else {
+      rbtree_node_t *uncle = grand->left;
+      if (!rbtree_is_black(uncle)) {
+        parent->color = RBTREE_BLACK;
+        uncle->color = RBTREE_BLACK;
+        grand->color = RBTREE_RED;
+        node = grand;
+        continue;
+      }
+      if (node == parent->left) {
+        rbtree_rotate_right(root, parent);
+        node = parent;
+        parent = node->parent;
+      }
+      parent->color = RBTREE_BLACK;
+      grand->color = RBTREE_RED;
+      rbtree_rotate_left(root, grand);
+    }
+  }
+  root->root->color = RBTREE_BLACK;
+}
+
+rbtree_node_t * rbtree_leftmost(rbtree_node_t *node) {
+  while (node->left)
+    node = node->left;
+  return node;
+}
+
+rbtree_node_t * rbtree_rightmost(rbtree_node_t *node) {
+  while (node->right)
+    node = node->right;
+  return node;
+}
+
+void rbtree_erase(rbtree_t *root, rbtree_node_t *node) {
+  // "child" takes the place of the node that's really unlinked, "parent" is
+  // its new parent (needed, since "child" may be NULL)
+  rbtree_node_t *child;
+  rbtree_node_t *parent;
+  int removed_color = node->color;
+  assert(root->size);
+
+  if (!node->left) {
+    child = node->right;
+    parent = node->parent;
+    rbtree_replace(root, node, child);
+  } else if (!node->right) {
+    child = node->left;
+    parent = node->parent;
+    rbtree_replace(root, node, child);
+  } else {
+    // Two children, so the successor (which has no left child) is unlinked
+    // from its spot, and takes node's place and color
+    rbtree_node_t *next = rbtree_leftmost(node->right);
+    removed_color = next->color;
+    child = next->right;
+    if (next->parent == node) {
+      parent = next;
+    } else {
+      parent = next->parent;
+      rbtree_replace(root, next, child);
+      next->right = node->right;
+      next->right->parent = next;
+    }
+    rbtree_replace(root, node, next);
+    next->left = node->left;
+    next->left->parent = next;
+    next->color = node->color;
+  }
+  root->size--;
+
+  if (removed_color == RBTREE_RED)
+    return;
+  // "child"'s side is now one black short
+  while (child != root->root && rbtree_is_black(child)) {
+    if (child == parent->left) {
+      rbtree_node_t *sibling = parent->right;
+      if (!rbtree_is_black(sibling)) {
+        sibling->color = RBTREE_BLACK;
+        parent->color = RBTREE_RED;
+        rbtree_rotate_left(root, parent);
+        sibling = parent->right;
+      }
+      if (rbtree_is_black(sibling->left) && rbtree_is_black(sibling->right)) {
+        sibling->color = RBTREE_RED;
+        child = parent;
+        parent = child->parent;
+        continue;
+      }
+      if (rbtree_is_black(sibling->right)) {
+        sibling->left->color = RBTREE_BLACK;
+        sibling->color = RBTREE_RED;
+        rbtree_rotate_right(root, sibling);
+        sibling = parent->right;
+      }
+      sibling->color = parent->color;
+      parent->color = RBTREE_BLACK;
+      sibling->right->color = RBTREE_BLACK;
+      rbtree_rotate_left(root, parent);
+    } else {
+      rbtree_node_t *sibling = parent->left;
+      if (!rbtree_is_black(sibling)) {
+        sibling->color = RBTREE_BLACK;
+        parent->color = RBTREE_RED;
+        rbtree_rotate_right(root, parent);
+        sibling = parent->left;
+      }
+      if (rbtree_is_black(sibling->left) && rbtree_is_black(sibling->right)) {
+        sibling->color = RBTREE_RED;
+        child = parent;
+        parent = child->parent;
+        continue;
+      }
+      if (rbtree_is_black(sibling->left)) {
+        sibling->right->color = RBTREE_BLACK;
+        sibling->color = RBTREE_RED;
+        rbtree_rotate_left(root, sibling);
+        sibling = parent->left;
+      }
+      sibling->color = parent->color;
+      parent->color = RBTREE_BLACK;
+      sibling->left->color = RBTREE_BLACK;
+      rbtree_rotate_right(root, parent);
+    }
+    child = root->root;
+  }
+  if (child)
+    child->color = RBTREE_BLACK;
+}
+
+rbtree_node_t * rbtree_first(const rbtree_t *root) {
+  return root->root ? rbtree_leftmost(root->root) : NULL;
+}
+
+rbtree_node_t * rbtree_last(const rbtree_t *root) {
+  return root->root ? rbtree_rightmost(root->root) : NULL;
+}
+
+rbtree_node_t * rbtree_next(const rbtree_node_t *node) {
+  if (node->right)
+    return rbtree_leftmost(node->right);
+  while (node->parent && node == node->parent->right)
+    node = node->parent;
+  return node->parent;
+}
+
+rbtree_node_t * rbtree_prev(const rbtree_node_t *node) {
+  if (node->left)
+    return rbtree_rightmost(node->left);
+  while (node->parent && node == node->parent->left)
+    node = node->parent;
+  return node->parent;
+}
+
+// Checks the subtree under "node", returning its black height
+size_t rbtree_check_subtree(const rbtree_node_t *node, size_t *count) {
+  size_t left_height;
+  size_t right_height;
+  if (!node)
+    return 1;
+  (*count)++;
+  assert(node->color == RBTREE_RED || node->color == RBTREE_BLACK);
+  if (node->left)
+    assert(node->left->parent == node);
+  if (node->right)
+    assert(node->right->parent == node);
+  if (node->color == RBTREE_RED) {
+    assert(rbtree_is_black(node->left));
+    assert(rbtree_is_black(node->right));
+  }
+  left_height = rbtree_check_subtree(node->left, count);
+  right_height = rbtree_check_subtree(node->right, count);
+  assert(left_height == right_height);
+  return left_height + (node->color == RBTREE_BLACK);
+}
+
+// Checks the links, the colors and the size. The typed check also checks
+// the order.
+void rbtree_check(const rbtree_t *root) {
+  size_t count = 0;
+  if (root->root) {
+    assert(!root->root->parent);
+    assert(root->root->color == RBTREE_BLACK);
+  }
+  rbtree_check_subtree(root->root, &count);
+  assert(count == root->size);
+}
+
+#endif
@@ -0,0 +1,132 @@
+// Benchmark for rbtree (intrusive red-black tree) against a sorted dlist
+//
+// Usage:
+//   gcc -O2 -o rbtree_bench rbtree_bench.c
+//   ./rbtree_bench [largest]
+// Times inserting random keys into a tree, and into a dlist kept sorted by
+// walking from the head to the insertion point, each already holding 1000,
+// 10000, 100000 and "largest" (default 1000000) nodes. The dlist's walk is
+// O(n), so at the larger sizes it's only sampled with a few inserts. Nodes
+// sit at random addresses, as if malloc'd over time.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "dlist.h"
+#include "rbtree.h"
+
+#define RUNS 5
+#define TREE_SAMPLES 10000
+
+typedef struct {
+  long key;
+  rbtree_node_t tree_data;
+  dlist_node_t list_data;
+} mynode_t;
+
+int mynode_cmp(const mynode_t *a, const mynode_t *b) {
+  return a->key < b->key ? -1 : a->key > b->key;
+}
+
+DEFINE_RBTREE(mynode_t, tree_data, mynode_cmp)
+DEFINE_DLIST(mynode_t, list_data)
+
+int cmp_ptr(const void *a, const void *b) {
+  return mynode_cmp(*(mynode_t* const*) a, *(mynode_t* const*) b);
+}
+
+// Inserts "data" after the last node that isn't greater than it
+void sorted_insert(dlist_mynode_t *list, mynode_t *data) {
+  dlist_mynode_t one;
+  mynode_t *prev = NULL;
+  mynode_t *n;
+  DLIST_FOREACH(mynode_t, list, n) {
+    if (mynode_cmp(n, data) > 0)
+      break;
+    prev = n;
+  }
+  dlist_mynode_t_init(&one);
+  dlist_mynode_t_pushback(&one, data);
+  dlist_mynode_t_splice_after(list, prev, &one);
+  dlist_mynode_t_destroy(&one);
+}
+
+void bench(size_t count) {
+  size_t list_samples = 20000000 / count;
+  size_t total;
+  mynode_t *nodes;
+  mynode_t **order;
+  rbtree_mynode_t tree;
+  dlist_mynode_t list;
+  double best[2] = {1e9, 1e9};
+  uint64_t seed = 1;
+  size_t i;
+  int run;
+
+  if (list_samples > 1000)
+    list_samples = 1000;
+  if (list_samples < 10)
+    list_samples = 10;
+  total = count + TREE_SAMPLES;
+  nodes = malloc(total * sizeof(mynode_t));
+  order = malloc(total * sizeof(mynode_t*));
+  for (i = 0; i < total; i++)
+    order[i] = &nodes[i];
+  bench_shuffle((void**) order, total, &seed);
+  for (i = 0; i < total; i++)
+    order[i]->key = bench_rand(&seed) >> 1;
+
+  // The first "count" nodes (in "order") are the starting contents, the
+  // rest are the timed inserts. The list starts out built from them sorted.
+  rbtree_mynode_t_init(&tree);
+  for (i = 0; i < count; i++)
+    rbtree_mynode_t_insert(&tree, order[i]);
+  qsort(order, count, sizeof(mynode_t*), cmp_ptr);
+  dlist_mynode_t_init(&list);
+  for (i = 0; i < count; i++)
+    dlist_mynode_t_pushback(&list, order[i]);
+
+  for (run = 0; run < RUNS; run++) {
+    double start = bench_now();
+    double mid;
+    double end;
+    for (i = count; i < total; i++)
+      rbtree_mynode_t_insert(&tree, order[i]);
+    mid = bench_now();
+    for (i = count; i < count + list_samples; i++)
+      sorted_insert(&list, order[i]);
+    end = bench_now();
+    if (mid - start < best[0])
+      best[0] = mid - start;
+    if (end - mid < best[1])
+      best[1] = end - mid;
+    for (i = count; i < total; i++)
+      rbtree_mynode_t_erase(&tree, order[i]);
+    for (i = count; i < count + list_samples; i++)
+      dlist_mynode_t_remove(&list, order[i]);
+  }
+  rbtree_mynode_t_check(&tree);
+  printf("  %8zu nodes  rbtree %7.1f   sorted dlist %10.1f\n", count,
+         best[0] * 1e9 / TREE_SAMPLES, best[1] * 1e9 / list_samples);
+
+  for (i = 0; i < count; i++) {
+    rbtree_mynode_t_erase(&tree, order[i]);
+    dlist_mynode_t_remove(&list, order[i]);
+  }
+  rbtree_mynode_t_destroy(&tree);
+  dlist_mynode_t_destroy(&list);
+  free(order);
+  free(nodes);
+}
+
+int main(int argc, char **argv) {
+  size_t largest = bench_arg(argc, argv, 1, 1000000);
+
+  printf("insert a random key (ns/insert)\n");
+  bench(1000);
+  bench(10000);
+  bench(100000);
+  bench(largest);
+  return 0;
+}
@@ -0,0 +1,344 @@
+// Intrusive skip list, single writer with lock-free concurrent readers
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) declare a "node" type, with a "skiplist_node_t" as a member, and
+//      storage for its tower: an array of "skiplist_link_t", either in the
+//      node (SKIPLIST_MAX_HEIGHT long fits any height) or allocated with it
+//   3) call "DEFINE_SKIPLIST" with their node-type, the member name, and a
+//      comparison function
+//   4) The user must allocate a "skiplist_##type", to store the list, and
+//      call skiplist_##type##_init() on it.
+//   5) Before inserting a node, call skiplist_##type##_node_init() on it with
+//      its tower and height. skiplist_##type##_random_height() gives the
+//      height to use, and so how much tower to allocate.
+//   6) When done with the list user must call "skiplist_##type##_destroy" on
+//      it
+//
+//   See skiplist_unittest.c for example usage.
+//
+// Threadsafety:
+//   One writer, any number of readers, at once.
+//   Writer functions (init, destroy, random_height, insert, erase, size,
+//   check) must be called by one thread at a time, this is not checked.
+//   Reader functions (find, lower_bound, upper_bound, first, next and the
+//   FOREACH macros) may be called from any thread, at any time, including
+//   while the writer is working. They never block, take a lock, or write to
+//   shared memory.
+//   A reader sees each node either linked or not. A node inserted or erased
+//   during a walk may or may not be seen, every other node is, in order.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   Requires C11 atomics.
+//   Equal nodes are allowed, they're kept in insertion order.
+//   Lookups take a "probe", a node with just the fields "cmp" looks at
+//   filled in, often a local variable.
+//   An erased node may still be in use by readers that reached it before it
+//   was unlinked, and they'll follow its links afterwards. So the node must
+//   not be freed, changed, or inserted again until every reader that might
+//   have seen it has finished (e.g. using an epoch or RCU scheme). This
+//   header doesn't track readers, since how is best decided by the caller.
+//
+// Design Decisions:
+//   * Towers are a geometric height with p = 1/4 (as in LevelDB), so a
+//     search compares against about 4 nodes per level, about 2 log2(n) in
+//     all, and a node has 1.33 links on average. SKIPLIST_MAX_HEIGHT
+//     (default 16) covers 4^16 nodes.
+//   * That's about twice the nodes an rbtree.h lookup visits, and in
+//     skiplist_bench.c a lookup takes about 2 (10K keys) to 2.5 (1M keys)
+//     times as long as an unlocked rbtree's. What's bought is readers that
+//     never wait on the writer.
+//   * The list head is a tower like any node's, so searches don't special
+//     case it.
+//   * Insert fills in the new node's tower, then publishes it bottom level
+//     first with release stores. A reader that loads a link (acquire) sees
+//     the node fully built, and a node is in the bottom level (and so
+//     findable) before any level above it.
+//   * Erase unlinks top level first, leaving the node's own links in place,
+//     so a reader standing on it still walks on to nodes after it.
+//   * The search is written by the typed macros, so "cmp" is called directly
+//     and can be inlined, as in rbtree.h.
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "offset.h"
+#include "panic.h"
+
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+// Tallest tower, may be defined before including this header
+#ifndef SKIPLIST_MAX_HEIGHT
+#define SKIPLIST_MAX_HEIGHT 16
+#endif
+
+// ******************* typedefs ****************
+
+typedef struct skiplist_node_struct skiplist_node_t;
+
+// One level of a tower, a link to the next node on that level
+typedef skiplist_node_t *_Atomic skiplist_link_t;
+
+// User should include this as a field in their node struct
+struct skiplist_node_struct {
+  skiplist_link_t *tower;
+  unsigned int height;
+};
+
+// The backend list, the typed list wraps this
+typedef struct {
+  skiplist_link_t head[SKIPLIST_MAX_HEIGHT];
+  // Height of the tallest tower, only ever grows
+  _Atomic unsigned int height;
+  // Writer only
+  size_t size;
+  uint64_t seed;
+} skiplist_t;
+
+// Defines the typed list.
+//   cmp - a function or macro taking two "const type *", returning <0, 0, or
+//         >0 like strcmp
+// find returns a node equal to "probe" (the first, if there are several),
+// lower_bound the first node >= "probe", upper_bound the first node >
+// "probe", all NULL if there isn't one.
+// search finds the tower before where "probe" goes on each level (before
+// nodes equal to it if "after" is 0, after them if 1), filling in "prev" if
+// it's not NULL, and returns the node after it on the bottom level. That's
+// the node it compared against, re-reading the link could give a node the
+// writer has just put in front of it.
+#define DEFINE_SKIPLIST(type, metaname, cmp)  \
+  typedef struct {  \
+    skiplist_t list;  \
+  } skiplist_##type;  \
+  void skiplist_##type##_init(skiplist_##type *root) {  \
+    skiplist_init(&root->list);  \
+  }  \
+  void skiplist_##type##_destroy(skiplist_##type *root) {  \
+    skiplist_destroy(&root->list);  \
+  }  \
+  size_t skiplist_##type##_size(const skiplist_##type *root) {  \
+    return root->list.size;  \
+  }  \
+  unsigned int skiplist_##type##_random_height(skiplist_##type *root) {  \
+    return skiplist_random_height(&root->list);  \
+  }  \
+  void skiplist_##type##_node_init(type *data, skiplist_link_t *tower,  \
+                                   unsigned int height) {  \
+    skiplist_node_init(&(data->metaname), tower, height);  \
+  }  \
+  type * skiplist_##type##_container(skiplist_node_t *node) {  \
+    return node ? GET_CONTAINER(node, type, metaname) : NULL;  \
+  }  \
+  skiplist_node_t * skiplist_##type##_search(const skiplist_##type *root,  \
+                                             const type *probe, int after,  \
+                                             skiplist_link_t **prev) {  \
+    skiplist_link_t *links = (skiplist_link_t*) root->list.head;  \
+    skiplist_node_t *next = NULL;  \
+    int level = (int) atomic_load_explicit(&root->list.height,  \
+                                           memory_order_relaxed) - 1;  \
+    for (; level >= 0; level--) {  \
+      for (;;) {  \
+        next = atomic_load_explicit(&links[level], memory_order_acquire);  \
+        if (!next ||  \
+            cmp(GET_CONTAINER(next, type, metaname), probe) >= after)  \
+          break;  \
+        links = next->tower;  \
+      }  \
+      if (prev)  \
+        prev[level] = links;  \
+    }  \
+    return next;  \
+  }  \
+  type * skiplist_##type##_lower_bound(const skiplist_##type *root,  \
+                                       const type *probe) {  \
+    return skiplist_##type##_container(  \
+        skiplist_##type##_search(root, probe, 0, NULL));  \
+  }  \
+  type * skiplist_##type##_upper_bound(const skiplist_##type *root,  \
+                                       const type *probe) {  \
+    return skiplist_##type##_container(  \
+        skiplist_##type##_search(root, probe, 1, NULL));  \
+  }  \
+  int skiplist_##type##_before(const type *data, const type *probe) {  \
+    return cmp(data, probe) < 0;  \
+  }  \
+  type * skiplist_##type##_find(const skiplist_##type *root,  \
+                                const type *probe) {  \
+    type *data = skiplist_##type##_lower_bound(root, probe);  \
+    return data && cmp(data, probe) == 0 ? data : NULL;  \
+  }  \
+  type * skiplist_##type##_first(const skiplist_##type *root) {  \
+    return skiplist_##type##_container(  \
+        atomic_load_explicit(&root->list.head[0], memory_order_acquire));  \
+  }  \
+  type * skiplist_##type##_next(const type *data) {  \
+    return skiplist_##type##_container(  \
+        atomic_load_explicit(&data->metaname.tower[0],  \
+                             memory_order_acquire));  \
+  }  \
+  void skiplist_##type##_insert(skiplist_##type *root, type *data) {  \
+    skiplist_link_t *prev[SKIPLIST_MAX_HEIGHT];  \
+    skiplist_prev_init(&root->list, prev);  \
+    skiplist_##type##_search(root, data, 1, prev);  \
+    skiplist_link(&root->list, &(data->metaname), prev);  \
+  }  \
+  void skiplist_##type##_erase(skiplist_##type *root, type *data) {  \
+    skiplist_link_t *prev[SKIPLIST_MAX_HEIGHT];  \
+    skiplist_prev_init(&root->list, prev);  \
+    skiplist_##type##_search(root, data, 0, prev);  \
+    skiplist_unlink(&root->list, &(data->metaname), prev);  \
+  }  \
+  void skiplist_##type##_check(const skiplist_##type *root) {  \
+    type *data;  \
+    type *last = NULL;  \
+    skiplist_check(&root->list);  \
+    for (data = skiplist_##type##_first(root); data;  \
+         data = skiplist_##type##_next(data)) {  \
+      if (last)  \
+        assert(cmp(last, data) <= 0);  \
+      last = data;  \
+    }  \
+  }
+
+// Inline iteration, in order, as DLIST_FOREACH in dlist.h
+// Safe for readers. The body must not erase "var" if it's the writer.
+#define SKIPLIST_FOREACH(type, root, var)  \
+  for ((var) = skiplist_##type##_first(root);  \
+       (var);  \
+       (var) = skiplist_##type##_next(var))
+
+// Iterates over the nodes "from" <= node < "to", in order.
+//   from, to - "const type *" probes, as for lower_bound
+// Safe for readers.
+#define SKIPLIST_FOREACH_RANGE(type, root, var, from, to)  \
+  for ((var) = skiplist_##type##_lower_bound((root), (from));  \
+       (var) && skiplist_##type##_before((var), (to));  \
+       (var) = skiplist_##type##_next(var))
+
+
+// ******************* private functions ****************
+
+void skiplist_init(skiplist_t *root) {
+  int level;
+  for (level = 0; level < SKIPLIST_MAX_HEIGHT; level++)
+    atomic_init(&root->head[level], NULL);
+  atomic_init(&root->height, 1);
+  root->size = 0;
+  root->seed = 0x9e3779b97f4a7c15ull;
+}
+
+void skiplist_destroy(skiplist_t *root) {
+  if (root->size) {
+    PANIC("skiplist_destroy: list is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  atomic_store(&root->head[0], (skiplist_node_t*) 0xdeadbeef);
+}
+
+// Writer only. Each level up is 1/4 as likely.
+unsigned int skiplist_random_height(skiplist_t *root) {
+  uint64_t bits;
+  unsigned int height = 1;
+  // xorshift64
+  root->seed ^= root->seed << 13;
+  root->seed ^= root->seed >> 7;
+  root->seed ^= root->seed << 17;
+  bits = root->seed;
+  while (height < SKIPLIST_MAX_HEIGHT && !(bits & 3)) {
+    height++;
+    bits >>= 2;
+  }
+  return height;
+}
+
+void skiplist_node_init(skiplist_node_t *node, skiplist_link_t *tower,
+                        unsigned int height) {
+  assert(height >= 1 && height <= SKIPLIST_MAX_HEIGHT);
+  node->tower = tower;
+  node->height = height;
+}
+
+// Writer only. Sets every level of "prev" to the head, for levels above the
+// list's height, which the search doesn't reach.
+void skiplist_prev_init(skiplist_t *root, skiplist_link_t **prev) {
+  int level;
+  for (level = 0; level < SKIPLIST_MAX_HEIGHT; level++)
+    prev[level] = root->head;
+}
+
+// Links "node" in after the towers "prev" found by the typed search
+void skiplist_link(skiplist_t *root, skiplist_node_t *node,
+                   skiplist_link_t **prev) {
+  unsigned int level;
+  // Readers may see the new height before the node, they'll find the new
+  // levels of the head empty, and drop down
+  if (node->height > atomic_load_explicit(&root->height, memory_order_relaxed))
+    atomic_store_explicit(&root->height, node->height, memory_order_relaxed);
+  // Not published yet, so nothing else can see these
+  for (level = 0; level < node->height; level++) {
+    atomic_store_explicit(&node->tower[level],
+        atomic_load_explicit(&prev[level][level], memory_order_relaxed),
+        memory_order_relaxed);
+  }
+  for (level = 0; level < node->height; level++)
+    atomic_store_explicit(&prev[level][level], node, memory_order_release);
+  root->size++;
+}
+
+// Unlinks "node", "prev" are the towers before the first node equal to it.
+// "node" may be further along, after other equal nodes.
+void skiplist_unlink(skiplist_t *root, skiplist_node_t *node,
+                     skiplist_link_t **prev) {
+  int level;
+  for (level = (int) node->height - 1; level >= 0; level--) {
+    skiplist_link_t *links = prev[level];
+    skiplist_node_t *next;
+    while ((next = atomic_load_explicit(&links[level], memory_order_relaxed))
+           != node) {
+      if (!next) {
+        PANIC("skiplist_unlink: node is not in the list");
+      }
+      links = next->tower;
+    }
+    atomic_store_explicit(&links[level],
+        atomic_load_explicit(&node->tower[level], memory_order_relaxed),
+        memory_order_release);
+  }
+  root->size--;
+}
+
+// Writer only. Checks each level only holds nodes tall enough for it, in the
+// same order as the bottom level, and the size. The typed check also checks
+// the order.
+void skiplist_check(const skiplist_t *root) {
+  unsigned int height = atomic_load(&root->height);
+  size_t count = 0;
+  unsigned int level;
+  skiplist_node_t *node;
+  assert(height >= 1 && height <= SKIPLIST_MAX_HEIGHT);
+  for (level = height; level < SKIPLIST_MAX_HEIGHT; level++)
+    assert(!atomic_load(&root->head[level]));
+  for (node = atomic_load(&root->head[0]); node;
+       node = atomic_load(&node->tower[0])) {
+    assert(node->height >= 1 && node->height <= height);
+    count++;
+  }
+  assert(count == root->size);
+  for (level = 1; level < height; level++) {
+    // Each node on this level must turn up, in order, on the level below
+    skiplist_node_t *below = atomic_load(&root->head[level - 1]);
+    for (node = atomic_load(&root->head[level]); node;
+         node = atomic_load(&node->tower[level])) {
+      assert(node->height > level);
+      while (below && below != node)
+        below = atomic_load(&below->tower[level - 1]);
+      assert(below == node);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,139 @@
+// Benchmark for skiplist (lock-free readers) against rbtree behind a rwlock
+//
+// Usage:
+//   gcc -O2 -o skiplist_bench skiplist_bench.c -lpthread
+//   ./skiplist_bench [nodes]
+// Builds a skiplist and an rbtree from the same "nodes" (default 1000000)
+// random keys, then has 1 to 32 threads look up LOOKUPS present keys
+// between them. The rbtree is read under a pthread rwlock, which is what it
+// would need with a writer about, and also with no lock at all, which only
+// works without one and shows what the lock costs.
+
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "rbtree.h"
+#include "skiplist.h"
+
+#define RUNS 5
+#define LOOKUPS 1000000
+#define MAX_THREADS 32
+
+typedef struct {
+  long key;
+  rbtree_node_t tree_data;
+  skiplist_node_t list_data;
+  skiplist_link_t tower[];
+} mynode_t;
+
+int mynode_cmp(const mynode_t *a, const mynode_t *b) {
+  return a->key < b->key ? -1 : a->key > b->key;
+}
+
+DEFINE_RBTREE(mynode_t, tree_data, mynode_cmp)
+DEFINE_SKIPLIST(mynode_t, list_data, mynode_cmp)
+
+skiplist_mynode_t list;
+rbtree_mynode_t tree;
+pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+mynode_t **nodes;
+size_t count;
+atomic_int go;
+atomic_size_t found;
+
+size_t per_thread;
+// 0 for the skiplist, 1 for the rbtree with a rwlock, 2 without
+int way;
+
+void* worker(void *arg) {
+  uint64_t seed = (uintptr_t) arg + 1;
+  mynode_t probe;
+  size_t hits = 0;
+  size_t i;
+  while (!atomic_load(&go))
+    ;
+  for (i = 0; i < per_thread; i++) {
+    probe.key = nodes[bench_rand(&seed) % count]->key;
+    if (way == 0) {
+      hits += skiplist_mynode_t_find(&list, &probe) != NULL;
+    } else if (way == 1) {
+      pthread_rwlock_rdlock(&lock);
+      hits += rbtree_mynode_t_find(&tree, &probe) != NULL;
+      pthread_rwlock_unlock(&lock);
+    } else {
+      hits += rbtree_mynode_t_find(&tree, &probe) != NULL;
+    }
+  }
+  atomic_fetch_add(&found, hits);
+  return NULL;
+}
+
+double pump(int threads) {
+  pthread_t ids[MAX_THREADS];
+  double start;
+  int x;
+  atomic_store(&go, 0);
+  for (x = 0; x < threads; x++)
+    pthread_create(&ids[x], NULL, worker, (void*) (uintptr_t) x);
+  start = bench_now();
+  atomic_store(&go, 1);
+  for (x = 0; x < threads; x++)
+    pthread_join(ids[x], NULL);
+  return bench_now() - start;
+}
+
+int main(int argc, char **argv) {
+  uint64_t seed = 1;
+  size_t i;
+  int threads;
+
+  count = bench_arg(argc, argv, 1, 1000000);
+  nodes = malloc(count * sizeof(mynode_t*));
+  skiplist_mynode_t_init(&list);
+  rbtree_mynode_t_init(&tree);
+  for (i = 0; i < count; i++) {
+    unsigned int height = skiplist_mynode_t_random_height(&list);
+    nodes[i] = malloc(sizeof(mynode_t) + height * sizeof(skiplist_link_t));
+    nodes[i]->key = bench_rand(&seed) >> 1;
+    skiplist_mynode_t_node_init(nodes[i], nodes[i]->tower, height);
+    skiplist_mynode_t_insert(&list, nodes[i]);
+    rbtree_mynode_t_insert(&tree, nodes[i]);
+  }
+  skiplist_mynode_t_check(&list);
+  rbtree_mynode_t_check(&tree);
+
+  printf("%d lookups in %zu keys (million lookups/sec)\n", LOOKUPS, count);
+  for (threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    double best[3] = {1e9, 1e9, 1e9};
+    size_t done;
+    int run;
+    per_thread = LOOKUPS / threads;
+    done = per_thread * threads;
+    for (run = 0; run < RUNS; run++) {
+      for (way = 0; way < 3; way++) {
+        double t;
+        atomic_store(&found, 0);
+        if ((t = pump(threads)) < best[way])
+          best[way] = t;
+        if (atomic_load(&found) != done)
+          abort();
+      }
+    }
+    printf("  %2d threads  skiplist %7.2f   rbtree+rwlock %7.2f"
+           "   rbtree unlocked %7.2f\n", threads, done / best[0] * 1e-6,
+           done / best[1] * 1e-6, done / best[2] * 1e-6);
+  }
+
+  for (i = 0; i < count; i++) {
+    skiplist_mynode_t_erase(&list, nodes[i]);
+    rbtree_mynode_t_erase(&tree, nodes[i]);
+    free(nodes[i]);
+  }
+  skiplist_mynode_t_destroy(&list);
+  rbtree_mynode_t_destroy(&tree);
+  free(nodes);
+  return 0;
+}
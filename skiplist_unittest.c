@@ -0,0 +1,287 @@
+// Unittest for skiplist (single writer, lock-free readers skip list)
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "assert.h"
+#include "skiplist.h"
+
+#define NODES 2000
+#define KEYS 500
+#define READERS 4
+// Each churn insert uses a fresh node, so no node is reused under a reader
+#define CHURN_NODES 100000
+
+typedef struct {
+  int key;
+  int seq;
+  skiplist_node_t list_data;
+  skiplist_link_t tower[SKIPLIST_MAX_HEIGHT];
+} mynode_t;
+
+int mynode_cmp(const mynode_t *a, const mynode_t *b) {
+  return a->key < b->key ? -1 : a->key > b->key;
+}
+
+DEFINE_SKIPLIST(mynode_t, list_data, mynode_cmp)
+
+// A node with a tower just big enough, allocated with it
+typedef struct {
+  int key;
+  skiplist_node_t list_data;
+  skiplist_link_t tower[];
+} smallnode_t;
+
+int smallnode_cmp(const smallnode_t *a, const smallnode_t *b) {
+  return a->key < b->key ? -1 : a->key > b->key;
+}
+
+DEFINE_SKIPLIST(smallnode_t, list_data, smallnode_cmp)
+
+skiplist_mynode_t list;
+mynode_t nodes[NODES];
+// Whether nodes[i] is in the list
+char present[NODES];
+// How many nodes with each key are in the list
+int key_count[KEYS];
+
+mynode_t churn_nodes[CHURN_NODES];
+_Atomic int done;
+
+void insert(skiplist_mynode_t *list, mynode_t *n) {
+  skiplist_mynode_t_node_init(n, n->tower,
+                              skiplist_mynode_t_random_height(list));
+  skiplist_mynode_t_insert(list, n);
+}
+
+// Asserts the list holds exactly the nodes marked in "present", in key
+// order, equal keys in insertion (seq) order
+void expect_list(skiplist_mynode_t *list) {
+  mynode_t *n;
+  mynode_t *last = NULL;
+  size_t count = 0;
+  int x;
+  skiplist_mynode_t_check(list);
+  SKIPLIST_FOREACH(mynode_t, list, n) {
+    assert(present[n - nodes]);
+    if (last && last->key == n->key)
+      assert(last->seq < n->seq);
+    last = n;
+    count++;
+  }
+  assert(count == skiplist_mynode_t_size(list));
+  for (x = 0; x < NODES; x++) {
+    if (present[x])
+      count--;
+  }
+  assert(count == 0);
+}
+
+// Even keys are always in the list, odd ones come and go. Checks every even
+// key is found, and walks see keys in order.
+void* reader(void *arg) {
+  mynode_t probe;
+  mynode_t to;
+  mynode_t *n;
+  long lookups = 0;
+  unsigned int seed = (unsigned int) (long) arg;
+  while (!atomic_load(&done) || lookups < 1000) {
+    int last = -1;
+    int count = 0;
+    probe.key = (rand_r(&seed) % KEYS) & ~1;
+    n = skiplist_mynode_t_find(&list, &probe);
+    assert(n && n->key == probe.key);
+    to.key = probe.key + 20;
+    SKIPLIST_FOREACH_RANGE(mynode_t, &list, n, &probe, &to) {
+      assert(n->key >= last);
+      assert(n->key < to.key);
+      last = n->key;
+      if (!(n->key & 1))
+        count++;
+    }
+    assert(count == (to.key > KEYS ? (KEYS - probe.key) / 2 : 10));
+    lookups++;
+  }
+  return NULL;
+}
+
+int main(unsigned int argc, char **argv) {
+  pthread_t threads[READERS];
+  mynode_t probe;
+  mynode_t to;
+  mynode_t *n;
+  int seq = 0;
+  int x;
+
+  printf("initializing list\n");
+  skiplist_mynode_t_init(&list);
+  expect_list(&list);
+  assert(!skiplist_mynode_t_first(&list));
+  probe.key = 1;
+  assert(!skiplist_mynode_t_find(&list, &probe));
+  assert(!skiplist_mynode_t_lower_bound(&list, &probe));
+
+  printf("ascending and descending inserts\n");
+  for (x = 0; x < 100; x++) {
+    nodes[x].key = x * 2;
+    nodes[x].seq = seq++;
+    insert(&list, &nodes[x]);
+    present[x] = 1;
+    skiplist_mynode_t_check(&list);
+  }
+  for (x = 199; x >= 100; x--) {
+    nodes[x].key = (x - 100) * 2 + 1;
+    nodes[x].seq = seq++;
+    insert(&list, &nodes[x]);
+    present[x] = 1;
+    skiplist_mynode_t_check(&list);
+  }
+  expect_list(&list);
+  x = 0;
+  SKIPLIST_FOREACH(mynode_t, &list, n) {
+    assert(n->key == x++);
+  }
+
+  printf("bounds\n");
+  probe.key = 10;
+  assert(skiplist_mynode_t_find(&list, &probe)->key == 10);
+  assert(skiplist_mynode_t_lower_bound(&list, &probe)->key == 10);
+  assert(skiplist_mynode_t_upper_bound(&list, &probe)->key == 11);
+  probe.key = -5;
+  assert(skiplist_mynode_t_lower_bound(&list, &probe)->key == 0);
+  probe.key = 199;
+  assert(!skiplist_mynode_t_upper_bound(&list, &probe));
+  probe.key = 500;
+  assert(!skiplist_mynode_t_lower_bound(&list, &probe));
+
+  printf("range\n");
+  probe.key = 50;
+  to.key = 60;
+  x = 50;
+  SKIPLIST_FOREACH_RANGE(mynode_t, &list, n, &probe, &to) {
+    assert(n->key == x++);
+  }
+  assert(x == 60);
+
+  printf("erase\n");
+  for (x = 0; x < 200; x++) {
+    if (nodes[x].key % 3 == 0) {
+      skiplist_mynode_t_erase(&list, &nodes[x]);
+      present[x] = 0;
+    }
+  }
+  expect_list(&list);
+  for (x = 0; x < 200; x++) {
+    if (present[x]) {
+      skiplist_mynode_t_erase(&list, &nodes[x]);
+      present[x] = 0;
+    }
+  }
+  expect_list(&list);
+
+  printf("random churn with duplicate keys\n");
+  srand(1);
+  for (x = 0; x < 50000; x++) {
+    int i = rand() % NODES;
+    if (present[i]) {
+      skiplist_mynode_t_erase(&list, &nodes[i]);
+      present[i] = 0;
+      key_count[nodes[i].key]--;
+    } else {
+      nodes[i].key = rand() % KEYS;
+      nodes[i].seq = seq++;
+      insert(&list, &nodes[i]);
+      present[i] = 1;
+      key_count[nodes[i].key]++;
+    }
+    if (x % 997 == 0)
+      expect_list(&list);
+  }
+  expect_list(&list);
+  for (x = 0; x < KEYS; x++) {
+    int count = 0;
+    probe.key = x;
+    n = skiplist_mynode_t_find(&list, &probe);
+    assert(!n == !key_count[x]);
+    for (; n && n->key == x; n = skiplist_mynode_t_next(n))
+      count++;
+    assert(count == key_count[x]);
+  }
+  for (x = 0; x < NODES; x++) {
+    if (present[x]) {
+      skiplist_mynode_t_erase(&list, &nodes[x]);
+      present[x] = 0;
+      key_count[nodes[x].key]--;
+    }
+  }
+  expect_list(&list);
+
+  printf("towers sized to their height\n");
+  {
+    skiplist_smallnode_t small;
+    smallnode_t *small_nodes[100];
+    smallnode_t *s;
+    skiplist_smallnode_t_init(&small);
+    for (x = 0; x < 100; x++) {
+      unsigned int height = skiplist_smallnode_t_random_height(&small);
+      small_nodes[x] = malloc(sizeof(smallnode_t) +
+                              height * sizeof(skiplist_link_t));
+      small_nodes[x]->key = (x * 37) % 100;
+      skiplist_smallnode_t_node_init(small_nodes[x], small_nodes[x]->tower,
+                                     height);
+      skiplist_smallnode_t_insert(&small, small_nodes[x]);
+    }
+    skiplist_smallnode_t_check(&small);
+    x = 0;
+    SKIPLIST_FOREACH(smallnode_t, &small, s) {
+      assert(s->key == x++);
+    }
+    for (x = 0; x < 100; x++) {
+      skiplist_smallnode_t_erase(&small, small_nodes[x]);
+      free(small_nodes[x]);
+    }
+    skiplist_smallnode_t_check(&small);
+    skiplist_smallnode_t_destroy(&small);
+  }
+
+  // Readers run lookups and range walks while the writer churns odd keys
+  printf("%d readers with a writer\n", READERS);
+  for (x = 0; x < KEYS; x += 2) {
+    nodes[x].key = x;
+    insert(&list, &nodes[x]);
+    present[x] = 1;
+  }
+  for (x = 0; x < READERS; x++)
+    pthread_create(&threads[x], NULL, reader, (void*) (long) x);
+  {
+    int live[KEYS] = {0};
+    for (x = 0; x < CHURN_NODES; x++) {
+      int key = (rand() % (KEYS / 2)) * 2 + 1;
+      if (live[key]) {
+        skiplist_mynode_t_erase(&list, &churn_nodes[live[key] - 1]);
+        live[key] = 0;
+      } else {
+        churn_nodes[x].key = key;
+        insert(&list, &churn_nodes[x]);
+        live[key] = x + 1;
+      }
+    }
+    atomic_store(&done, 1);
+    for (x = 0; x < READERS; x++)
+      pthread_join(threads[x], NULL);
+    for (x = 1; x < KEYS; x += 2) {
+      if (live[x])
+        skiplist_mynode_t_erase(&list, &churn_nodes[live[x] - 1]);
+    }
+  }
+  expect_list(&list);
+  for (x = 0; x < KEYS; x += 2) {
+    skiplist_mynode_t_erase(&list, &nodes[x]);
+    present[x] = 0;
+  }
+  expect_list(&list);
+  skiplist_mynode_t_destroy(&list);
+
+  printf("PASSED!\n");
+}
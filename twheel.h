@@ -0,0 +1,297 @@
+// Generic intrusive hierarchical timer wheel, built from dlist.h lists
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) declare a "node" type, with a "twheel_timer_t" as a member
+//   3) call "DEFINE_TWHEEL" with their node-type and the member name
+//   4) The user must allocate a "twheel_##type", to store the wheel, and call
+//      twheel_##type##_init() on it with the current time (in ticks)
+//   5) The user must allocate all nodes, and call
+//      twheel_##type##_timer_init() on each, before arming them
+//   6) Call twheel_##type##_advance() as time passes, it calls back for each
+//      timer that's expired
+//   7) When done with the wheel user must cancel any remaining timers and
+//      call "twheel_##type##_destroy" on it
+//
+//   See twheel_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   Time is a uint64_t count of ticks, what a tick is is up to the user.
+//   Arming an armed timer moves it to the new time. Arming a timer for now
+//   or the past makes it expire on the next tick.
+//   A timer expires on the first advance to or past its tick. It's unarmed
+//   before its callback is called, so the callback may re-arm it (for a
+//   periodic timer), or arm and cancel any other timer, including ones that
+//   expired in the same advance but haven't been called back yet.
+//   twheel_##type##_size counts the timers yet to expire, so within an
+//   advance it doesn't include those waiting for their callback.
+//   A node may be in a wheel and a dlist at once, with a member for each.
+//
+// Design Decisions:
+//   * There are TWHEEL_LEVELS (default 4) levels of TWHEEL_SLOTS (64)
+//     slots. A level 0 slot is one tick, a level 1 slot 64 ticks, and so on,
+//     so the default wheel covers 2^24 ticks. Timers further out than that
+//     sit in the last level, and are moved down when their slot comes up.
+//   * Each slot is a dlist_t, and each timer holds a dlist_node_t and a
+//     pointer to its slot, so arm and cancel are O(1), using dlist_enqueue
+//     and dlist_remove.
+//   * Each tick moves the slot that's come up in each higher level down
+//     (cascading), and the level 0 slot for the tick is moved onto the
+//     expired list whole with dlist_concat. Most timers are cancelled long
+//     before they're cascaded, so they're only ever touched twice.
+//   * Expired timers are gathered for every tick being advanced over, then
+//     the callbacks are called in one batch. That keeps the wheel consistent
+//     while callbacks run, and the callback is a plain function pointer, as
+//     in dlist_##type##_foldr.
+//   * The gathered timers wait on the wheel's own "expired" list, which
+//     their slot pointer is moved to, so cancelling or re-arming one from a
+//     callback takes it off that list like any other slot.
+//   * Advancing costs one step per tick passed, even with no timers due, so
+//     ticks should be about the resolution needed, not the clock's. An empty
+//     wheel skips straight to the new time.
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "dlist.h"
+#include "offset.h"
+#include "panic.h"
+
+#ifndef TWHEEL_H
+#define TWHEEL_H
+
+#ifndef TWHEEL_LEVELS
+#define TWHEEL_LEVELS 4
+#endif
+
+#define TWHEEL_BITS 6
+#define TWHEEL_SLOTS (1 << TWHEEL_BITS)
+#define TWHEEL_MASK (TWHEEL_SLOTS - 1)
+
+// The furthest ahead a timer can be placed directly
+#define TWHEEL_RANGE (((uint64_t) 1 << (TWHEEL_BITS * TWHEEL_LEVELS)) - 1)
+
+// ******************* typedefs ****************
+
+// User should include this as a field in their node struct
+typedef struct {
+  dlist_node_t node;
+  // The slot the timer's in, NULL if it's not armed
+  dlist_t *slot;
+  uint64_t expires;
+} twheel_timer_t;
+
+// The backend wheel, the typed wheel wraps this
+typedef struct {
+  // The last tick advanced to
+  uint64_t now;
+  // Timers in "slots", not counting "expired"
+  size_t size;
+  dlist_t slots[TWHEEL_LEVELS][TWHEEL_SLOTS];
+  // Timers that have expired, waiting for their callback
+  dlist_t expired;
+} twheel_t;
+
+// Defines the typed wheel.
+// advance moves the wheel to "now" and calls "func" on each timer that's
+// expired, in order of expiry, returning how many there were.
+#define DEFINE_TWHEEL(type, metaname)  \
+  typedef struct {  \
+    twheel_t wheel;  \
+  } twheel_##type;  \
+  void twheel_##type##_init(twheel_##type *root, uint64_t now) {  \
+    twheel_init(&root->wheel, now);  \
+  }  \
+  void twheel_##type##_destroy(twheel_##type *root) {  \
+    twheel_destroy(&root->wheel);  \
+  }  \
+  size_t twheel_##type##_size(const twheel_##type *root) {  \
+    return root->wheel.size;  \
+  }  \
+  uint64_t twheel_##type##_now(const twheel_##type *root) {  \
+    return root->wheel.now;  \
+  }  \
+  void twheel_##type##_timer_init(type *data) {  \
+    data->metaname.slot = NULL;  \
+  }  \
+  int twheel_##type##_armed(const type *data) {  \
+    return data->metaname.slot != NULL;  \
+  }  \
+  uint64_t twheel_##type##_expires(const type *data) {  \
+    return data->metaname.expires;  \
+  }  \
+  void twheel_##type##_arm(twheel_##type *root, type *data,  \
+                           uint64_t expires) {  \
+    twheel_arm(&root->wheel, &(data->metaname), expires);  \
+  }  \
+  int twheel_##type##_cancel(twheel_##type *root, type *data) {  \
+    return twheel_cancel(&root->wheel, &(data->metaname));  \
+  }  \
+  size_t twheel_##type##_advance(twheel_##type *root, uint64_t now,  \
+                                 void (*func)(type*, void*), void *arg) {  \
+    dlist_node_t *ptr;  \
+    size_t count = 0;  \
+    twheel_collect(&root->wheel, now);  \
+    while ((ptr = dlist_pop(&root->wheel.expired))) {  \
+      twheel_timer_t *timer = GET_CONTAINER(ptr, twheel_timer_t, node);  \
+      timer->slot = NULL;  \
+      count++;  \
+      (*func)(GET_CONTAINER(timer, type, metaname), arg);  \
+    }  \
+    return count;  \
+  }  \
+  void twheel_##type##_check(const twheel_##type *root) {  \
+    twheel_check(&root->wheel);  \
+  }
+
+
+// ******************* private functions ****************
+
+void twheel_init(twheel_t *root, uint64_t now) {
+  size_t level;
+  size_t slot;
+  root->now = now;
+  root->size = 0;
+  for (level = 0; level < TWHEEL_LEVELS; level++) {
+    for (slot = 0; slot < TWHEEL_SLOTS; slot++)
+      dlist_init(&root->slots[level][slot]);
+  }
+  dlist_init(&root->expired);
+}
+
+void twheel_destroy(twheel_t *root) {
+  size_t level;
+  size_t slot;
+  if (root->size) {
+    PANIC("twheel_destroy: wheel has armed timers");
+  }
+  for (level = 0; level < TWHEEL_LEVELS; level++) {
+    for (slot = 0; slot < TWHEEL_SLOTS; slot++)
+      dlist_destroy(&root->slots[level][slot]);
+  }
+  dlist_destroy(&root->expired);
+}
+
+// The level a timer "delta" ticks away belongs in
+size_t twheel_level(uint64_t delta) {
+  size_t level;
+  for (level = 0; level < TWHEEL_LEVELS - 1; level++) {
+    if (delta < (uint64_t) 1 << (TWHEEL_BITS * (level + 1)))
+      break;
+  }
+  return level;
+}
+
+// Puts "timer" in the slot for its expiry, or "earliest" if that's later.
+// Arm passes the next tick, cascading passes the tick being advanced to,
+// whose level 0 slot is yet to be collected.
+void twheel_place(twheel_t *root, twheel_timer_t *timer, uint64_t earliest) {
+  uint64_t when = timer->expires;
+  size_t level;
+  if (when < earliest)
+    when = earliest;
+  if (when - root->now > TWHEEL_RANGE)
+    when = root->now + TWHEEL_RANGE;
+  level = twheel_level(when - root->now);
+  timer->slot =
+      &root->slots[level][(when >> (TWHEEL_BITS * level)) & TWHEEL_MASK];
+  dlist_enqueue(timer->slot, &timer->node);
+}
+
+// Takes "timer" out of whichever list it's in, slots or expired
+void twheel_unlink(twheel_t *root, twheel_timer_t *timer) {
+  dlist_remove(timer->slot, &timer->node);
+  if (timer->slot != &root->expired)
+    root->size--;
+  timer->slot = NULL;
+}
+
+void twheel_arm(twheel_t *root, twheel_timer_t *timer, uint64_t expires) {
+  if (timer->slot)
+    twheel_unlink(root, timer);
+  root->size++;
+  timer->expires = expires;
+  twheel_place(root, timer, root->now + 1);
+}
+
+int twheel_cancel(twheel_t *root, twheel_timer_t *timer) {
+  if (!timer->slot)
+    return 0;
+  twheel_unlink(root, timer);
+  return 1;
+}
+
+// Advances to "now", moving every expired timer onto "expired" in order of
+// expiry. They stay armed, the typed advance unarms each as it calls back.
+void twheel_collect(twheel_t *root, uint64_t now) {
+  while (root->now < now) {
+    uint64_t tick;
+    size_t level;
+    dlist_t *slot;
+    dlist_node_t *ptr;
+    if (!root->size) {
+      root->now = now;
+      break;
+    }
+    tick = ++root->now;
+    for (level = 1; level < TWHEEL_LEVELS; level++) {
+      dlist_t cascade;
+      if (tick & (((uint64_t) 1 << (TWHEEL_BITS * level)) - 1))
+        break;
+      dlist_init(&cascade);
+      dlist_concat(&cascade,
+          &root->slots[level][(tick >> (TWHEEL_BITS * level)) & TWHEEL_MASK]);
+      while ((ptr = dlist_pop(&cascade)))
+        twheel_place(root, GET_CONTAINER(ptr, twheel_timer_t, node), tick);
+      dlist_destroy(&cascade);
+    }
+    slot = &root->slots[0][tick & TWHEEL_MASK];
+    for (ptr = slot->head; ptr; ptr = ptr->next) {
+      GET_CONTAINER(ptr, twheel_timer_t, node)->slot = &root->expired;
+      root->size--;
+    }
+    dlist_concat(&root->expired, slot);
+  }
+}
+
+// Checks every slot's list, that each timer knows its slot, and that the
+// slot is right for its expiry, then the expired list. A timer may be in a higher level than it
+// would be put in now, until it's cascaded.
+void twheel_check(const twheel_t *root) {
+  size_t level;
+  size_t slot;
+  size_t count = 0;
+  dlist_node_t *ptr;
+  for (level = 0; level < TWHEEL_LEVELS; level++) {
+    for (slot = 0; slot < TWHEEL_SLOTS; slot++) {
+      const dlist_t *list = &root->slots[level][slot];
+      dlist_check(list);
+      for (ptr = list->head; ptr; ptr = ptr->next) {
+        twheel_timer_t *timer = GET_CONTAINER(ptr, twheel_timer_t, node);
+        assert(timer->slot == list);
+        // Timers armed in the past, and ones beyond the wheel's range, are
+        // placed by an adjusted time
+        if (timer->expires > root->now && level < TWHEEL_LEVELS - 1) {
+          assert(twheel_level(timer->expires - root->now) <= level);
+          assert(((timer->expires >> (TWHEEL_BITS * level)) & TWHEEL_MASK) ==
+                 slot);
+        }
+        count++;
+      }
+    }
+  }
+  assert(count == root->size);
+  dlist_check(&root->expired);
+  for (ptr = root->expired.head; ptr; ptr = ptr->next)
+    assert(GET_CONTAINER(ptr, twheel_timer_t, node)->slot == &root->expired);
+}
+
+#endif
@@ -0,0 +1,168 @@
+// Benchmark for twheel (intrusive hierarchical timer wheel) against heap
+//
+// Usage:
+//   gcc -O2 -o twheel_bench twheel_bench.c
+//   ./twheel_bench [timers]
+// Keeps "timers" (default 1000000) timeouts armed, each for a random delay
+// of up to DELAY ticks. 9 in 10 are cancelled at a random tick before they
+// expire, as a request finishing before its timeout, and the rest expire.
+// Either way the timer is re-armed straight away for the next request. The
+// first DELAY ticks settle the mix, then the next 2 * DELAY are timed. Both
+// pay for the same list of cancels due at each tick, heap.h's remove makes
+// the heap the usual alternative.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "dlist.h"
+#include "heap.h"
+#include "twheel.h"
+
+#define RUNS 5
+#define DELAY 10000
+
+typedef struct {
+  uint64_t expires;
+  twheel_timer_t wheel_data;
+  heap_node_t heap_data;
+  dlist_node_t cancel_data;
+} mytimer_t;
+
+int mytimer_cmp(const mytimer_t *a, const mytimer_t *b) {
+  return a->expires < b->expires ? -1 : a->expires > b->expires;
+}
+
+DEFINE_TWHEEL(mytimer_t, wheel_data)
+DEFINE_HEAP(mytimer_t, heap_data, mytimer_cmp)
+DEFINE_DLIST(mytimer_t, cancel_data)
+
+twheel_mytimer_t wheel;
+heap_mytimer_t heap;
+// The timers to cancel at each tick, by tick % DELAY
+dlist_mytimer_t cancels[DELAY];
+int use_heap;
+uint64_t now;
+uint64_t seed;
+size_t expired;
+size_t cancelled;
+
+// Arms "t" for a random delay, and picks whether and when it's cancelled
+void arm(mytimer_t *t) {
+  uint64_t r = bench_rand(&seed);
+  uint64_t delay = 1 + r % DELAY;
+  t->expires = now + delay;
+  if (delay > 1 && (r >> 40) % 10) {
+    dlist_mytimer_t_pushback(
+        &cancels[(now + 1 + (r >> 20) % (delay - 1)) % DELAY], t);
+  }
+  if (use_heap)
+    heap_mytimer_t_push(&heap, t);
+  else
+    twheel_mytimer_t_arm(&wheel, t, t->expires);
+}
+
+void on_expire(mytimer_t *t, void *arg) {
+  (void) arg;
+  expired++;
+  arm(t);
+}
+
+// Runs the ticks up to "end", returning how long they took
+double run_ticks(uint64_t end) {
+  double start = bench_now();
+  while (now < end) {
+    dlist_mytimer_t *list = &cancels[++now % DELAY];
+    mytimer_t *t;
+    while ((t = dlist_mytimer_t_first(list))) {
+      dlist_mytimer_t_remove(list, t);
+      if (use_heap)
+        heap_mytimer_t_remove(&heap, t);
+      else if (!twheel_mytimer_t_cancel(&wheel, t))
+        abort();
+      cancelled++;
+      arm(t);
+    }
+    if (use_heap) {
+      while ((t = heap_mytimer_t_peek(&heap)) && t->expires <= now) {
+        heap_mytimer_t_pop(&heap);
+        on_expire(t, NULL);
+      }
+    } else {
+      twheel_mytimer_t_advance(&wheel, now, on_expire, NULL);
+    }
+  }
+  return bench_now() - start;
+}
+
+// Returns the time per timer that was cancelled or expired
+double bench(mytimer_t *timers, size_t count, heap_node_t **array,
+             double *ratio) {
+  double elapsed;
+  size_t i;
+  now = 0;
+  seed = 1;
+  twheel_mytimer_t_init(&wheel, now);
+  heap_mytimer_t_init(&heap, array, count);
+  for (i = 0; i < count; i++) {
+    twheel_mytimer_t_timer_init(&timers[i]);
+    heap_mytimer_t_node_init(&timers[i]);
+    arm(&timers[i]);
+  }
+  run_ticks(DELAY);
+  expired = 0;
+  cancelled = 0;
+  elapsed = run_ticks(3 * DELAY);
+  *ratio = (double) cancelled / (cancelled + expired);
+
+  if (use_heap) {
+    heap_mytimer_t_check(&heap);
+    if (heap_mytimer_t_size(&heap) != count)
+      abort();
+    while (heap_mytimer_t_pop(&heap))
+      ;
+  } else {
+    twheel_mytimer_t_check(&wheel);
+    if (twheel_mytimer_t_size(&wheel) != count)
+      abort();
+    for (i = 0; i < count; i++)
+      twheel_mytimer_t_cancel(&wheel, &timers[i]);
+  }
+  for (i = 0; i < DELAY; i++) {
+    mytimer_t *t;
+    while ((t = dlist_mytimer_t_first(&cancels[i])))
+      dlist_mytimer_t_remove(&cancels[i], t);
+  }
+  twheel_mytimer_t_destroy(&wheel);
+  heap_mytimer_t_destroy(&heap);
+  return elapsed / (cancelled + expired);
+}
+
+int main(int argc, char **argv) {
+  size_t count = bench_arg(argc, argv, 1, 1000000);
+  mytimer_t *timers = malloc(count * sizeof(mytimer_t));
+  heap_node_t **array = malloc(count * sizeof(heap_node_t*));
+  double best[2] = {1e9, 1e9};
+  double ratio = 0;
+  int run;
+  int i;
+
+  for (i = 0; i < DELAY; i++)
+    dlist_mytimer_t_init(&cancels[i]);
+  for (run = 0; run < RUNS; run++) {
+    for (use_heap = 0; use_heap < 2; use_heap++) {
+      double t = bench(timers, count, array, &ratio);
+      if (t < best[use_heap])
+        best[use_heap] = t;
+    }
+  }
+  printf("%zu armed timers, %.1f%% cancelled before expiry (ns/timer)\n",
+         count, ratio * 100);
+  printf("  twheel %7.1f   %d-ary heap %7.1f\n", best[0] * 1e9,
+         HEAP_ARITY, best[1] * 1e9);
+  for (i = 0; i < DELAY; i++)
+    dlist_mytimer_t_destroy(&cancels[i]);
+  free(array);
+  free(timers);
+  return 0;
+}
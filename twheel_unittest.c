@@ -0,0 +1,234 @@
+// Unittest for twheel (intrusive hierarchical timer wheel)
+
+
+#include <stdio.h>
+#include "assert.h"
+#include "twheel.h"
+
+#define TIMERS 2000
+
+typedef struct {
+  int id;
+  // How many times the timer has fired
+  int fired;
+  twheel_timer_t timer_data;
+} mytimer_t;
+
+DEFINE_TWHEEL(mytimer_t, timer_data)
+
+twheel_mytimer_t wheel;
+mytimer_t timers[TIMERS];
+
+// The time before the advance in progress
+uint64_t last_now;
+// The expiry of the last timer fired in this advance
+uint64_t last_expires;
+
+// Checks each timer fires on the first advance past its expiry, in order.
+// "arg" is non-NULL if timers may have been armed in the past.
+void on_expire(mytimer_t *t, void *arg) {
+  uint64_t now = twheel_mytimer_t_now(&wheel);
+  uint64_t expires = twheel_mytimer_t_expires(t);
+  assert(!twheel_mytimer_t_armed(t));
+  assert(expires <= now);
+  assert(expires > last_now || arg);
+  assert(expires >= last_expires || arg);
+  last_expires = expires;
+  t->fired++;
+}
+
+// Re-arms each timer "period" ticks after it was due
+void on_expire_periodic(mytimer_t *t, void *arg) {
+  uint64_t period = *(uint64_t*) arg;
+  on_expire(t, NULL);
+  twheel_mytimer_t_arm(&wheel, t, twheel_mytimer_t_expires(t) + period);
+}
+
+// The first of a batch of timers 0-9 to be called back, -1 before then
+int batch_first = -1;
+
+// Cancels the rest of the batch from the first callback, re-arming the odd
+// ones for later. They've all expired, but not all been called back yet.
+void on_expire_batch(mytimer_t *t, void *arg) {
+  int x;
+  on_expire(t, arg);
+  assert(batch_first < 0);
+  batch_first = t->id;
+  for (x = 0; x < 10; x++) {
+    if (x == t->id)
+      continue;
+    assert(twheel_mytimer_t_armed(&timers[x]));
+    if (x % 2)
+      twheel_mytimer_t_arm(&wheel, &timers[x], twheel_mytimer_t_now(&wheel) + 10);
+    else
+      assert(twheel_mytimer_t_cancel(&wheel, &timers[x]));
+  }
+}
+
+size_t advance(uint64_t now, void (*func)(mytimer_t*, void*), void *arg) {
+  size_t count;
+  last_now = twheel_mytimer_t_now(&wheel);
+  last_expires = 0;
+  count = twheel_mytimer_t_advance(&wheel, now, func, arg);
+  assert(twheel_mytimer_t_now(&wheel) == now);
+  twheel_mytimer_t_check(&wheel);
+  return count;
+}
+
+// Asserts no armed timer is overdue, and the wheel counts them all
+void expect_wheel(twheel_mytimer_t *wheel) {
+  size_t count = 0;
+  int x;
+  twheel_mytimer_t_check(wheel);
+  for (x = 0; x < TIMERS; x++) {
+    if (!twheel_mytimer_t_armed(&timers[x]))
+      continue;
+    assert(twheel_mytimer_t_expires(&timers[x]) > twheel_mytimer_t_now(wheel));
+    count++;
+  }
+  assert(count == twheel_mytimer_t_size(wheel));
+}
+
+void reset_fired() {
+  int x;
+  for (x = 0; x < TIMERS; x++)
+    timers[x].fired = 0;
+}
+
+int main(unsigned int argc, char **argv) {
+  uint64_t period;
+  uint64_t start;
+  int x;
+
+  for (x = 0; x < TIMERS; x++) {
+    timers[x].id = x;
+    twheel_mytimer_t_timer_init(&timers[x]);
+  }
+
+  printf("initializing wheel\n");
+  twheel_mytimer_t_init(&wheel, 1000);
+  expect_wheel(&wheel);
+  assert(advance(2000, on_expire, NULL) == 0);
+
+  printf("one timer per level\n");
+  twheel_mytimer_t_arm(&wheel, &timers[0], 2010);
+  twheel_mytimer_t_arm(&wheel, &timers[1], 2000 + 1000);
+  twheel_mytimer_t_arm(&wheel, &timers[2], 2000 + 100000);
+  twheel_mytimer_t_arm(&wheel, &timers[3], 2000 + 5000000);
+  expect_wheel(&wheel);
+  assert(advance(2009, on_expire, NULL) == 0);
+  assert(advance(2010, on_expire, NULL) == 1);
+  assert(timers[0].fired == 1);
+  assert(advance(2999, on_expire, NULL) == 0);
+  assert(advance(3000, on_expire, NULL) == 1);
+  assert(timers[1].fired == 1);
+  assert(advance(101999, on_expire, NULL) == 0);
+  expect_wheel(&wheel);
+  assert(advance(102000, on_expire, NULL) == 1);
+  assert(timers[2].fired == 1);
+  assert(advance(5001999, on_expire, NULL) == 0);
+  assert(advance(5002000, on_expire, NULL) == 1);
+  assert(timers[3].fired == 1);
+  expect_wheel(&wheel);
+  reset_fired();
+
+  printf("arm in the past, re-arm and cancel\n");
+  twheel_mytimer_t_arm(&wheel, &timers[0], 5);
+  twheel_mytimer_t_arm(&wheel, &timers[1], twheel_mytimer_t_now(&wheel));
+  twheel_mytimer_t_arm(&wheel, &timers[2], twheel_mytimer_t_now(&wheel) + 10);
+  twheel_mytimer_t_arm(&wheel, &timers[2], twheel_mytimer_t_now(&wheel) + 500);
+  twheel_mytimer_t_arm(&wheel, &timers[3], twheel_mytimer_t_now(&wheel) + 10);
+  twheel_mytimer_t_check(&wheel);
+  assert(twheel_mytimer_t_size(&wheel) == 4);
+  assert(twheel_mytimer_t_cancel(&wheel, &timers[3]));
+  assert(!twheel_mytimer_t_cancel(&wheel, &timers[3]));
+  assert(twheel_mytimer_t_size(&wheel) == 3);
+  // Past timers fire on the next tick, though they're "late"
+  assert(advance(twheel_mytimer_t_now(&wheel) + 1, on_expire, (void*) 1) == 2);
+  assert(advance(twheel_mytimer_t_now(&wheel) + 499, on_expire, NULL) == 1);
+  assert(timers[2].fired == 1);
+  assert(!timers[3].fired);
+  expect_wheel(&wheel);
+  reset_fired();
+
+  printf("cancel and re-arm from a callback\n");
+  start = twheel_mytimer_t_now(&wheel);
+  for (x = 0; x < 10; x++)
+    twheel_mytimer_t_arm(&wheel, &timers[x], start + 5);
+  assert(advance(start + 5, on_expire_batch, NULL) == 1);
+  assert(batch_first >= 0);
+  assert(twheel_mytimer_t_size(&wheel) == (size_t) (5 - batch_first % 2));
+  expect_wheel(&wheel);
+  assert(advance(start + 15, on_expire, NULL) ==
+         (size_t) (5 - batch_first % 2));
+  for (x = 0; x < 10; x++)
+    assert(timers[x].fired == (x == batch_first || x % 2));
+  expect_wheel(&wheel);
+  reset_fired();
+  // The wheel is empty again, so this skips straight there, rather than
+  // stepping through 2^40 ticks
+  assert(advance(twheel_mytimer_t_now(&wheel) + ((uint64_t) 1 << 40),
+                 on_expire, NULL) == 0);
+
+  printf("beyond the wheel's range\n");
+  twheel_mytimer_t_arm(&wheel, &timers[0],
+                       twheel_mytimer_t_now(&wheel) + TWHEEL_RANGE + 12345);
+  twheel_mytimer_t_arm(&wheel, &timers[1],
+                       twheel_mytimer_t_now(&wheel) + TWHEEL_RANGE);
+  assert(advance(twheel_mytimer_t_now(&wheel) + TWHEEL_RANGE, on_expire,
+                 NULL) == 1);
+  assert(timers[1].fired == 1);
+  assert(advance(twheel_mytimer_t_now(&wheel) + 12344, on_expire, NULL) == 0);
+  assert(advance(twheel_mytimer_t_now(&wheel) + 1, on_expire, NULL) == 1);
+  assert(timers[0].fired == 1);
+  expect_wheel(&wheel);
+  reset_fired();
+
+  printf("periodic timers\n");
+  // Callbacks are batched, so a timer fires at most once per advance
+  period = 7;
+  start = twheel_mytimer_t_now(&wheel);
+  for (x = 0; x < 10; x++)
+    twheel_mytimer_t_arm(&wheel, &timers[x], start + 1 + x);
+  while (twheel_mytimer_t_now(&wheel) < start + 700)
+    advance(twheel_mytimer_t_now(&wheel) + 1, on_expire_periodic, &period);
+  for (x = 0; x < 10; x++) {
+    assert(timers[x].fired == 1 + (699 - x) / 7);
+    assert(twheel_mytimer_t_cancel(&wheel, &timers[x]));
+  }
+  expect_wheel(&wheel);
+  reset_fired();
+
+  printf("random churn, most timers cancelled\n");
+  srand(1);
+  for (x = 0; x < 200000; x++) {
+    int i = rand() % TIMERS;
+    uint64_t now = twheel_mytimer_t_now(&wheel);
+    switch (rand() % 10) {
+      case 0:
+        advance(now + rand() % 300, on_expire, NULL);
+        break;
+      case 1:
+      case 2:
+      case 3:
+        twheel_mytimer_t_cancel(&wheel, &timers[i]);
+        break;
+      default:
+        // Mostly near, sometimes far
+        if (rand() % 10)
+          twheel_mytimer_t_arm(&wheel, &timers[i], now + 1 + rand() % 1000);
+        else
+          twheel_mytimer_t_arm(&wheel, &timers[i], now + 1 + rand() % 300000);
+        break;
+    }
+    if (x % 997 == 0)
+      expect_wheel(&wheel);
+  }
+  expect_wheel(&wheel);
+  advance(twheel_mytimer_t_now(&wheel) + 300001, on_expire, NULL);
+  assert(twheel_mytimer_t_size(&wheel) == 0);
+  expect_wheel(&wheel);
+  twheel_mytimer_t_destroy(&wheel);
+
+  printf("PASSED!\n");
+}
@@ -0,0 +1,450 @@
+// Unrolled doubly-linked list of values
+//
+// Usage:
+//   The user should
+//   1) include this header
+//   2) call "DEFINE_ULIST" with the type they want to store (by value)
+//   3) allocate a "ulist_##type" and an array of "ulist_block_##type" to back
+//      it, and call ulist_##type##_init() with them
+//   4) When done with the list, empty it (ulist_##type##_clear() will do),
+//      then call "ulist_##type##_destroy". The blocks may then be reused.
+//
+//   See ulist_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   Blocks come from the array handed to init, so inserts return 0 when
+//   they've all been used.
+//   Unlike dlist.h this is not intrusive, values are copied in and out. It's
+//   meant for small payloads (ints, pointers) where a dlist_node_t per item
+//   would cost more than the item.
+//   Pointers from ulist_##type##_at() and ULIST_FOREACH are only good until
+//   the next insert or remove.
+//
+// Design Decisions:
+//   * Each block holds up to ULIST_CAPACITY(type) values in an array, plus
+//     one next/prev pair, sized to fit ULIST_BLOCK_BYTES (a cache line by
+//     default). A scan then misses once per block rather than once per item.
+//   * Values are packed at the front of each block. Inserting or removing
+//     shifts the rest of that block, which is at most a cache line of data.
+//   * A full block is split in half to insert into it. Pushing onto a full
+//     end block starts a new block instead, so lists built by pushing are
+//     packed full.
+//   * An emptied block is freed, and a block is merged into its neighbour
+//     when they fit in one block, so the list stays reasonably dense.
+//   * Blocks are allocated from a pool.h pool over the user's array.
+//   * Positional operations walk the blocks, so they're O(n / capacity).
+//   * As with dlist.h, macros write a typesafe interface over shared backend
+//     functions. The backend works on untyped slots and the typed wrapper
+//     does the copy, so it's a plain assignment.
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include "offset.h"
+#include "panic.h"
+#include "pool.h"
+
+#ifndef ULIST_H
+#define ULIST_H
+
+#ifndef ULIST_BLOCK_BYTES
+#define ULIST_BLOCK_BYTES 64
+#endif
+
+// ******************* typedefs ****************
+
+// The header at the start of every block
+typedef struct ulist_block_struct {
+  struct ulist_block_struct *next;
+  struct ulist_block_struct *prev;
+  size_t count;
+} ulist_block_t;
+
+// The backend list, the typed list wraps this
+typedef struct {
+  ulist_block_t *head;
+  ulist_block_t *tail;
+  size_t size;
+  size_t elemoff;
+  size_t elemsize;
+  size_t capacity;
+  pool_t blocks;
+} ulist_t;
+
+// Number of values per block, as many as fit in ULIST_BLOCK_BYTES, but at
+// least 2 (a block must split into two non-full halves).
+#define ULIST_CAPACITY(type)  \
+  ((ULIST_BLOCK_BYTES - sizeof(ulist_block_t)) / sizeof(type) >= 2 ?  \
+   (ULIST_BLOCK_BYTES - sizeof(ulist_block_t)) / sizeof(type) : 2)
+
+#define DEFINE_ULIST(type)  \
+  typedef struct {  \
+    ulist_block_t hdr;  \
+    type elems[ULIST_CAPACITY(type)];  \
+  } ulist_block_##type;  \
+  typedef struct {  \
+    ulist_t list;  \
+  } ulist_##type;  \
+  typedef struct {  \
+    ulist_block_##type *block;  \
+    type *ptr;  \
+    type *end;  \
+  } ulist_##type##_iter;  \
+  void ulist_##type##_init(ulist_##type *root, ulist_block_##type *blocks,  \
+                           size_t count) {  \
+    ulist_init(&root->list, blocks, sizeof(ulist_block_##type), count,  \
+               OFFSET(ulist_block_##type, elems), sizeof(type),  \
+               ULIST_CAPACITY(type));  \
+  }  \
+  void ulist_##type##_destroy(ulist_##type *root) {  \
+    ulist_destroy(&root->list);  \
+  }  \
+  void ulist_##type##_check(const ulist_##type *root) {  \
+    ulist_check(&root->list);  \
+  }  \
+  void ulist_##type##_clear(ulist_##type *root) {  \
+    ulist_clear(&root->list);  \
+  }  \
+  int ulist_##type##_empty(const ulist_##type *root) {  \
+    return !root->list.size;  \
+  }  \
+  size_t ulist_##type##_size(const ulist_##type *root) {  \
+    return root->list.size;  \
+  }  \
+  int ulist_##type##_enqueue(ulist_##type *root, type data) {  \
+    type *slot = (type*) ulist_enqueue(&root->list);  \
+    if (!slot)  \
+      return 0;  \
+    *slot = data;  \
+    return 1;  \
+  }  \
+  int ulist_##type##_pushback(ulist_##type *root, type data) {  \
+    type *slot = (type*) ulist_pushback(&root->list);  \
+    if (!slot)  \
+      return 0;  \
+    *slot = data;  \
+    return 1;  \
+  }  \
+  int ulist_##type##_push(ulist_##type *root, type data) {  \
+    return ulist_##type##_enqueue(root, data);  \
+  }  \
+  int ulist_##type##_pop(ulist_##type *root, type *out) {  \
+    return ulist_pop(&root->list, out);  \
+  }  \
+  int ulist_##type##_dequeue(ulist_##type *root, type *out) {  \
+    return ulist_dequeue(&root->list, out);  \
+  }  \
+  int ulist_##type##_insert(ulist_##type *root, size_t index, type data) {  \
+    type *slot = (type*) ulist_insert(&root->list, index);  \
+    if (!slot)  \
+      return 0;  \
+    *slot = data;  \
+    return 1;  \
+  }  \
+  void ulist_##type##_erase(ulist_##type *root, size_t index) {  \
+    ulist_erase(&root->list, index);  \
+  }  \
+  type * ulist_##type##_at(const ulist_##type *root, size_t index) {  \
+    return (type*) ulist_at(&root->list, index);  \
+  }  \
+  ulist_##type##_iter ulist_##type##_iter_first(const ulist_##type *root) {  \
+    ulist_##type##_iter it;  \
+    it.block = (ulist_block_##type*) root->list.head;  \
+    it.ptr = it.block ? it.block->elems : NULL;  \
+    it.end = it.block ? it.block->elems + it.block->hdr.count : NULL;  \
+    return it;  \
+  }  \
+  ulist_##type##_iter ulist_##type##_iter_last(const ulist_##type *root) {  \
+    ulist_##type##_iter it;  \
+    it.block = (ulist_block_##type*) root->list.tail;  \
+    it.ptr = it.block ? it.block->elems + it.block->hdr.count : NULL;  \
+    it.end = it.block ? it.block->elems : NULL;  \
+    return it;  \
+  }  \
+  int ulist_##type##_iter_next_block(ulist_##type##_iter *it) {  \
+    if (!it->block || !it->block->hdr.next)  \
+      return 0;  \
+    it->block = (ulist_block_##type*) it->block->hdr.next;  \
+    it->ptr = it->block->elems;  \
+    it->end = it->block->elems + it->block->hdr.count;  \
+    return 1;  \
+  }  \
+  int ulist_##type##_iter_prev_block(ulist_##type##_iter *it) {  \
+    if (!it->block || !it->block->hdr.prev)  \
+      return 0;  \
+    it->block = (ulist_block_##type*) it->block->hdr.prev;  \
+    it->ptr = it->block->elems + it->block->hdr.count;  \
+    it->end = it->block->elems;  \
+    return 1;  \
+  }
+
+// Inline iteration, the body is the statement following the macro.
+//   type - the type given to DEFINE_ULIST
+//   root - pointer to the list
+//   var  - a "type *" that is set to each value in turn, it must be a plain
+//          identifier (it's used to name the loop's iterator)
+// The inner step is a pointer compare and increment, the block is only
+// looked at once its values run out.
+// The body may change the values, but must not insert or remove.
+#define ULIST_FOREACH(type, root, var)  \
+  for (ulist_##type##_iter ulist_it_##var = ulist_##type##_iter_first(root);  \
+       (ulist_it_##var.ptr != ulist_it_##var.end ||  \
+        ulist_##type##_iter_next_block(&ulist_it_##var)) &&  \
+       (((var) = ulist_it_##var.ptr), 1);  \
+       ulist_it_##var.ptr++)
+
+// As ULIST_FOREACH, but from tail to head
+#define ULIST_FOREACH_REVERSE(type, root, var)  \
+  for (ulist_##type##_iter ulist_it_##var = ulist_##type##_iter_last(root);  \
+       (ulist_it_##var.ptr != ulist_it_##var.end ||  \
+        ulist_##type##_iter_prev_block(&ulist_it_##var)) &&  \
+       (((var) = ulist_it_##var.ptr - 1), 1);  \
+       ulist_it_##var.ptr--)
+
+
+// ******************* private functions ****************
+
+char * ulist_slot(const ulist_t *root, ulist_block_t *block, size_t index) {
+  return (char*) block + root->elemoff + index * root->elemsize;
+}
+
+// "buffer" holds "count" blocks of "blocksize" bytes, each a ulist_block_t
+// followed (at "elemoff") by room for "capacity" values of "elemsize" bytes
+void ulist_init(ulist_t *root, void *buffer, size_t blocksize, size_t count,
+                size_t elemoff, size_t elemsize, size_t capacity) {
+  assert(capacity >= 2);
+  assert(elemoff + capacity * elemsize <= blocksize);
+  root->head = NULL;
+  root->tail = NULL;
+  root->size = 0;
+  root->elemoff = elemoff;
+  root->elemsize = elemsize;
+  root->capacity = capacity;
+  pool_init(&root->blocks, buffer, blocksize, count);
+}
+
+void ulist_destroy(ulist_t *root) {
+  if (root->size) {
+    PANIC("ulist_destroy: list is non-empty");
+  }
+  pool_destroy(&root->blocks);
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->head = (ulist_block_t*) 0xdeadbeef;
+  root->tail = (ulist_block_t*) 0xdeadbeef;
+}
+
+// Drops every value, returning all blocks to the pool
+void ulist_clear(ulist_t *root) {
+  ulist_block_t *block = root->head;
+  while (block) {
+    ulist_block_t *next = block->next;
+    pool_free(&root->blocks, block);
+    block = next;
+  }
+  root->head = NULL;
+  root->tail = NULL;
+  root->size = 0;
+}
+
+// Allocates an empty block and links it in after "prev" (at the head if
+// "prev" is NULL). Returns NULL if we're out of blocks.
+ulist_block_t * ulist_new_block(ulist_t *root, ulist_block_t *prev) {
+  ulist_block_t *block = (ulist_block_t*) pool_alloc(&root->blocks);
+  if (!block)
+    return NULL;
+  block->count = 0;
+  block->prev = prev;
+  block->next = prev ? prev->next : root->head;
+  if (prev)
+    prev->next = block;
+  else
+    root->head = block;
+  if (block->next)
+    block->next->prev = block;
+  else
+    root->tail = block;
+  return block;
+}
+
+void ulist_free_block(ulist_t *root, ulist_block_t *block) {
+  if (block->prev)
+    block->prev->next = block->next;
+  else
+    root->head = block->next;
+  if (block->next)
+    block->next->prev = block->prev;
+  else
+    root->tail = block->prev;
+  pool_free(&root->blocks, block);
+}
+
+// Opens a gap at "index" in "block", which must not be full, and returns it
+void * ulist_open_slot(ulist_t *root, ulist_block_t *block, size_t index) {
+  char *slot = ulist_slot(root, block, index);
+  assert(block->count < root->capacity);
+  assert(index <= block->count);
+  memmove(slot + root->elemsize, slot, (block->count - index) * root->elemsize);
+  block->count++;
+  root->size++;
+  return slot;
+}
+
+// Removes the value at "index" in "block", copying it to "out" if non-NULL.
+// Frees the block if that empties it, otherwise merges it with a neighbour
+// if the two fit in one block.
+void ulist_close_slot(ulist_t *root, ulist_block_t *block, size_t index,
+                      void *out) {
+  char *slot = ulist_slot(root, block, index);
+  assert(index < block->count);
+  if (out)
+    memcpy(out, slot, root->elemsize);
+  block->count--;
+  root->size--;
+  memmove(slot, slot + root->elemsize, (block->count - index) * root->elemsize);
+
+  if (!block->count) {
+    ulist_free_block(root, block);
+    return;
+  }
+  if (block->prev && block->prev->count + block->count <= root->capacity)
+    block = block->prev;
+  else if (!block->next || block->count + block->next->count > root->capacity)
+    return;
+  memcpy(ulist_slot(root, block, block->count),
+         ulist_slot(root, block->next, 0),
+         block->next->count * root->elemsize);
+  block->count += block->next->count;
+  ulist_free_block(root, block->next);
+}
+
+// Finds the block holding position "*index", and makes "*index" relative to
+// it. A position just past the end of a block is found in that block, so
+// only an empty list returns NULL.
+ulist_block_t * ulist_find(const ulist_t *root, size_t *index) {
+  ulist_block_t *block = root->head;
+  while (block && *index > block->count) {
+    *index -= block->count;
+    block = block->next;
+  }
+  return block;
+}
+
+// The functions returning "void *" return the slot the new value goes in, or
+// NULL if we're out of blocks. The typed interface stores the value there.
+
+void * ulist_enqueue(ulist_t *root) {
+  ulist_block_t *block = root->head;
+  if (!block || block->count == root->capacity)
+    block = ulist_new_block(root, NULL);
+  if (!block)
+    return NULL;
+  return ulist_open_slot(root, block, 0);
+}
+
+void * ulist_pushback(ulist_t *root) {
+  ulist_block_t *block = root->tail;
+  if (!block || block->count == root->capacity)
+    block = ulist_new_block(root, root->tail);
+  if (!block)
+    return NULL;
+  return ulist_open_slot(root, block, block->count);
+}
+
+void * ulist_push(ulist_t *root) {
+  return ulist_enqueue(root);
+}
+
+// Removes the head value, copying it to "out" if non-NULL.
+// Returns 0 if the list is empty.
+int ulist_pop(ulist_t *root, void *out) {
+  if (!root->head)
+    return 0;
+  ulist_close_slot(root, root->head, 0, out);
+  return 1;
+}
+
+// As ulist_pop, but from the tail
+int ulist_dequeue(ulist_t *root, void *out) {
+  if (!root->tail)
+    return 0;
+  ulist_close_slot(root, root->tail, root->tail->count - 1, out);
+  return 1;
+}
+
+// Makes room for a value at position "index" (0 <= index <= size), moving
+// everything from "index" on back by one
+void * ulist_insert(ulist_t *root, size_t index) {
+  assert(index <= root->size);
+  ulist_block_t *block = ulist_find(root, &index);
+  if (!block)
+    return ulist_pushback(root);
+  if (block->count == root->capacity) {
+    // Split, moving the back half into a new block
+    ulist_block_t *next = ulist_new_block(root, block);
+    size_t keep = root->capacity / 2;
+    if (!next)
+      return NULL;
+    next->count = block->count - keep;
+    memcpy(ulist_slot(root, next, 0), ulist_slot(root, block, keep),
+           next->count * root->elemsize);
+    block->count = keep;
+    if (index > keep) {
+      block = next;
+      index -= keep;
+    }
+  }
+  return ulist_open_slot(root, block, index);
+}
+
+// Removes the value at position "index" (0 <= index < size)
+void ulist_erase(ulist_t *root, size_t index) {
+  assert(index < root->size);
+  ulist_block_t *block = ulist_find(root, &index);
+  if (index == block->count) {
+    block = block->next;
+    index = 0;
+  }
+  ulist_close_slot(root, block, index, NULL);
+}
+
+// Returns the value at position "index", or NULL if it's past the end
+void * ulist_at(const ulist_t *root, size_t index) {
+  if (index >= root->size)
+    return NULL;
+  ulist_block_t *block = ulist_find(root, &index);
+  if (index == block->count) {
+    block = block->next;
+    index = 0;
+  }
+  return ulist_slot(root, block, index);
+}
+
+// Checks the links, that no block is empty or overfull, and that the size
+// and the pool agree with the blocks
+void ulist_check(const ulist_t *root) {
+  const ulist_block_t *block;
+  const ulist_block_t *last_block = NULL;
+  size_t size = 0;
+  size_t nblocks = 0;
+  for (block = root->head; block; block = block->next) {
+    assert(block->prev == last_block);
+    assert(block->count);
+    assert(block->count <= root->capacity);
+    size += block->count;
+    nblocks++;
+    last_block = block;
+  }
+  assert(root->tail == last_block);
+  assert(size == root->size);
+  pool_check(&root->blocks);
+  assert(nblocks + pool_available(&root->blocks) == root->blocks.count);
+}
+
+#endif
@@ -0,0 +1,138 @@
+// Benchmark for ulist (unrolled doubly-linked list) against dlist
+//
+// Usage:
+//   gcc -O2 -o ulist_bench ulist_bench.c
+//   ./ulist_bench [largest]
+// Scans lists of 1000 and 1000000 ints, and "largest", which defaults to
+// 10000000. 100000000 needs about 4GB of memory, for the dlist nodes and
+// the shuffle.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "dlist.h"
+#include "ulist.h"
+
+#define RUNS 5
+
+typedef struct {
+  dlist_node_t list_data;
+  int data;
+} mynode_t;
+
+DEFINE_DLIST(mynode_t, list_data)
+DEFINE_ULIST(int)
+
+// Scans are repeated until about this many ints have been summed, so the
+// small lists take long enough to time
+#define SCAN_TOTAL 100000000
+
+void best_of(double *best, double t) {
+  if (t < *best)
+    *best = t;
+}
+
+void bench_ulist(size_t count, size_t repeat) {
+  size_t nblocks = count / ULIST_CAPACITY(int) + 1;
+  ulist_block_int *blocks = malloc(nblocks * sizeof(ulist_block_int));
+  ulist_int list;
+  double best = 1e9;
+  long expect = 0;
+  size_t i;
+  int run;
+
+  ulist_int_init(&list, blocks, nblocks);
+  for (i = 0; i < count; i++) {
+    if (!ulist_int_pushback(&list, (int) i))
+      abort();
+    expect += (int) i;
+  }
+  for (run = 0; run < RUNS; run++) {
+    double start = bench_now();
+    size_t r;
+    for (r = 0; r < repeat; r++) {
+      long sum = 0;
+      int *v;
+      ULIST_FOREACH(int, &list, v) {
+        sum += *v;
+      }
+      if (sum != expect)
+        abort();
+    }
+    best_of(&best, bench_now() - start);
+  }
+  printf("  %10zu ints  ulist            %6.2f ns/int  %5.1f bytes/int\n",
+         count, best * 1e9 / (count * repeat),
+         (double) sizeof(ulist_block_int) / ULIST_CAPACITY(int));
+  ulist_int_clear(&list);
+  ulist_int_destroy(&list);
+  free(blocks);
+}
+
+// Nodes come from one array, linked in array order, or shuffled so each
+// hop is to a random address, as with nodes malloc'd at different times
+void bench_dlist(size_t count, size_t repeat, int shuffle) {
+  mynode_t *nodes = malloc(count * sizeof(mynode_t));
+  dlist_mynode_t list;
+  double best = 1e9;
+  long expect = 0;
+  uint64_t seed = 1;
+  size_t i;
+  int run;
+
+  dlist_mynode_t_init(&list);
+  if (shuffle) {
+    mynode_t **order = malloc(count * sizeof(mynode_t*));
+    for (i = 0; i < count; i++)
+      order[i] = &nodes[i];
+    bench_shuffle((void**) order, count, &seed);
+    for (i = 0; i < count; i++)
+      dlist_mynode_t_pushback(&list, order[i]);
+    free(order);
+  } else {
+    for (i = 0; i < count; i++)
+      dlist_mynode_t_pushback(&list, &nodes[i]);
+  }
+  for (i = 0; i < count; i++) {
+    nodes[i].data = (int) i;
+    expect += (int) i;
+  }
+  for (run = 0; run < RUNS; run++) {
+    double start = bench_now();
+    size_t r;
+    for (r = 0; r < repeat; r++) {
+      long sum = 0;
+      mynode_t *n;
+      DLIST_FOREACH(mynode_t, &list, n) {
+        sum += n->data;
+      }
+      if (sum != expect)
+        abort();
+    }
+    best_of(&best, bench_now() - start);
+  }
+  printf("  %10zu ints  dlist %-10s %6.2f ns/int  %5.1f bytes/int\n",
+         count, shuffle ? "shuffled" : "in order",
+         best * 1e9 / (count * repeat), (double) sizeof(mynode_t));
+  dlist_mynode_t_init(&list);
+  dlist_mynode_t_destroy(&list);
+  free(nodes);
+}
+
+int main(int argc, char **argv) {
+  size_t sizes[3] = {1000, 1000000, 0};
+  int x;
+
+  sizes[2] = bench_arg(argc, argv, 1, 10000000);
+  printf("sum a list of ints, %d per ulist block\n", (int) ULIST_CAPACITY(int));
+  for (x = 0; x < 3; x++) {
+    size_t repeat = sizes[x] < SCAN_TOTAL ? SCAN_TOTAL / sizes[x] : 1;
+    // A shuffled scan of a big list misses on every node, so fewer repeats
+    size_t shuffled = repeat / 10 ? repeat / 10 : 1;
+    bench_ulist(sizes[x], repeat);
+    bench_dlist(sizes[x], repeat, 0);
+    bench_dlist(sizes[x], sizes[x] < 100000 ? repeat : shuffled, 1);
+  }
+  return 0;
+}
@@ -0,0 +1,201 @@
+// Unittest for ulist (unrolled doubly linked list)
+
+
+#include <stdio.h>
+#include "assert.h"
+#include "ulist.h"
+
+#define NBLOCKS 64
+#define CHURN_SIZE 200
+
+DEFINE_ULIST(int)
+
+#define MAX_SIZE (NBLOCKS * ULIST_CAPACITY(int))
+
+// A type too big for more than one per cache line, capacity is still 2
+typedef struct {
+  long data[12];
+} bignode_t;
+
+DEFINE_ULIST(bignode_t)
+
+ulist_block_int blocks[NBLOCKS];
+ulist_int list;
+
+ulist_block_bignode_t big_blocks[4];
+ulist_bignode_t big_list;
+
+// The list we expect, kept as a plain array
+int model[MAX_SIZE];
+int model_size;
+
+// Asserts "list" holds exactly "model", in order, and is well formed
+void expect_list(ulist_int *list) {
+  int *v;
+  int i = 0;
+  ulist_int_check(list);
+  assert(ulist_int_size(list) == (size_t) model_size);
+  assert(ulist_int_empty(list) == (model_size == 0));
+  ULIST_FOREACH(int, list, v) {
+    assert(i < model_size);
+    assert(*v == model[i]);
+    i++;
+  }
+  assert(i == model_size);
+  ULIST_FOREACH_REVERSE(int, list, v) {
+    i--;
+    assert(*v == model[i]);
+  }
+  assert(i == 0);
+  for (i = 0; i < model_size; i++)
+    assert(*ulist_int_at(list, i) == model[i]);
+  assert(!ulist_int_at(list, model_size));
+}
+
+void model_insert(int index, int value) {
+  memmove(&model[index + 1], &model[index], (model_size - index) * sizeof(int));
+  model[index] = value;
+  model_size++;
+}
+
+void model_erase(int index) {
+  model_size--;
+  memmove(&model[index], &model[index + 1], (model_size - index) * sizeof(int));
+}
+
+int main(unsigned int argc, char **argv) {
+  int x;
+  int v;
+  int round;
+
+  printf("capacity is %d ints per block\n", (int) ULIST_CAPACITY(int));
+  assert(ULIST_CAPACITY(int) >= 2);
+  assert(ULIST_CAPACITY(bignode_t) == 2);
+
+  printf("initializing list\n");
+  ulist_int_init(&list, blocks, NBLOCKS);
+  expect_list(&list);
+  assert(!ulist_int_pop(&list, &v));
+  assert(!ulist_int_dequeue(&list, &v));
+
+  printf("pushback and enqueue\n");
+  for (x = 0; x < 40; x++) {
+    assert(ulist_int_pushback(&list, x));
+    model_insert(model_size, x);
+    assert(ulist_int_enqueue(&list, -x));
+    model_insert(0, -x);
+  }
+  expect_list(&list);
+
+  printf("pop and dequeue\n");
+  for (x = 0; x < 30; x++) {
+    assert(ulist_int_pop(&list, &v));
+    assert(v == model[0]);
+    model_erase(0);
+    assert(ulist_int_dequeue(&list, &v));
+    assert(v == model[model_size - 1]);
+    model_erase(model_size - 1);
+  }
+  expect_list(&list);
+
+  printf("positional insert and erase\n");
+  for (x = 0; x < 100; x++) {
+    int index = (x * 7) % (model_size + 1);
+    assert(ulist_int_insert(&list, index, 1000 + x));
+    model_insert(index, 1000 + x);
+    expect_list(&list);
+  }
+  for (x = 0; x < 90; x++) {
+    int index = (x * 13) % model_size;
+    ulist_int_erase(&list, index);
+    model_erase(index);
+    expect_list(&list);
+  }
+
+  printf("random churn\n");
+  srand(1);
+  for (round = 0; round < 20000; round++) {
+    int op = rand() % 6;
+    int index = rand() % (model_size + 1);
+    if (model_size >= CHURN_SIZE || (model_size && op >= 3)) {
+      if (index == model_size)
+        index--;
+      if (op == 3 && ulist_int_pop(&list, &v)) {
+        assert(v == model[0]);
+        model_erase(0);
+      } else if (op == 4 && ulist_int_dequeue(&list, &v)) {
+        assert(v == model[model_size - 1]);
+        model_erase(model_size - 1);
+      } else {
+        ulist_int_erase(&list, index);
+        model_erase(index);
+      }
+    } else if (op == 0) {
+      if (ulist_int_enqueue(&list, round))
+        model_insert(0, round);
+    } else if (op == 1) {
+      if (ulist_int_pushback(&list, round))
+        model_insert(model_size, round);
+    } else {
+      if (ulist_int_insert(&list, index, round))
+        model_insert(index, round);
+    }
+    if (round % 97 == 0)
+      expect_list(&list);
+  }
+  expect_list(&list);
+
+  printf("modify through FOREACH\n");
+  int *p;
+  ULIST_FOREACH(int, &list, p) {
+    *p += 1;
+  }
+  for (x = 0; x < model_size; x++)
+    model[x]++;
+  expect_list(&list);
+
+  printf("running out of blocks\n");
+  ulist_int_clear(&list);
+  model_size = 0;
+  expect_list(&list);
+  for (x = 0; ulist_int_pushback(&list, x); x++)
+    model_insert(model_size, x);
+  assert(model_size == NBLOCKS * ULIST_CAPACITY(int));
+  assert(!ulist_int_enqueue(&list, -1));
+  assert(!ulist_int_insert(&list, 5, -1));
+  expect_list(&list);
+  // Freeing one value in the middle makes room in place, with no new block
+  ulist_int_erase(&list, 5);
+  model_erase(5);
+  assert(ulist_int_insert(&list, 5, 5));
+  model_insert(5, 5);
+  expect_list(&list);
+  ulist_int_clear(&list);
+  model_size = 0;
+  ulist_int_destroy(&list);
+
+  printf("big values\n");
+  bignode_t b;
+  bignode_t *bp;
+  ulist_bignode_t_init(&big_list, big_blocks, 4);
+  for (x = 0; x < 8; x++) {
+    b.data[11] = x;
+    assert(ulist_bignode_t_pushback(&big_list, b));
+  }
+  assert(!ulist_bignode_t_pushback(&big_list, b));
+  assert(!ulist_bignode_t_insert(&big_list, 3, b));
+  ulist_bignode_t_check(&big_list);
+  x = 0;
+  ULIST_FOREACH(bignode_t, &big_list, bp) {
+    assert(bp->data[11] == x);
+    x++;
+  }
+  assert(x == 8);
+  for (x = 0; ulist_bignode_t_pop(&big_list, &b); x++)
+    assert(b.data[11] == x);
+  assert(x == 8);
+  ulist_bignode_t_check(&big_list);
+  ulist_bignode_t_destroy(&big_list);
+
+  printf("PASSED!\n");
+}
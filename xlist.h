@@ -0,0 +1,268 @@
+// Generic XOR-linked list
+//
+// Usage:
+//   The same as dlist.h, with "xlist" in place of "dlist"
+//   1) include this header
+//   2) declare a "node" type, with a "xlist_node_t" as a member
+//   3) call "DEFINE_XLIST" with their node-type, and the member name
+//   4) The user must allocate a "xlist_t", to store the list, and call
+//      xlist_init() on it.
+//   5) The user must allocate all nodes before passing them in
+//   6) When done with the list user must call "xlist_destroy" on the list head
+//
+//   See xlist_unittest.c for example usage.
+//
+// Threadsafety:
+//   Not threadhostile, not threadsafe
+//   This datastructure includes no mutexing at all, and should be mutexed
+//   externally if locking is desired.
+//   This datastructure also never calls malloc - so it never calls any mutex.
+//
+// Usage Notes:
+//   This datastructure never calls malloc. Making it realtime-safe.
+//   A node can't be found from its neighbours without knowing where you came
+//   from, so there is no "next(node)" or "remove(node)". Nodes are reached by
+//   walking from an end (XLIST_FOREACH), and added or removed at the ends.
+//   This makes it a deque, use dlist.h if nodes must be removed from the
+//   middle.
+//
+// Design Decisions:
+//   * Each node stores one word, prev ^ next, half of a dlist_node_t. Given
+//     either neighbour you get the other with one xor, so the list can be
+//     walked from either end.
+//   * The ends store NULL for the missing neighbour, so head's link is just
+//     its next, and tail's its prev. Push and pop only touch the end node and
+//     its one neighbour.
+//   * Every step of a walk depends on the previous node's address as well as
+//     the current link, so it's an xor more per hop than dlist.h, and can't
+//     be done by a debugger or anything that doesn't know the scheme. In
+//     xlist_bench.c the smaller nodes make up for the xor.
+//   * Otherwise we follow dlist.h - everything is in the header, backend
+//     functions are shared by all types, and macros write a typesafe
+//     interface over them.
+
+#include <assert.h>
+#include <stdint.h>
+#include "offset.h"
+#include "panic.h"
+
+#ifndef XLIST_H
+#define XLIST_H
+
+// ******************* typedefs ****************
+
+// User should include this as a field in their node struct
+typedef struct {
+  uintptr_t link;
+} xlist_node_t;
+
+// User should use this type to store the list
+typedef struct {
+  xlist_node_t *head;
+  xlist_node_t *tail;
+} xlist_t;
+
+// A position in a walk, the current node and the one we came from
+typedef struct {
+  xlist_node_t *prev;
+  xlist_node_t *cur;
+} xlist_iter_t;
+
+// As in dlist.h we define a *new* struct that wraps the original, for
+// typechecking, and cast to call the backend.
+#define DEFINE_XLIST(type, metaname)  \
+  typedef struct {  \
+    xlist_t list;  \
+  } xlist_##type;  \
+  void xlist_##type##_init(xlist_##type *root) {  \
+    xlist_init((xlist_t*) root);  \
+  }  \
+  void xlist_##type##_destroy(xlist_##type *root) {  \
+    xlist_destroy((xlist_t*) root);  \
+  }  \
+  void xlist_##type##_check(const xlist_##type *root) {  \
+    xlist_check((const xlist_t*) root);  \
+  }  \
+  int xlist_##type##_empty(const xlist_##type *root) {  \
+    return !root->list.head;  \
+  }  \
+  void xlist_##type##_enqueue(xlist_##type *root, type *data) {  \
+    xlist_enqueue((xlist_t*) root, &(data->metaname));  \
+  }  \
+  void xlist_##type##_pushback(xlist_##type *root, type *data) {  \
+    xlist_pushback((xlist_t*) root, &(data->metaname));  \
+  }  \
+  void xlist_##type##_push(xlist_##type *root, type *data) {  \
+    xlist_push((xlist_t*) root, &(data->metaname));  \
+  }  \
+  type * xlist_##type##_dequeue(xlist_##type *root) {  \
+    xlist_node_t *ptr = xlist_dequeue((xlist_t*) root);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * xlist_##type##_pop(xlist_##type *root) {  \
+    xlist_node_t *ptr = xlist_pop((xlist_t*) root);  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * xlist_##type##_head(const xlist_##type *root) {  \
+    xlist_node_t *ptr = root->list.head;  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * xlist_##type##_tail(const xlist_##type *root) {  \
+    xlist_node_t *ptr = root->list.tail;  \
+    return ptr ? GET_CONTAINER(ptr, type, metaname) : NULL;  \
+  }  \
+  type * xlist_##type##_iter_get(const xlist_iter_t *it) {  \
+    return it->cur ? GET_CONTAINER(it->cur, type, metaname) : NULL;  \
+  }  \
+  void * xlist_##type##_foldr(  \
+      const xlist_##type *root,  \
+      void *(*func)(type*, void*, char*),  \
+      void *init) {  \
+    xlist_iter_t it = xlist_iter_init(root->list.head);  \
+    void* result = init;  \
+    for (; it.cur; xlist_iter_step(&it)) {  \
+      char terminate = 0;  \
+      result = (*func)(GET_CONTAINER(it.cur, type, metaname), result,  \
+                       &terminate);  \
+      if (terminate)  \
+        break;  \
+    }  \
+    return result;  \
+  }  \
+  void * xlist_##type##_foldl(  \
+      const xlist_##type *root,  \
+      void *(*func)(type*, void*, char*),  \
+      void *init) {  \
+    xlist_iter_t it = xlist_iter_init(root->list.tail);  \
+    void* result = init;  \
+    for (; it.cur; xlist_iter_step(&it)) {  \
+      char terminate = 0;  \
+      result = (*func)(GET_CONTAINER(it.cur, type, metaname), result,  \
+                       &terminate);  \
+      if (terminate)  \
+        break;  \
+    }  \
+    return result;  \
+  }
+
+// Inline iteration, as DLIST_FOREACH in dlist.h
+//   var - a "type *" that is set to each node in turn, it must be a plain
+//         identifier (it's used to name the loop's iterator)
+// The body must not add or remove nodes.
+#define XLIST_FOREACH(type, root, var)  \
+  for (xlist_iter_t xlist_it_##var = xlist_iter_init((root)->list.head);  \
+       ((var) = xlist_##type##_iter_get(&xlist_it_##var));  \
+       xlist_iter_step(&xlist_it_##var))
+
+// As XLIST_FOREACH, but from tail to head
+#define XLIST_FOREACH_REVERSE(type, root, var)  \
+  for (xlist_iter_t xlist_it_##var = xlist_iter_init((root)->list.tail);  \
+       ((var) = xlist_##type##_iter_get(&xlist_it_##var));  \
+       xlist_iter_step(&xlist_it_##var))
+
+
+// ******************* private functions ****************
+
+// Given one neighbour of "node", returns the other
+xlist_node_t * xlist_other(const xlist_node_t *node,
+                           const xlist_node_t *neighbour) {
+  return (xlist_node_t*) (node->link ^ (uintptr_t) neighbour);
+}
+
+// Starts a walk at an end of the list, it goes away from that end
+xlist_iter_t xlist_iter_init(xlist_node_t *end) {
+  xlist_iter_t it;
+  it.prev = NULL;
+  it.cur = end;
+  return it;
+}
+
+void xlist_iter_step(xlist_iter_t *it) {
+  xlist_node_t *next = xlist_other(it->cur, it->prev);
+  it->prev = it->cur;
+  it->cur = next;
+}
+
+void xlist_init(xlist_t *root) {
+  root->head = NULL;
+  root->tail = NULL;
+}
+
+void xlist_destroy(xlist_t *root) {
+  if (root->head) {
+    PANIC("xlist_destroy: list is non-empty");
+  }
+  // Drop some magic, so we notice if it gets used again without initialization
+  root->head = (xlist_node_t*) 0xdeadbeef;
+  root->tail = (xlist_node_t*) 0xdeadbeef;
+}
+
+// Adds "data" beyond the end node "*end", "*other_end" is the opposite end
+void xlist_add_end(xlist_node_t **end, xlist_node_t **other_end,
+                   xlist_node_t *data) {
+  xlist_node_t *old = *end;
+  data->link = (uintptr_t) old;
+  if (old) {
+    // old's outer neighbour was NULL, now it's data
+    old->link ^= (uintptr_t) data;
+  } else {
+    assert(!*other_end);
+    *other_end = data;
+  }
+  *end = data;
+}
+
+// Removes the end node "*end", "*other_end" is the opposite end
+xlist_node_t * xlist_remove_end(xlist_node_t **end, xlist_node_t **other_end) {
+  xlist_node_t *old = *end;
+  if (!old)
+    return NULL;
+  // An end node's link is just its one neighbour
+  xlist_node_t *next = (xlist_node_t*) old->link;
+  if (next) {
+    next->link ^= (uintptr_t) old;
+  } else {
+    assert(*other_end == old);
+    *other_end = NULL;
+  }
+  *end = next;
+  return old;
+}
+
+void xlist_enqueue(xlist_t *root, xlist_node_t *data) {
+  xlist_add_end(&root->head, &root->tail, data);
+}
+
+void xlist_pushback(xlist_t *root, xlist_node_t *data) {
+  xlist_add_end(&root->tail, &root->head, data);
+}
+
+void xlist_push(xlist_t *root, xlist_node_t *data) {
+  xlist_enqueue(root, data);
+}
+
+xlist_node_t * xlist_dequeue(xlist_t *root) {
+  return xlist_remove_end(&root->tail, &root->head);
+}
+
+xlist_node_t * xlist_pop(xlist_t *root) {
+  return xlist_remove_end(&root->head, &root->tail);
+}
+
+// Walks forward making sure we end at the tail, then backward making sure we
+// end at the head having seen the same number of nodes
+void xlist_check(const xlist_t *root) {
+  xlist_iter_t it;
+  size_t forward = 0;
+  size_t backward = 0;
+  assert(!root->head == !root->tail);
+  for (it = xlist_iter_init(root->head); it.cur; xlist_iter_step(&it))
+    forward++;
+  assert(it.prev == root->tail);
+  for (it = xlist_iter_init(root->tail); it.cur; xlist_iter_step(&it))
+    backward++;
+  assert(it.prev == root->head);
+  assert(forward == backward);
+}
+
+#endif
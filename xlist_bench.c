@@ -0,0 +1,167 @@
+// Benchmark for xlist (XOR-linked list) against dlist
+//
+// Usage:
+//   gcc -O2 -o xlist_bench xlist_bench.c
+//   ./xlist_bench [nodes]
+// "nodes" defaults to 10000000. Each list holds a node of a long, and is
+// walked in both directions, linked in array order and shuffled. Queue
+// operations are timed on a short list that stays in cache.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "dlist.h"
+#include "xlist.h"
+
+#define RUNS 5
+#define QUEUE_NODES 1024
+
+typedef struct {
+  dlist_node_t list_data;
+  long data;
+} mydnode_t;
+
+typedef struct {
+  xlist_node_t list_data;
+  long data;
+} myxnode_t;
+
+DEFINE_DLIST(mydnode_t, list_data)
+DEFINE_XLIST(myxnode_t, list_data)
+
+dlist_mydnode_t dlist;
+xlist_myxnode_t xlist;
+
+// Fills "order" with the indexes 0..count-1, shuffled if "shuffle" is set
+void make_order(size_t *order, size_t count, int shuffle) {
+  uint64_t seed = 1;
+  size_t i;
+  for (i = 0; i < count; i++)
+    order[i] = i;
+  if (!shuffle)
+    return;
+  for (i = count; i > 1; i--) {
+    size_t j = bench_rand(&seed) % i;
+    size_t tmp = order[i - 1];
+    order[i - 1] = order[j];
+    order[j] = tmp;
+  }
+}
+
+// Walks each list forward and back, and prints the best ns/node of each
+void scan(size_t count, int shuffle) {
+  mydnode_t *dnodes = malloc(count * sizeof(mydnode_t));
+  myxnode_t *xnodes = malloc(count * sizeof(myxnode_t));
+  size_t *order = malloc(count * sizeof(size_t));
+  long expect = (long) count * (long) (count - 1) / 2;
+  double best[4] = {1e9, 1e9, 1e9, 1e9};
+  size_t i;
+  int run;
+
+  make_order(order, count, shuffle);
+  dlist_mydnode_t_init(&dlist);
+  xlist_myxnode_t_init(&xlist);
+  for (i = 0; i < count; i++) {
+    dnodes[order[i]].data = i;
+    xnodes[order[i]].data = i;
+    dlist_mydnode_t_pushback(&dlist, &dnodes[order[i]]);
+    xlist_myxnode_t_pushback(&xlist, &xnodes[order[i]]);
+  }
+  free(order);
+  for (run = 0; run < RUNS; run++) {
+    double times[5];
+    long sums[4] = {0, 0, 0, 0};
+    mydnode_t *d;
+    myxnode_t *x;
+    int w;
+    times[0] = bench_now();
+    DLIST_FOREACH(mydnode_t, &dlist, d) {
+      sums[0] += d->data;
+    }
+    times[1] = bench_now();
+    XLIST_FOREACH(myxnode_t, &xlist, x) {
+      sums[1] += x->data;
+    }
+    times[2] = bench_now();
+    DLIST_FOREACH_REVERSE(mydnode_t, &dlist, d) {
+      sums[2] += d->data;
+    }
+    times[3] = bench_now();
+    XLIST_FOREACH_REVERSE(myxnode_t, &xlist, x) {
+      sums[3] += x->data;
+    }
+    times[4] = bench_now();
+    for (w = 0; w < 4; w++) {
+      if (sums[w] != expect)
+        abort();
+      if (times[w + 1] - times[w] < best[w])
+        best[w] = times[w + 1] - times[w];
+    }
+  }
+  printf("  %-8s forward  dlist %6.2f  xlist %6.2f"
+         "   reverse  dlist %6.2f  xlist %6.2f\n",
+         shuffle ? "shuffled" : "in order", best[0] * 1e9 / count,
+         best[1] * 1e9 / count, best[2] * 1e9 / count, best[3] * 1e9 / count);
+  while (xlist_myxnode_t_pop(&xlist))
+    ;
+  xlist_myxnode_t_destroy(&xlist);
+  dlist_mydnode_t_init(&dlist);
+  dlist_mydnode_t_destroy(&dlist);
+  free(xnodes);
+  free(dnodes);
+}
+
+// Rotates a short list, taking from the head and putting on the tail
+void queue(size_t ops) {
+  static mydnode_t dnodes[QUEUE_NODES];
+  static myxnode_t xnodes[QUEUE_NODES];
+  double best[2] = {1e9, 1e9};
+  size_t i;
+  int run;
+
+  dlist_mydnode_t_init(&dlist);
+  xlist_myxnode_t_init(&xlist);
+  for (i = 0; i < QUEUE_NODES; i++) {
+    dlist_mydnode_t_pushback(&dlist, &dnodes[i]);
+    xlist_myxnode_t_pushback(&xlist, &xnodes[i]);
+  }
+  for (run = 0; run < RUNS; run++) {
+    double start = bench_now();
+    double mid;
+    double end;
+    for (i = 0; i < ops; i++) {
+      mydnode_t *d = dlist_mydnode_t_first(&dlist);
+      dlist_mydnode_t_remove(&dlist, d);
+      dlist_mydnode_t_pushback(&dlist, d);
+    }
+    mid = bench_now();
+    for (i = 0; i < ops; i++)
+      xlist_myxnode_t_pushback(&xlist, xlist_myxnode_t_pop(&xlist));
+    end = bench_now();
+    if (mid - start < best[0])
+      best[0] = mid - start;
+    if (end - mid < best[1])
+      best[1] = end - mid;
+  }
+  printf("  pop+pushback  dlist %6.2f  xlist %6.2f  ns/op\n",
+         best[0] * 1e9 / ops, best[1] * 1e9 / ops);
+  while (xlist_myxnode_t_pop(&xlist))
+    ;
+  xlist_myxnode_t_destroy(&xlist);
+  dlist_mydnode_t_init(&dlist);
+  dlist_mydnode_t_destroy(&dlist);
+}
+
+int main(int argc, char **argv) {
+  size_t count = bench_arg(argc, argv, 1, 10000000);
+
+  printf("node of a long: dlist %zu bytes, xlist %zu bytes, %zuMB saved at "
+         "%zu nodes\n", sizeof(mydnode_t), sizeof(myxnode_t),
+         (sizeof(mydnode_t) - sizeof(myxnode_t)) * count >> 20, count);
+  printf("walk %zu nodes (ns/node)\n", count);
+  scan(count, 0);
+  scan(count, 1);
+  queue(count);
+  return 0;
+}
@@ -0,0 +1,154 @@
+// Unittest for xlist (XOR-linked list)
+
+
+#include <stdio.h>
+#include <string.h>
+#include "assert.h"
+#include "xlist.h"
+
+typedef struct {
+  int data;
+  xlist_node_t list_data;
+} mynode_t;
+
+DEFINE_XLIST(mynode_t, list_data)
+
+xlist_mynode_t list;
+
+void* print_node(mynode_t *n, void *last, char* term) {
+  printf("%d ", n->data);
+  return 0;
+}
+
+void* is_5(mynode_t *n, void *last, char* term) {
+  if (n->data == 5) {
+    // This short-circuits
+    *term = 1;
+    return n;
+  }
+  return 0;
+}
+
+void print_list(xlist_mynode_t *list) {
+  printf("flist = [");
+  xlist_mynode_t_foldl(list, print_node, 0);
+  printf("]\n");
+  printf("blist = [");
+  xlist_mynode_t_foldr(list, print_node, 0);
+  printf("]\n");
+}
+
+// Asserts "list" holds exactly "expect", in order, and is well formed
+void expect_list(xlist_mynode_t *list, const int *expect, int len) {
+  mynode_t *n;
+  int i = 0;
+  xlist_mynode_t_check(list);
+  XLIST_FOREACH(mynode_t, list, n) {
+    assert(i < len);
+    assert(n->data == expect[i]);
+    i++;
+  }
+  assert(i == len);
+  XLIST_FOREACH_REVERSE(mynode_t, list, n) {
+    i--;
+    assert(n->data == expect[i]);
+  }
+  assert(i == 0);
+  assert(xlist_mynode_t_empty(list) == (len == 0));
+}
+
+mynode_t * new_node(int data) {
+  mynode_t *n = malloc(sizeof(mynode_t));
+  n->data = data;
+  return n;
+}
+
+int main(unsigned int argc, char **argv) {
+  mynode_t *n;
+  int expect[64];
+  int len = 0;
+  int x;
+
+  assert(sizeof(xlist_node_t) == sizeof(void*));
+
+  printf("initializing list\n");
+  xlist_mynode_t_init(&list);
+  expect_list(&list, NULL, 0);
+  assert(!xlist_mynode_t_head(&list));
+  assert(!xlist_mynode_t_tail(&list));
+  assert(!xlist_mynode_t_pop(&list));
+  assert(!xlist_mynode_t_dequeue(&list));
+
+  printf("test base cases\n");
+  n = new_node(1);
+  xlist_mynode_t_pushback(&list, n);
+  expect[0] = 1;
+  expect_list(&list, expect, 1);
+  assert(xlist_mynode_t_head(&list) == n);
+  assert(xlist_mynode_t_tail(&list) == n);
+  assert(xlist_mynode_t_pop(&list) == n);
+  expect_list(&list, NULL, 0);
+  xlist_mynode_t_push(&list, n);
+  assert(xlist_mynode_t_dequeue(&list) == n);
+  expect_list(&list, NULL, 0);
+  free(n);
+
+  printf("inserting elements at both ends\n");
+  for (x = 0; x < 10; x++) {
+    xlist_mynode_t_enqueue(&list, new_node(9 - x));
+    xlist_mynode_t_pushback(&list, new_node(10 + x));
+  }
+  for (len = 0; len < 20; len++)
+    expect[len] = len;
+  expect_list(&list, expect, len);
+  print_list(&list);
+
+  printf("fold short-circuits\n");
+  n = xlist_mynode_t_foldr(&list, is_5, 0);
+  assert(n && n->data == 5);
+
+  printf("pop and dequeue\n");
+  n = xlist_mynode_t_pop(&list);
+  assert(n->data == 0);
+  free(n);
+  n = xlist_mynode_t_dequeue(&list);
+  assert(n->data == 19);
+  free(n);
+  expect_list(&list, expect + 1, 18);
+
+  printf("interleaved churn\n");
+  srand(1);
+  len = 0;
+  while ((n = xlist_mynode_t_pop(&list)))
+    free(n);
+  for (x = 0; x < 10000; x++) {
+    int op = rand() % 4;
+    if (op == 0 && len < 64) {
+      memmove(&expect[1], &expect[0], len * sizeof(int));
+      expect[0] = x;
+      len++;
+      xlist_mynode_t_enqueue(&list, new_node(x));
+    } else if (op == 1 && len < 64) {
+      expect[len++] = x;
+      xlist_mynode_t_pushback(&list, new_node(x));
+    } else if (op == 2 && len) {
+      n = xlist_mynode_t_pop(&list);
+      assert(n->data == expect[0]);
+      memmove(&expect[0], &expect[1], --len * sizeof(int));
+      free(n);
+    } else if (op == 3 && len) {
+      n = xlist_mynode_t_dequeue(&list);
+      assert(n->data == expect[--len]);
+      free(n);
+    }
+    if (x % 37 == 0)
+      expect_list(&list, expect, len);
+  }
+  expect_list(&list, expect, len);
+
+  while ((n = xlist_mynode_t_dequeue(&list)))
+    free(n);
+  xlist_mynode_t_destroy(&list);
+
+  printf("PASSED!\n");
+}